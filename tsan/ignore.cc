@@ -99,6 +99,57 @@ bool TripleVectorMatchKnown(const vector<IgnoreTriple>& v,
   return false;
 }
 
+void IgnoreMatcher::Compile(const vector<IgnoreTriple>& v) {
+  for (int c = 0; c < kNumComponents; c++) {
+    literals_[c].clear();
+    wildcards_[c].clear();
+  }
+  other_.clear();
+  for (size_t i = 0; i < v.size(); i++) {
+    const string *patterns[kNumComponents] = {&v[i].fun, &v[i].obj,
+                                              &v[i].file};
+    int n_nontrivial = 0, component = 0;
+    for (int c = 0; c < kNumComponents; c++) {
+      if (*patterns[c] != "*") {
+        n_nontrivial++;
+        component = c;
+      }
+    }
+    const string &pattern = *patterns[component];
+    if (n_nontrivial != 1 || pattern.empty()) {
+      other_.push_back(v[i]);
+    } else if (pattern.find_first_of("*?") == string::npos) {
+      literals_[component].insert(pattern);
+    } else {
+      wildcards_[component].push_back(pattern);
+    }
+  }
+}
+
+bool IgnoreMatcher::Match(const string& fun,
+                          const string& obj,
+                          const string& file) const {
+  const string *names[kNumComponents] = {&fun, &obj, &file};
+  for (int c = 0; c < kNumComponents; c++) {
+    const string &name = *names[c];
+    // An empty name is unknown, see TripleVectorMatchKnown.
+    if (name.empty()) continue;
+    if (literals_[c].count(name))
+      return true;
+    for (size_t i = 0; i < wildcards_[c].size(); i++) {
+      if (ThreadSanitizerStringMatch(wildcards_[c][i], name))
+        return true;
+    }
+  }
+  return TripleVectorMatchKnown(other_, fun, obj, file);
+}
+
+void CompileIgnoreLists(IgnoreLists *ignore_lists) {
+  ignore_lists->ignores_matcher.Compile(ignore_lists->ignores);
+  ignore_lists->ignores_r_matcher.Compile(ignore_lists->ignores_r);
+  ignore_lists->ignores_hist_matcher.Compile(ignore_lists->ignores_hist);
+}
+
 bool StringVectorMatch(const vector<string>& v, const string& obj) {
   for (size_t i = 0; i < v.size(); i++)
     if (ThreadSanitizerStringMatch(v[i], obj))
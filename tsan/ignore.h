@@ -29,10 +29,34 @@ struct IgnoreFile : public IgnoreTriple {
   IgnoreFile(string file) : IgnoreTriple("*", "*", file) {}
 };
 
+// A vector of IgnoreTriple compiled for matching: Match() gives the same
+// answer as TripleVectorMatchKnown() on that vector.
+// A triple with only one pattern other than "*" (that's what the fun:, obj:
+// and src: lines give) is filed under that component: patterns without
+// wildcards go into a set, the rest are matched one by one. Other triples are
+// matched by TripleVectorMatchKnown().
+// Not changed after Compile(), so Match() may be called without a lock.
+class IgnoreMatcher {
+ public:
+  void Compile(const vector<IgnoreTriple>& v);
+  bool Match(const string& fun, const string& obj, const string& file) const;
+
+ private:
+  enum { kFun, kObj, kFile, kNumComponents };
+  set<string> literals_[kNumComponents];
+  vector<string> wildcards_[kNumComponents];
+  vector<IgnoreTriple> other_;
+};
+
 struct IgnoreLists {
   vector<IgnoreTriple> ignores;
   vector<IgnoreTriple> ignores_r;
   vector<IgnoreTriple> ignores_hist;
+
+  // Filled by CompileIgnoreLists() once all the entries are added.
+  IgnoreMatcher ignores_matcher;
+  IgnoreMatcher ignores_r_matcher;
+  IgnoreMatcher ignores_hist_matcher;
 };
 
 extern IgnoreLists *g_ignore_lists;
@@ -43,6 +67,8 @@ extern IgnoreLists *g_white_lists;
 void ReadIgnoresFromString(const string& ignoreString,
     IgnoreLists* ignoreLists);
 
+void CompileIgnoreLists(IgnoreLists *ignore_lists);
+
 bool TripleVectorMatchKnown(const vector<IgnoreTriple>& v,
     const string& fun,
     const string& obj,
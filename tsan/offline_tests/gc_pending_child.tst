@@ -0,0 +1,2450 @@
+# The shadow memory GC must not drop a segment which does not happen-before
+# a child thread that is created but has not started yet.
+# T1 writes 0xabcde and exits. T0 acquires the lock T1 released, so the
+# write happens-before every segment of a running thread. It does not
+# happen-before T2: T0 created T2 before acquiring the lock.
+# FLAGS: --gc_lines_per_slice=1024 --max_sid_before_flush=1500
+# EXPECT: reported 1 warning(s) (1 race(s))
+
+# Start threads T0 and T1.
+THR_START 0 0 0 0
+THR_START 1 0 0 0
+
+RTN_CALL 0 ca000001 ca000002 0
+RTN_CALL 1 ca100001 ca100002 0
+
+MALLOC 0 cdeffedc abcd0 ff
+MALLOC 0 cdeffedc 100000 10000
+
+# T0 starts creating T2.
+THR_CREATE_BEFORE 0 ca000010 0 0
+
+# Write to 0xabcde in T1.
+SBLOCK_ENTER 1 ca100002 0 0
+WRITE 1 aa108001 abcde 1
+
+# T1 hands lock 7777 over to T0 and exits.
+WRITER_LOCK 1 bb 7777 0
+UNLOCK 1 bb 7777 0
+THR_END 1 0 0 0
+WRITER_LOCK 0 aa 7777 0
+UNLOCK 0 aa 7777 0
+
+# T0 creates 800 segments, each one written to a new location, so that
+# more than max_sid_before_flush/2 SIDs are in use and the GC runs.
+SBLOCK_ENTER 0 ca000002 0 0
+
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100000 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100004 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100008 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10000c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100010 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100014 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100018 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10001c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100020 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100024 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100028 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10002c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100030 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100034 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100038 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10003c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100040 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100044 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100048 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10004c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100050 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100054 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100058 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10005c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100060 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100064 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100068 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10006c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100070 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100074 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100078 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10007c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100080 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100084 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100088 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10008c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100090 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100094 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100098 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10009c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1000fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100100 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100104 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100108 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10010c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100110 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100114 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100118 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10011c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100120 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100124 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100128 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10012c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100130 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100134 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100138 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10013c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100140 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100144 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100148 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10014c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100150 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100154 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100158 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10015c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100160 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100164 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100168 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10016c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100170 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100174 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100178 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10017c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100180 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100184 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100188 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10018c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100190 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100194 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100198 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10019c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1001fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100200 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100204 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100208 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10020c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100210 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100214 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100218 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10021c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100220 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100224 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100228 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10022c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100230 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100234 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100238 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10023c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100240 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100244 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100248 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10024c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100250 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100254 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100258 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10025c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100260 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100264 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100268 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10026c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100270 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100274 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100278 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10027c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100280 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100284 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100288 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10028c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100290 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100294 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100298 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10029c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1002fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100300 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100304 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100308 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10030c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100310 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100314 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100318 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10031c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100320 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100324 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100328 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10032c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100330 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100334 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100338 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10033c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100340 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100344 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100348 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10034c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100350 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100354 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100358 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10035c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100360 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100364 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100368 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10036c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100370 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100374 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100378 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10037c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100380 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100384 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100388 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10038c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100390 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100394 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100398 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10039c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1003fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100400 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100404 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100408 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10040c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100410 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100414 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100418 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10041c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100420 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100424 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100428 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10042c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100430 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100434 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100438 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10043c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100440 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100444 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100448 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10044c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100450 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100454 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100458 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10045c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100460 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100464 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100468 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10046c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100470 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100474 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100478 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10047c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100480 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100484 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100488 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10048c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100490 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100494 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100498 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10049c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1004fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100500 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100504 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100508 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10050c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100510 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100514 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100518 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10051c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100520 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100524 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100528 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10052c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100530 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100534 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100538 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10053c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100540 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100544 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100548 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10054c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100550 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100554 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100558 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10055c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100560 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100564 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100568 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10056c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100570 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100574 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100578 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10057c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100580 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100584 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100588 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10058c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100590 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100594 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100598 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10059c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1005fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100600 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100604 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100608 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10060c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100610 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100614 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100618 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10061c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100620 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100624 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100628 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10062c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100630 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100634 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100638 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10063c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100640 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100644 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100648 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10064c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100650 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100654 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100658 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10065c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100660 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100664 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100668 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10066c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100670 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100674 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100678 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10067c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100680 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100684 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100688 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10068c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100690 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100694 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100698 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10069c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1006fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100700 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100704 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100708 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10070c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100710 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100714 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100718 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10071c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100720 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100724 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100728 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10072c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100730 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100734 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100738 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10073c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100740 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100744 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100748 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10074c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100750 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100754 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100758 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10075c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100760 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100764 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100768 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10076c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100770 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100774 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100778 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10077c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100780 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100784 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100788 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10078c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100790 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100794 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100798 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10079c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1007fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100800 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100804 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100808 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10080c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100810 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100814 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100818 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10081c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100820 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100824 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100828 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10082c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100830 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100834 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100838 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10083c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100840 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100844 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100848 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10084c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100850 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100854 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100858 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10085c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100860 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100864 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100868 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10086c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100870 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100874 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100878 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10087c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100880 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100884 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100888 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10088c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100890 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100894 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100898 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10089c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1008fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100900 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100904 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100908 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10090c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100910 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100914 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100918 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10091c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100920 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100924 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100928 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10092c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100930 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100934 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100938 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10093c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100940 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100944 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100948 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10094c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100950 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100954 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100958 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10095c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100960 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100964 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100968 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10096c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100970 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100974 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100978 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10097c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100980 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100984 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100988 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10098c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100990 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100994 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100998 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 10099c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009a0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009a4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009a8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009ac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009b0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009b4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009b8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009bc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009c0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009c4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009c8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009cc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009d0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009d4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009d8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009dc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009e0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009e4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009e8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009ec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009f0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009f4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009f8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 1009fc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a00 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a04 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a08 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a0c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a10 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a14 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a18 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a1c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a20 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a24 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a28 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a2c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a30 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a34 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a38 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a3c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a40 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a44 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a48 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a4c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a50 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a54 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a58 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a5c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a60 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a64 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a68 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a6c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a70 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a74 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a78 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a7c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a80 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a84 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a88 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a8c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a90 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a94 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a98 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100a9c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100aa0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100aa4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100aa8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100aac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ab0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ab4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ab8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100abc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ac0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ac4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ac8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100acc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ad0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ad4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ad8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100adc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ae0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ae4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ae8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100aec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100af0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100af4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100af8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100afc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b00 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b04 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b08 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b0c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b10 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b14 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b18 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b1c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b20 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b24 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b28 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b2c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b30 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b34 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b38 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b3c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b40 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b44 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b48 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b4c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b50 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b54 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b58 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b5c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b60 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b64 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b68 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b6c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b70 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b74 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b78 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b7c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b80 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b84 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b88 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b8c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b90 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b94 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b98 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100b9c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ba0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ba4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100ba8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bac 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bb0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bb4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bb8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bbc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bc0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bc4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bc8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bcc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bd0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bd4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bd8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bdc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100be0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100be4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100be8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bec 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bf0 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bf4 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bf8 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100bfc 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c00 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c04 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c08 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c0c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c10 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c14 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c18 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c1c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c20 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c24 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c28 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c2c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c30 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c34 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c38 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c3c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c40 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c44 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c48 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c4c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c50 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c54 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c58 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c5c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c60 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c64 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c68 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c6c 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c70 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c74 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c78 4
+UNLOCK 0 aa 7778 0
+WRITER_LOCK 0 aa 7778 0
+WRITE 0 aa008002 100c7c 4
+UNLOCK 0 aa 7778 0
+
+# T2 starts.
+THR_CREATE_AFTER 0 ca000010 0 2
+THR_START 2 0 0 0
+RTN_CALL 2 ca200001 ca200002 0
+
+##############
+# Race here: #
+##############
+SBLOCK_ENTER 2 ca200002 0 0
+WRITE 2 aa208001 abcde 1
+
+THR_END 2 0 0 0
+THR_END 0 0 0 0
@@ -0,0 +1,32 @@
+# A race report must point at the last access of the other thread, even if
+# that thread did not synchronize between its accesses.
+# 0x300 is the routine of the second write of T0, not of the first one.
+# EXPECT: Race verifier data: 0x511,0x300
+# EXPECT: reported 1 warning(s) (1 race(s))
+
+# Start threads T0 and T1.
+THR_START 0 0 0 0
+THR_START 1 0 0 0
+
+RTN_CALL 0 100 200 0
+RTN_CALL 1 500 510 0
+
+MALLOC 0 cdeffedc 5000 100
+
+# T0 writes to 0x5010 in routine 0x200...
+SBLOCK_ENTER 0 200 0 0
+WRITE 0 210 5010 4
+
+# ... and then again in routine 0x300, with no synchronization in between.
+RTN_CALL 0 220 300 0
+SBLOCK_ENTER 0 300 0 0
+WRITE 0 310 5010 4
+
+##############
+# Race here: #
+##############
+SBLOCK_ENTER 1 510 0 0
+WRITE 1 511 5010 4
+
+THR_END 0 0 0 0
+THR_END 1 0 0 0
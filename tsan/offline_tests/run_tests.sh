@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Runs ThreadSanitizerOffline on every offline_tests/*.tst file.
+# A test may have lines of the form
+#   # FLAGS: <flags passed to ts_offline>
+#   # EXPECT: <text which must appear in the output>
+# A test passes if the output has every EXPECT text.
+#
+# Usage: run_tests.sh <path to ts_offline> [test.tst ...]
+
+TS_OFFLINE=$1
+shift
+TESTS_DIR=`dirname $0`
+TESTS=${@:-$TESTS_DIR/*.tst}
+
+if [ ! -x "$TS_OFFLINE" ]; then
+  echo "Usage: $0 <path to ts_offline> [test.tst ...]"
+  exit 1
+fi
+
+N_FAILED=0
+for TEST in $TESTS; do
+  FLAGS=`sed -n 's/^# FLAGS: //p' $TEST`
+  OUTPUT=`$TS_OFFLINE $FLAGS < $TEST 2>&1`
+  RESULT=PASSED
+  while read -r EXPECT; do
+    if ! echo "$OUTPUT" | grep -qF -- "$EXPECT"; then
+      echo "$TEST: expected '$EXPECT'"
+      RESULT=FAILED
+    fi
+  done < <(sed -n 's/^# EXPECT: //p' $TEST)
+  if [ "$RESULT" == "FAILED" ]; then
+    N_FAILED=$((N_FAILED + 1))
+  fi
+  echo "$RESULT: $TEST"
+done
+
+if [ $N_FAILED -ne 0 ]; then
+  echo "$N_FAILED test(s) failed"
+  exit 1
+fi
@@ -1,3 +1,5 @@
+# EXPECT: reported 1 warning(s) (1 race(s))
+
 # Start thread T0.
 THR_START 0 0 0 0
 
@@ -321,8 +321,92 @@ bool ThreadSanitizerParser::NextSuppression(Suppression* supp) {
   return true;
 }
 
+// Stack trace templates of all suppressions with the same tool and warning
+// name are compiled into a trie. Each edge is one Location, so templates
+// with a common prefix share nodes. Literal fun: and obj: patterns (without
+// '*' or '?') are looked up in a map instead of being matched one by one,
+// which is what most suppressions look like. Wildcard patterns and '...'
+// are still tried in turn.
+struct TemplateTrieNode {
+  static const int kNoSuppression = INT_MAX;
+
+  TemplateTrieNode()
+      : suppression_index(kNoSuppression), min_index(kNoSuppression),
+        star(NULL) {}
+
+  ~TemplateTrieNode() {
+    for (map<string, TemplateTrieNode*>::iterator it = literal_fun.begin();
+         it != literal_fun.end(); ++it)
+      delete it->second;
+    for (map<string, TemplateTrieNode*>::iterator it = literal_obj.begin();
+         it != literal_obj.end(); ++it)
+      delete it->second;
+    for (size_t i = 0; i < wildcards.size(); i++)
+      delete wildcards[i].second;
+    delete star;
+  }
+
+  // The first suppression with a template ending here.
+  int suppression_index;
+  // The first suppression with a template ending in this subtree.
+  int min_index;
+  map<string, TemplateTrieNode*> literal_fun;
+  map<string, TemplateTrieNode*> literal_obj;
+  vector<pair<Location, TemplateTrieNode*> > wildcards;
+  TemplateTrieNode *star;
+};
+
+static bool IsLiteralPattern(const string &pattern) {
+  return pattern.find_first_of("*?") == string::npos;
+}
+
+static TemplateTrieNode *GetChild(TemplateTrieNode *node,
+                                  const Location &location) {
+  TemplateTrieNode **child;
+  if (location.type == LT_STAR) {
+    child = &node->star;
+  } else if (IsLiteralPattern(location.name)) {
+    child = location.type == LT_FUN ? &node->literal_fun[location.name]
+                                    : &node->literal_obj[location.name];
+  } else {
+    child = NULL;
+    for (size_t i = 0; i < node->wildcards.size(); i++) {
+      Location &l = node->wildcards[i].first;
+      if (l.type == location.type && l.name == location.name)
+        child = &node->wildcards[i].second;
+    }
+    if (!child) {
+      node->wildcards.push_back(make_pair(location,
+                                          (TemplateTrieNode*)NULL));
+      child = &node->wildcards.back().second;
+    }
+  }
+  if (!*child)
+    *child = new TemplateTrieNode;
+  return *child;
+}
+
+static void AddTemplateToTrie(TemplateTrieNode *root,
+                              const StackTraceTemplate &tmpl, int index) {
+  TemplateTrieNode *node = root;
+  node->min_index = min(node->min_index, index);
+  for (size_t i = 0; i < tmpl.locations.size(); i++) {
+    node = GetChild(node, tmpl.locations[i]);
+    node->min_index = min(node->min_index, index);
+  }
+  node->suppression_index = min(node->suppression_index, index);
+}
+
 struct ThreadSanitizerSuppressions::SuppressionsRep {
+  ~SuppressionsRep() {
+    for (map<pair<string, string>, TemplateTrieNode*>::iterator it =
+         tries.begin(); it != tries.end(); ++it)
+      delete it->second;
+  }
+
   vector<Suppression> suppressions;
+  // (tool, warning name) => templates of the matching suppressions.
+  map<pair<string, string>, TemplateTrieNode*> tries;
   string error_string_;
   int error_line_no_;
 };
@@ -340,7 +424,18 @@ int ThreadSanitizerSuppressions::ReadFromString(const string &str) {
   ThreadSanitizerParser* parser = new ThreadSanitizerParser(str);
   Suppression *supp = new Suppression();
   while (parser->NextSuppression(supp)) {
+    int index = rep_->suppressions.size();
     rep_->suppressions.push_back(*supp);
+    for (set<string>::iterator tool = supp->tools.begin();
+         tool != supp->tools.end(); ++tool) {
+      TemplateTrieNode *&root =
+          rep_->tries[make_pair(*tool, supp->warning_name)];
+      if (!root)
+        root = new TemplateTrieNode;
+      for (size_t i = 0; i < supp->templates.size(); i++)
+        AddTemplateToTrie(root, supp->templates[i], index);
+    }
+    *supp = Suppression();
   }
   int res = -1;
   if (parser->GetError()) {
@@ -369,49 +464,72 @@ struct MatcherContext {
       const vector<string>& object_names_) :
       function_names_mangled(function_names_mangled_),
       function_names_demangled(function_names_demangled_),
-      object_names(object_names_),
-      tmpl(NULL)
+      object_names(object_names_)
   {}
 
   const vector<string>& function_names_mangled;
   const vector<string>& function_names_demangled;
   const vector<string>& object_names;
-  StackTraceTemplate* tmpl;
 };
 
-static bool MatchStackTraceRecursive(MatcherContext ctx,
-                                     size_t trace_index,
-                                     size_t tmpl_index) {
+static TemplateTrieNode *FindChild(const map<string, TemplateTrieNode*> &m,
+                                   const string &name) {
+  map<string, TemplateTrieNode*>::const_iterator it = m.find(name);
+  return it == m.end() ? NULL : it->second;
+}
+
+// Lower *best to the index of the first suppression in the subtree of
+// 'node' whose template matches the frames starting at 'trace_index'.
+// Like valgrind, a template only has to match the top of the stack and
+// '...' matches zero or more frames, but not past the end of the stack.
+static void MatchTrie(const MatcherContext &ctx, const TemplateTrieNode *node,
+                      size_t trace_index, int *best) {
+  if (node->min_index >= *best)
+    return;
+  if (node->suppression_index < *best)
+    *best = node->suppression_index;
   const size_t trace_size = ctx.function_names_mangled.size();
-  const size_t tmpl_size = ctx.tmpl->locations.size();
-  while (trace_index < trace_size && tmpl_index < tmpl_size) {
-    Location& location = ctx.tmpl->locations[tmpl_index];
-    if (location.type == LT_STAR) {
-      ++tmpl_index;
-      while (trace_index < trace_size) {
-        if (MatchStackTraceRecursive(ctx, trace_index++, tmpl_index))
-          return true;
-      }
-      return false;
+  if (trace_index == trace_size)
+    return;
+
+  // The callers may pass fewer demangled names or objects than frames.
+  const string &mangled = ctx.function_names_mangled[trace_index];
+  const string *demangled =
+      trace_index < ctx.function_names_demangled.size() ?
+      &ctx.function_names_demangled[trace_index] : NULL;
+  const string *object = trace_index < ctx.object_names.size() ?
+      &ctx.object_names[trace_index] : NULL;
+  TemplateTrieNode *child = FindChild(node->literal_fun, mangled);
+  if (child)
+    MatchTrie(ctx, child, trace_index + 1, best);
+  if (demangled && *demangled != mangled) {
+    child = FindChild(node->literal_fun, *demangled);
+    if (child)
+      MatchTrie(ctx, child, trace_index + 1, best);
+  }
+  if (object) {
+    child = FindChild(node->literal_obj, *object);
+    if (child)
+      MatchTrie(ctx, child, trace_index + 1, best);
+  }
+  for (size_t i = 0; i < node->wildcards.size(); i++) {
+    const Location &location = node->wildcards[i].first;
+    bool match;
+    if (location.type == LT_OBJ) {
+      match = object && ThreadSanitizerStringMatch(location.name, *object);
     } else {
-      bool match = false;
-      if (location.type == LT_OBJ) {
-        match = ThreadSanitizerStringMatch(location.name, ctx.object_names[trace_index]);
-      } else {
-        CHECK(location.type == LT_FUN);
-        match =
-          ThreadSanitizerStringMatch(location.name, ctx.function_names_mangled[trace_index]) ||
-          ThreadSanitizerStringMatch(location.name, ctx.function_names_demangled[trace_index]);
-      }
-      if (match) {
-        ++trace_index;
-        ++tmpl_index;
-      } else {
-        return false;
-      }
+      CHECK(location.type == LT_FUN);
+      match = ThreadSanitizerStringMatch(location.name, mangled) ||
+              (demangled &&
+               ThreadSanitizerStringMatch(location.name, *demangled));
     }
+    if (match)
+      MatchTrie(ctx, node->wildcards[i].second, trace_index + 1, best);
+  }
+  if (node->star) {
+    for (size_t i = trace_index; i < trace_size; i++)
+      MatchTrie(ctx, node->star, i, best);
   }
-  return tmpl_index == tmpl_size;
 }
 
 bool ThreadSanitizerSuppressions::StackTraceSuppressed(const string& tool_name,
@@ -420,22 +538,16 @@ bool ThreadSanitizerSuppressions::StackTraceSuppressed(const string& tool_name,
     const vector<string>& function_names_demangled,
     const vector<string>& object_names,
     string *name_of_suppression) {
+  map<pair<string, string>, TemplateTrieNode*>::iterator it =
+      rep_->tries.find(make_pair(tool_name, warning_name));
+  if (it == rep_->tries.end())
+    return false;
   MatcherContext ctx(function_names_mangled, function_names_demangled,
       object_names);
-  for (vector<Suppression>::iterator it = rep_->suppressions.begin();
-       it != rep_->suppressions.end(); ++it) {
-    if (it->warning_name != warning_name ||
-        it->tools.find(tool_name) == it->tools.end())
-      continue;
-    for (vector<StackTraceTemplate>::iterator it2 = it->templates.begin();
-         it2 != it->templates.end(); ++it2) {
-      ctx.tmpl = &*it2;
-      bool result = MatchStackTraceRecursive(ctx, 0, 0);
-      if (result) {
-        *name_of_suppression = it->name;
-        return true;
-      }
-    }
-  }
-  return false;
+  int best = TemplateTrieNode::kNoSuppression;
+  MatchTrie(ctx, it->second, 0, &best);
+  if (best == TemplateTrieNode::kNoSuppression)
+    return false;
+  *name_of_suppression = rep_->suppressions[best].name;
+  return true;
 }
@@ -357,6 +357,58 @@ TEST_F(BaseSuppressionsTest, ComparisonAndShiftOperators) {
   ASSERT_TRUE(IsSuppressed(VEC(m), VEC(d), VEC(o)));
 }
 
+// The tools and stack traces of one suppression must not leak into the
+// next one in the same file.
+TEST_F(BaseSuppressionsTest, SuppressionsAreIndependent) {
+  const string data =
+      "{\n"
+      "  name1\n"
+      "  other_tool:test_warning_type\n"
+      "  fun:function1\n"
+      "}\n"
+      "{\n"
+      "  name2\n"
+      "  test_tool:test_warning_type\n"
+      "  fun:function2\n"
+      "}";
+  ASSERT_EQ(2, supp_.ReadFromString(data));
+  string m[] = {"function1", "bb"};
+  string d[] = {"aaa", "bbb"};
+  string o[] = {"object1", "object2"};
+  ASSERT_FALSE(IsSuppressed(VEC(m), VEC(d), VEC(o)));
+  ASSERT_TRUE(IsSuppressed("other_tool", "test_warning_type",
+                           VEC(m), VEC(d), VEC(o)));
+}
+
+// If several suppressions match, the first one in the file is reported.
+TEST_F(BaseSuppressionsTest, FirstMatchingSuppressionWins) {
+  const string data =
+      "{\n"
+      "  name1\n"
+      "  test_tool:test_warning_type\n"
+      "  fun:function1\n"
+      "  fun:zz\n"
+      "}\n"
+      "{\n"
+      "  name2\n"
+      "  test_tool:test_warning_type\n"
+      "  ...\n"
+      "  fun:bb\n"
+      "}\n"
+      "{\n"
+      "  name3\n"
+      "  test_tool:test_warning_type\n"
+      "  fun:function1\n"
+      "}";
+  ASSERT_EQ(3, supp_.ReadFromString(data));
+  string m[] = {"function1", "bb"};
+  string d[] = {"aaa", "bbb"};
+  string o[] = {"object1", "object2"};
+  string name;
+  ASSERT_TRUE(supp_.StackTraceSuppressed("test_tool", "test_warning_type",
+                                         VEC(m), VEC(d), VEC(o), &name));
+  ASSERT_EQ("name2", name);
+}
 
 class FailingSuppressionsTest : public ::testing::Test {
  protected:
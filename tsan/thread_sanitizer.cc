@@ -71,7 +71,7 @@ bool g_has_exited_main = false;
 size_t g_last_flush_time;
 
 // Incremented on each Lock and Unlock. Used by LockHistory.
-uint32_t g_lock_era = 0;
+int32_t g_lock_era = 0;
 
 uintptr_t g_nacl_mem_start = (uintptr_t)-1;
 uintptr_t g_nacl_mem_end = (uintptr_t)-1;
@@ -122,6 +122,100 @@ class TIL {
 static TSLock *ts_lock;
 static TSLock *ts_ignore_below_lock;
 
+// With --locking_scheme=2 each of the shared tables below is additionally
+// protected by its own lock. A thread may hold ts_lock while taking one of
+// them. The pool locks (kSegmentPoolLock, kCacheLinePoolLock, kVtsPoolLock,
+// kShadowSpillLock) are the innermost ones and may be taken while holding
+// any other subsystem lock (or a Cache shard lock); the rest never nest with
+// each other.
+enum SubsystemLockId {
+  kLockTableLock,      // Lock::map_ and the state of each Lock.
+  kLockSetLock,        // LockSet intern table and caches.
+  kSegmentSetLock,     // SegmentSet intern table and recycle queues.
+  kSegmentPoolLock,    // Segment::reusable_sids_, Segment::n_segments_.
+  kHeapMapLock,        // G_heap_map.
+  kSignallerMapLock,   // TSanThread::signaller_map_.
+  kStackDepotLock,     // StackDepot insertions.
+  kCacheLinePoolLock,  // CacheLine and CompressedCacheLine free lists.
+  kVtsPoolLock,        // VTS free lists.
+  kShadowSpillLock,    // ShadowSpill free slots.
+  kNumSubsystemLocks
+};
+
+static TSLock *ts_subsystem_locks[kNumSubsystemLocks];
+// Number of threads holding or waiting for each subsystem lock.
+// Used only to count contention.
+static int32_t ts_subsystem_lock_users[kNumSubsystemLocks];
+
+// Scoped lock for one subsystem; a no-op unless --locking_scheme >= 2.
+class SubsystemTIL {
+ public:
+  explicit SubsystemTIL(SubsystemLockId id)
+    : id_(id),
+      need_locking_(TS_SERIALIZED == 0 && G_flags->locking_scheme >= 2) {
+    if (need_locking_) {
+      bool contended =
+          NoBarrier_AtomicIncrement(&ts_subsystem_lock_users[id_]) > 1;
+      ts_subsystem_locks[id_]->Lock();
+      G_stats->subsystem_lock_sites[id_]++;
+      if (contended)
+        G_stats->subsystem_lock_contention[id_]++;
+    }
+  }
+  ~SubsystemTIL() {
+    if (need_locking_) {
+      ts_subsystem_locks[id_]->Unlock();
+      NoBarrier_AtomicDecrement(&ts_subsystem_lock_users[id_]);
+    }
+  }
+ private:
+  SubsystemLockId id_;
+  bool need_locking_;
+};
+
+// With --locking_scheme=2 lock/unlock and malloc/free events are handled
+// w/o ts_lock (see Detector::HandleEventWithoutTsLock); the subsystem locks
+// above protect the shared state they touch. Such a handler runs between
+// Enter() and Leave() and must not take ts_lock.
+// ForgetAllStateAndStartOver() closes the gate and waits for the handlers
+// inside it to finish before it resets the state they use.
+class UnlockedHandlerGate {
+ public:
+  // Returns false if the state is being flushed; then the event
+  // has to be handled under ts_lock.
+  static bool Enter() {
+    // Both atomic operations are full barriers, so either we see the gate
+    // closed or Close() sees us inside.
+    NoBarrier_AtomicIncrement(&n_inside_);
+    if (AtomicCompareAndSwap(&n_closed_, 0, 0))
+      return true;
+    NoBarrier_AtomicDecrement(&n_inside_);
+    return false;
+  }
+
+  static void Leave() {
+    NoBarrier_AtomicDecrement(&n_inside_);
+  }
+
+  // Must be called under ts_lock.
+  static void Close() {
+    NoBarrier_AtomicIncrement(&n_closed_);
+    while (!AtomicCompareAndSwap(&n_inside_, 0, 0))
+      YIELD();
+  }
+
+  static void Open() {
+    NoBarrier_AtomicDecrement(&n_closed_);
+  }
+
+ private:
+  static int32_t n_inside_;
+  static int32_t n_closed_;
+};
+
+int32_t UnlockedHandlerGate::n_inside_;
+int32_t UnlockedHandlerGate::n_closed_;
+
 #ifdef TS_LLVM
 void ThreadSanitizerLockAcquire() {
   ts_lock->Lock();
@@ -297,6 +391,7 @@ const char *c_default = "";
 static void ForgetAllStateAndStartOver(TSanThread *thr, const char *reason);
 static void FlushStateIfOutOfSegments(TSanThread *thr);
 static int32_t raw_tid(TSanThread *t);
+static bool ReplayEventHistory(SID sid, uintptr_t *pcs);
 // -------- Simple Cache ------ {{{1
 #include "ts_simple_cache.h"
 // -------- PairCache & IntPairToIntCache ------ {{{1
@@ -402,6 +497,10 @@ class PairCache {
     return combine2(a.raw(), b.raw());
   }
 
+  static uint32_t combine2(SSID a, SSID b) {
+    return combine2(a.raw(), b.raw());
+  }
+
   Entry htable_[kHtableSize];
 
   Entry array_[kArraySize];
@@ -418,13 +517,73 @@ class IntPairToIntCache
 
 
 
+// -------- MemoryAccounting --------------- {{{1
+// Bytes used by ThreadSanitizer's own data structures, per cost center.
+// ScopedMallocCostCenter names allocations only for Valgrind's malloc,
+// so the allocators report their bytes here explicitly.
+// A counter is updated under the lock which guards the allocation it counts;
+// readers may see slightly stale values.
+// Objects in free lists are not counted, objects in magazines are.
+enum MemCostCenter {
+  kMemCacheLines,
+  kMemCompressedLines,
+  kMemVts,
+  kMemSegments,       // Allocated once, see Segment::InitClassMembers.
+  kMemHistoryStacks,  // The 'previous' stack traces of segments.
+  kMemSegmentSets,
+  kMemStackTraces,
+  kMemStackDepot,
+  kMemHeapMap,        // Estimated, see CheckMemoryBudget.
+  kNumMemCostCenters
+};
+
+class MemoryAccounting {
+ public:
+  static INLINE void Add(MemCostCenter cc, intptr_t bytes) {
+    bytes_[cc] += bytes;
+  }
+  static void Set(MemCostCenter cc, uintptr_t bytes) { bytes_[cc] = bytes; }
+
+  // All but kMemSegments: that one never changes, so there is no point
+  // in counting it against --mem_budget_in_mb.
+  static uintptr_t Total() {
+    uintptr_t res = 0;
+    for (int i = 0; i < kNumMemCostCenters; i++) {
+      if (i != kMemSegments) res += bytes_[i];
+    }
+    return res;
+  }
+
+  static string ToString() {
+    static const char *names[kNumMemCostCenters] = {
+      "cache lines", "compressed lines", "VTS", "segments", "history stacks",
+      "segment sets", "stack traces", "stack depot", "heap map"
+    };
+    char buff[100];
+    snprintf(buff, sizeof(buff), "%ldK", (long)(Total() >> 10));
+    string res = buff;
+    for (int i = 0; i < kNumMemCostCenters; i++) {
+      snprintf(buff, sizeof(buff), "%s %s %ldK", i ? "," : ";",
+               names[i], (long)(bytes_[i] >> 10));
+      res += buff;
+    }
+    return res;
+  }
+
+ private:
+  static uintptr_t bytes_[kNumMemCostCenters];
+};
+
+uintptr_t MemoryAccounting::bytes_[kNumMemCostCenters];
+
 // -------- FreeList --------------- {{{1
 class FreeList {
  public:
-  FreeList(int obj_size, int chunk_size)
+  FreeList(int obj_size, int chunk_size, MemCostCenter cost_center)
     : list_(0),
       obj_size_(obj_size),
-      chunk_size_(chunk_size) {
+      chunk_size_(chunk_size),
+      cost_center_(cost_center) {
     CHECK_GE(obj_size_, static_cast<int>(sizeof(NULL)));
     CHECK((obj_size_ % sizeof(NULL)) == 0);
     CHECK_GE(chunk_size_, 1);
@@ -436,6 +595,7 @@ class FreeList {
     CHECK(list_);
     List *head = list_;
     list_ = list_->next;
+    MemoryAccounting::Add(cost_center_, obj_size_);
     return reinterpret_cast<void*>(head);
   }
 
@@ -446,8 +606,11 @@ class FreeList {
     List *new_head = reinterpret_cast<List*>(ptr);
     new_head->next = list_;
     list_ = new_head;
+    MemoryAccounting::Add(cost_center_, -obj_size_);
   }
 
+  int obj_size() const { return obj_size_; }
+
  private:
   void AllocateNewChunk() {
     CHECK(list_ == NULL);
@@ -469,6 +632,65 @@ class FreeList {
 
   const int obj_size_;
   const int chunk_size_;
+  const MemCostCenter cost_center_;
+};
+
+// -------- FreeListMagazine --------------- {{{1
+// A per-thread stack of free objects taken from a shared FreeList
+// (the depot). Allocate() and Deallocate() touch only the magazine;
+// the depot (and its lock) is used to move kBatch objects at a time.
+class FreeListMagazine {
+ public:
+  FreeListMagazine(FreeList *depot, SubsystemLockId depot_lock)
+    : depot_(depot), depot_lock_(depot_lock), n_objs_(0) {
+    DCHECK(depot_);
+  }
+
+  ~FreeListMagazine() { FlushAll(); }
+
+  INLINE void *Allocate() {
+    if (UNLIKELY(n_objs_ == 0))
+      Refill();
+    return objs_[--n_objs_];
+  }
+
+  INLINE void Deallocate(void *ptr) {
+    if (TSAN_DEBUG) {
+      memset(ptr, 0xac, depot_->obj_size());
+    }
+    if (UNLIKELY(n_objs_ == kSize))
+      Flush(kBatch);
+    objs_[n_objs_++] = ptr;
+  }
+
+  // Give all the objects back to the depot (e.g. when the thread ends).
+  void FlushAll() {
+    if (n_objs_) Flush(n_objs_);
+  }
+
+ private:
+  static const size_t kSize = 32;
+  static const size_t kBatch = kSize / 2;
+
+  NOINLINE void Refill() {
+    SubsystemTIL til(depot_lock_);
+    for (size_t i = 0; i < kBatch; i++)
+      objs_[n_objs_++] = depot_->Allocate();
+    G_stats->magazine_refills++;
+  }
+
+  NOINLINE void Flush(size_t n) {
+    DCHECK(n <= n_objs_);
+    SubsystemTIL til(depot_lock_);
+    for (size_t i = 0; i < n; i++)
+      depot_->Deallocate(objs_[--n_objs_]);
+    G_stats->magazine_flushes++;
+  }
+
+  FreeList *depot_;
+  SubsystemLockId depot_lock_;
+  size_t n_objs_;
+  void *objs_[kSize];
 };
 // -------- StackTrace -------------- {{{1
 class StackTraceFreeList {
@@ -488,7 +710,8 @@ class StackTraceFreeList {
     free_lists_ = new FreeList *[n];
     free_lists_[0] = NULL;
     for (size_t i = 1; i < n; i++) {
-      free_lists_[i] = new FreeList((i+2) * sizeof(uintptr_t), 1024);
+      free_lists_[i] = new FreeList((i+2) * sizeof(uintptr_t), 1024,
+                                   kMemStackTraces);
     }
   }
 
@@ -631,6 +854,186 @@ class StackTrace {
   uintptr_t arr_[];
 };
 
+// -------- InsertOnlyHashTable -------------- {{{1
+// Buckets of singly linked Entry lists (Entry must have an 'Entry *next'
+// member). Lookups don't take any lock: an entry is completely filled before
+// Insert() links it into its bucket with ReleaseStore(), Head() reads the
+// bucket with AcquireLoad(), and an entry is never changed or freed after
+// it is inserted. The caller serializes insertions.
+template<class Entry, size_t kNumBuckets>
+class InsertOnlyHashTable {
+ public:
+  void Init(const char *description) {
+    DCHECK((kNumBuckets & (kNumBuckets - 1)) == 0);
+    buckets_ = new uintptr_t[kNumBuckets];
+    memset(buckets_, 0, kNumBuckets * sizeof(uintptr_t));
+    ANNOTATE_BENIGN_RACE_SIZED(buckets_, kNumBuckets * sizeof(uintptr_t),
+                               description);
+  }
+
+  // The first entry of the bucket of 'hash'; follow 'next' for the rest.
+  Entry *Head(uintptr_t hash) const {
+    return reinterpret_cast<Entry*>(AcquireLoad(Bucket(hash)));
+  }
+
+  void Insert(uintptr_t hash, Entry *e) {
+    uintptr_t *bucket = Bucket(hash);
+    e->next = reinterpret_cast<Entry*>(*bucket);
+    ReleaseStore(bucket, reinterpret_cast<uintptr_t>(e));
+  }
+
+ private:
+  uintptr_t *Bucket(uintptr_t hash) const {
+    return &buckets_[hash & (kNumBuckets - 1)];
+  }
+
+  uintptr_t *buckets_;
+};
+
+// -------- StackDepot -------------- {{{1
+// Append-only storage of unique stack traces.
+// Long-lived contexts (where a lock was last acquired, where a thread was
+// created, etc) keep a 32-bit StackDepot::Id instead of a private StackTrace,
+// so that a context which repeats millions of times is stored once.
+// Id 0 means "no stack trace".
+//
+// Lookups don't take any lock (see InsertOnlyHashTable); insertions are
+// serialized by kStackDepotLock (or ts_lock).
+// ForgetAllState() does not touch the depot.
+class StackDepot {
+ public:
+  typedef uint32_t Id;
+
+  // Returns the id of the trace pcs[0..size), pcs[0] being the innermost
+  // frame. The trace is copied into the depot if it is not there yet.
+  static Id Put(const uintptr_t *pcs, size_t size) {
+    if (size == 0) return 0;
+    G_stats->stack_depot_put++;
+    uint32_t hash = Hash(pcs, size);
+    Entry *e = Find(table_.Head(hash), hash, pcs, size);
+    if (e) return e->id;
+
+    SubsystemTIL til(kStackDepotLock);
+    // Someone may have inserted the same trace while we were waiting.
+    e = Find(table_.Head(hash), hash, pcs, size);
+    if (e) return e->id;
+    CHECK(n_entries_ + 1 < kMaxChunks * kChunkSize);
+    e = AllocateEntry(size);
+    e->hash = hash;
+    e->size = size;
+    e->id = ++n_entries_;
+    memcpy(e->pcs, pcs, size * sizeof(uintptr_t));
+    size_t chunk_idx = e->id / kChunkSize;
+    if (!id_to_entry_[chunk_idx]) {
+      id_to_entry_[chunk_idx] = new Entry*[kChunkSize];
+    }
+    id_to_entry_[chunk_idx][e->id % kChunkSize] = e;
+    G_stats->stack_depot_new++;
+    table_.Insert(hash, e);
+    return e->id;
+  }
+
+  // The PCs of the trace, innermost first; NULL for id 0.
+  static const uintptr_t *Get(Id id, size_t *size) {
+    if (id == 0) {
+      *size = 0;
+      return NULL;
+    }
+    DCHECK(id <= n_entries_);
+    Entry *e = id_to_entry_[id / kChunkSize][id % kChunkSize];
+    *size = e->size;
+    return e->pcs;
+  }
+
+  static string ToString(Id id, const char *indent = "    ") {
+    if (id == 0) return "NO STACK TRACE\n";
+    size_t size;
+    const uintptr_t *pcs = Get(id, &size);
+    return StackTrace::EmbeddedStackTraceToString(pcs, size, indent);
+  }
+
+  static void PrintStats() {
+    Printf("   StackDepot: %'ld traces; %'ldK in %'ld blocks\n",
+           (long)n_entries_, (long)(n_blocks_ * kBlockSize * sizeof(uintptr_t)
+                                    >> 10), (long)n_blocks_);
+  }
+
+  static void InitClassMembers() {
+    table_.Init("StackDepot::table_ (lock-free lookup)");
+    id_to_entry_ = new Entry**[kMaxChunks];
+    memset(id_to_entry_, 0, kMaxChunks * sizeof(Entry**));
+  }
+
+ private:
+  struct Entry {
+    Entry    *next;
+    uint32_t  hash;
+    Id        id;
+    uintptr_t size;
+    uintptr_t pcs[];
+  };
+
+  enum {
+    kNumBuckets = 1 << 16,
+    kChunkSize  = 1 << 16,   // Ids per chunk of id_to_entry_.
+    kMaxChunks  = 1 << 12,
+    kBlockSize  = 1 << 16    // Words per allocation block.
+  };
+
+  static uint32_t Hash(const uintptr_t *pcs, size_t size) {
+    uint64_t h = size;
+    for (size_t i = 0; i < size; i++) {
+      h ^= pcs[i];
+      h *= 0x9E3779B97F4A7C15ULL;
+      h ^= h >> 29;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+  }
+
+  static Entry *Find(Entry *head, uint32_t hash,
+                     const uintptr_t *pcs, size_t size) {
+    for (Entry *e = head; e; e = e->next) {
+      if (e->hash != hash || e->size != size) continue;
+      if (memcmp(e->pcs, pcs, size * sizeof(uintptr_t)) == 0)
+        return e;
+    }
+    return NULL;
+  }
+
+  // Bump allocation from big blocks which are never freed.
+  static Entry *AllocateEntry(size_t size) {
+    size_t n_words = sizeof(Entry) / sizeof(uintptr_t) + size;
+    if (n_words > kBlockSize) {
+      MemoryAccounting::Add(kMemStackDepot, n_words * sizeof(uintptr_t));
+      return reinterpret_cast<Entry*>(new uintptr_t[n_words]);
+    }
+    if (block_pos_ + n_words > kBlockSize) {
+      block_ = new uintptr_t[kBlockSize];
+      block_pos_ = 0;
+      n_blocks_++;
+      MemoryAccounting::Add(kMemStackDepot, kBlockSize * sizeof(uintptr_t));
+    }
+    Entry *res = reinterpret_cast<Entry*>(block_ + block_pos_);
+    block_pos_ += n_words;
+    return res;
+  }
+
+  static InsertOnlyHashTable<Entry, kNumBuckets> table_;
+  static Entry   ***id_to_entry_;
+  static Id         n_entries_;
+  static uintptr_t *block_;
+  static size_t     block_pos_;
+  static size_t     n_blocks_;
+};
+
+InsertOnlyHashTable<StackDepot::Entry, StackDepot::kNumBuckets>
+                     StackDepot::table_;
+StackDepot::Entry ***StackDepot::id_to_entry_;
+StackDepot::Id       StackDepot::n_entries_;
+uintptr_t           *StackDepot::block_;
+size_t               StackDepot::block_pos_ = StackDepot::kBlockSize;
+size_t               StackDepot::n_blocks_;
+
 
 
 // -------- Lock -------------------- {{{1
@@ -644,11 +1047,12 @@ class Lock {
     // Destroy(lock_addr);
 
     // CHECK(Lookup(lock_addr) == NULL);
-    Lock *res = LookupOrCreate(lock_addr);
+    SubsystemTIL til(kLockTableLock);
+    Lock *res = LookupOrCreateLocked(lock_addr);
     res->rd_held_ = 0;
     res->wr_held_ = 0;
     res->is_pure_happens_before_ = G_flags->pure_happens_before;
-    res->last_lock_site_ = NULL;
+    res->last_lock_site_ = 0;
     return res;
   }
 
@@ -659,17 +1063,13 @@ class Lock {
 
   static NOINLINE Lock *LookupOrCreate(uintptr_t lock_addr) {
     ScopedMallocCostCenter cc("LockLookup");
-    Lock **lock = &(*map_)[lock_addr];
-    if (*lock == NULL) {
-//      Printf("Lock::LookupOrCreate: %p\n", lock_addr);
-      ScopedMallocCostCenter cc_lock("new Lock");
-      *lock = new Lock(lock_addr, map_->size());
-    }
-    return *lock;
+    SubsystemTIL til(kLockTableLock);
+    return LookupOrCreateLocked(lock_addr);
   }
 
   static NOINLINE Lock *Lookup(uintptr_t lock_addr) {
     ScopedMallocCostCenter cc("LockLookup");
+    SubsystemTIL til(kLockTableLock);
     Map::iterator it = map_->find(lock_addr);
     if (it == map_->end()) return NULL;
     return it->second;
@@ -692,7 +1092,10 @@ class Lock {
 
   void set_is_pure_happens_before(bool x) { is_pure_happens_before_ = x; }
 
-  void WrLock(TID tid, StackTrace *lock_site) {
+  // The lock and unlock handlers may run w/o ts_lock in different threads,
+  // so the state below is changed under kLockTableLock.
+  void WrLock(TID tid, StackDepot::Id lock_site) {
+    SubsystemTIL til(kLockTableLock);
     CHECK(!rd_held_);
     if (wr_held_ == 0) {
       thread_holding_me_in_write_mode_ = tid;
@@ -700,24 +1103,25 @@ class Lock {
       CHECK(thread_holding_me_in_write_mode_ == tid);
     }
     wr_held_++;
-    StackTrace::Delete(last_lock_site_);
     last_lock_site_ = lock_site;
   }
 
   void WrUnlock() {
+    SubsystemTIL til(kLockTableLock);
     CHECK(!rd_held_);
     CHECK(wr_held_ > 0);
     wr_held_--;
   }
 
-  void RdLock(StackTrace *lock_site) {
+  void RdLock(StackDepot::Id lock_site) {
+    SubsystemTIL til(kLockTableLock);
     CHECK(!wr_held_);
     rd_held_++;
-    StackTrace::Delete(last_lock_site_);
     last_lock_site_ = lock_site;
   }
 
   void RdUnlock() {
+    SubsystemTIL til(kLockTableLock);
     CHECK(!wr_held_);
     CHECK(rd_held_);
     rd_held_--;
@@ -741,6 +1145,7 @@ class Lock {
 
   static Lock *LIDtoLock(LID lid) {
     // slow, but needed only for reports.
+    SubsystemTIL til(kLockTableLock);
     for (Map::iterator it = map_->begin(); it != map_->end(); ++it) {
       Lock *l = it->second;
       if (l->lid_ == lid) {
@@ -767,7 +1172,7 @@ class Lock {
       Report("   %s (%p)\n%s",
              lock->ToString().c_str(),
              lock->lock_addr_,
-             lock->last_lock_site_->ToString().c_str());
+             StackDepot::ToString(lock->last_lock_site_).c_str());
     } else {
       Report("   %s. This lock was probably destroyed"
                  " w/o calling Unlock()\n", lock->ToString().c_str());
@@ -789,13 +1194,24 @@ class Lock {
       name_(NULL) {
   }
 
+  // Must be called under kLockTableLock.
+  static Lock *LookupOrCreateLocked(uintptr_t lock_addr) {
+    Lock **lock = &(*map_)[lock_addr];
+    if (*lock == NULL) {
+//      Printf("Lock::LookupOrCreate: %p\n", lock_addr);
+      ScopedMallocCostCenter cc_lock("new Lock");
+      *lock = new Lock(lock_addr, map_->size());
+    }
+    return *lock;
+  }
+
   // Data members
   uintptr_t lock_addr_;
   LID       lid_;
   int       rd_held_;
   int       wr_held_;
   bool      is_pure_happens_before_;
-  StackTrace *last_lock_site_;
+  StackDepot::Id last_lock_site_;
   const char *name_;
   TID       thread_holding_me_in_write_mode_;
 
@@ -849,8 +1265,25 @@ class FixedArray {
 
 // -------- LockSet ----------------- {{{1
 class LockSet {
+ private:
+//  static const int kPrimeSizeOfLsCache = 307;
+//  static const int kPrimeSizeOfLsCache = 499;
+  static const int kPrimeSizeOfLsCache = 1021;
+  typedef IntPairToIntCache<kPrimeSizeOfLsCache> LSCache;
+  typedef IntPairToBoolCache<kPrimeSizeOfLsCache> LSIntersectionCache;
+
  public:
-  NOINLINE static LSID Add(LSID lsid, Lock *lock) {
+  // Per-thread front caches for Add(), Remove() and IntersectionIsEmpty().
+  // LSIDs are never recycled, so these caches never need to be flushed.
+  class ThreadCache {
+   private:
+    friend class LockSet;
+    LSCache add_cache_;
+    LSCache rem_cache_;
+    LSIntersectionCache intersection_cache_;
+  };
+
+  NOINLINE static LSID Add(LSID lsid, Lock *lock, ThreadCache *cache) {
     ScopedMallocCostCenter cc("LockSetAdd");
     LID lid = lock->lid();
     if (lsid.IsEmpty()) {
@@ -859,7 +1292,7 @@ class LockSet {
       return LSID(lid.raw());
     }
     int cache_res;
-    if (ls_add_cache_->Lookup(lsid.raw(), lid.raw(), &cache_res)) {
+    if (cache->add_cache_.Lookup(lsid.raw(), lid.raw(), &cache_res)) {
       G_stats->ls_add_cache_hit++;
       return LSID(cache_res);
     }
@@ -873,13 +1306,14 @@ class LockSet {
       G_stats->ls_add_to_multi++;
       res = ComputeId(set);
     }
-    ls_add_cache_->Insert(lsid.raw(), lid.raw(), res.raw());
+    cache->add_cache_.Insert(lsid.raw(), lid.raw(), res.raw());
     return res;
   }
 
   // If lock is present in lsid, set new_lsid to (lsid \ lock) and return true.
   // Otherwise set new_lsid to lsid and return false.
-  NOINLINE static bool Remove(LSID lsid, Lock *lock, LSID *new_lsid) {
+  NOINLINE static bool Remove(LSID lsid, Lock *lock, LSID *new_lsid,
+                              ThreadCache *cache) {
     *new_lsid = lsid;
     if (lsid.IsEmpty()) return false;
     LID lid = lock->lid();
@@ -893,24 +1327,26 @@ class LockSet {
     }
 
     int cache_res;
-    if (ls_rem_cache_->Lookup(lsid.raw(), lid.raw(), &cache_res)) {
+    if (cache->rem_cache_.Lookup(lsid.raw(), lid.raw(), &cache_res)) {
       G_stats->ls_rem_cache_hit++;
       *new_lsid = LSID(cache_res);
       return true;
     }
 
-    LSSet &prev_set = Get(lsid);
-    if (!prev_set.has(lid)) return false;
+    const LSSet &prev_set = Get(lsid);
+    if (!Has(lsid, lid)) return false;
     LSSet set(prev_set, LSSet::REMOVE, lid);
     CHECK(set.size() == prev_set.size() - 1);
     G_stats->ls_remove_from_multi++;
     LSID res = ComputeId(set);
-    ls_rem_cache_->Insert(lsid.raw(), lid.raw(), res.raw());
+    cache->rem_cache_.Insert(lsid.raw(), lid.raw(), res.raw());
     *new_lsid = res;
     return true;
   }
 
-  NOINLINE static bool IntersectionIsEmpty(LSID lsid1, LSID lsid2) {
+  // cache may be NULL (e.g. when reporting a race).
+  NOINLINE static bool IntersectionIsEmpty(LSID lsid1, LSID lsid2,
+                                           ThreadCache *cache) {
     // at least one empty
     if (lsid1.IsEmpty() || lsid2.IsEmpty())
       return true;  // empty
@@ -922,31 +1358,43 @@ class LockSet {
 
     // first is singleton, second is not
     if (lsid1.IsSingleton()) {
-      const LSSet &set2 = Get(lsid2);
-      return set2.has(LID(lsid1.raw())) == false;
+      return Has(lsid2, lsid1.GetSingleton()) == false;
     }
 
     // second is singleton, first is not
     if (lsid2.IsSingleton()) {
-      const LSSet &set1 = Get(lsid1);
-      return set1.has(LID(lsid2.raw())) == false;
+      return Has(lsid1, lsid2.GetSingleton()) == false;
     }
 
     // LockSets are equal and not empty
     if (lsid1 == lsid2)
       return false;
 
-    // both are not singletons - slow path.
+    // both are not singletons. Try the signatures first.
+    const Rec *rec1 = GetRec(lsid1);
+    const Rec *rec2 = GetRec(lsid2);
+    if ((rec1->mask & rec2->mask) == 0) {
+      G_stats->ls_intersection_mask++;
+      return true;
+    }
+    if (rec1->mask_is_exact && rec2->mask_is_exact) {
+      G_stats->ls_intersection_mask++;
+      return false;
+    }
+
+    // slow path.
     bool ret = true,
          cache_hit = false;
     DCHECK(lsid2.raw() < 0);
-    if (ls_intersection_cache_->Lookup(lsid1.raw(), -lsid2.raw(), &ret)) {
+    if (cache &&
+        cache->intersection_cache_.Lookup(lsid1.raw(), -lsid2.raw(), &ret)) {
       if (!TSAN_DEBUG)
         return ret;
       cache_hit = true;
     }
-    const LSSet &set1 = Get(lsid1);
-    const LSSet &set2 = Get(lsid2);
+    G_stats->ls_intersection_slow++;
+    const LSSet &set1 = rec1->set;
+    const LSSet &set2 = rec2->set;
 
     FixedArray<LID> intersection(min(set1.size(), set2.size()));
     LID *end = set_intersection(set1.begin(), set1.end(),
@@ -954,7 +1402,8 @@ class LockSet {
                             intersection.begin());
     DCHECK(!cache_hit || (ret == (end == intersection.begin())));
     ret = (end == intersection.begin());
-    ls_intersection_cache_->Insert(lsid1.raw(), -lsid2.raw(), ret);
+    if (cache)
+      cache->intersection_cache_.Insert(lsid1.raw(), -lsid2.raw(), ret);
     return ret;
   }
 
@@ -964,7 +1413,7 @@ class LockSet {
     if (lsid.IsSingleton())
       return !Lock::LIDtoLock(LID(lsid.raw()))->is_pure_happens_before();
 
-    LSSet &set = Get(lsid);
+    const LSSet &set = Get(lsid);
     for (LSSet::const_iterator it = set.begin(); it != set.end(); ++it)
       if (!Lock::LIDtoLock(*it)->is_pure_happens_before())
         return true;
@@ -1023,11 +1472,9 @@ class LockSet {
 
   static void InitClassMembers() {
     map_ = new LockSet::Map;
-    vec_ = new LockSet::Vec;
-    ls_add_cache_ = new LSCache;
-    ls_rem_cache_ = new LSCache;
-    ls_rem_cache_ = new LSCache;
-    ls_intersection_cache_ = new LSIntersectionCache;
+    vec_chunks_ = new Rec**[kMaxNumVecChunks];
+    memset(vec_chunks_, 0, kMaxNumVecChunks * sizeof(Rec**));
+    vec_size_ = 0;
   }
 
  private:
@@ -1036,14 +1483,54 @@ class LockSet {
 
   typedef DenseMultimap<LID, 3> LSSet;
 
-  static LSSet &Get(LSID lsid) {
-    ScopedMallocCostCenter cc(__FUNCTION__);
-    int idx = -lsid.raw() - 1;
-    DCHECK(idx >= 0);
-    DCHECK(idx < static_cast<int>(vec_->size()));
-    return (*vec_)[idx];
+  // A LockSet with two or more locks together with its 64-bit signature:
+  // bit (lid % 64) is set for every lid in the set. Sets with disjoint
+  // signatures do not intersect. If all lids are below 64 (which is the
+  // case for most programs) the signature is an exact bitset of the locks.
+  struct Rec {
+    Rec(const LSSet &s, uintptr_t h)
+        : set(s), hash(h), mask(0), mask_is_exact(true) {
+      for (LSSet::const_iterator it = set.begin(); it != set.end(); ++it) {
+        uint32_t lid = it->raw();
+        mask |= 1ULL << (lid & 63);
+        if (lid >= 64) mask_is_exact = false;
+      }
+    }
+    LSSet set;
+    uintptr_t hash;
+    uint64_t mask;
+    bool mask_is_exact;
+  };
+
+  static INLINE const Rec *GetRec(LSID lsid) {
+    uintptr_t idx = -lsid.raw() - 1;
+    DCHECK(idx < INTERNAL_ANNOTATE_UNPROTECTED_READ(vec_size_));
+    return VecAt(idx);
+  }
+
+  static const LSSet &Get(LSID lsid) {
+    return GetRec(lsid)->set;
+  }
+
+  // Returns true if lid is in the multi-lock set lsid.
+  static INLINE bool Has(LSID lsid, LID lid) {
+    const Rec *rec = GetRec(lsid);
+    if ((rec->mask & (1ULL << (lid.raw() & 63))) == 0)
+      return false;
+    if (rec->mask_is_exact && lid.raw() < 64)
+      return true;
+    return rec->set.has(lid);
+  }
+
+  static uintptr_t Hash(const LSSet &set) {
+    uint64_t res = set.size();
+    for (LSSet::const_iterator it = set.begin(); it != set.end(); ++it) {
+      res = (res ^ it->raw()) * 0x9E3779B97F4A7C15ULL;
+    }
+    return res ^ (res >> 32);
   }
 
+  // May be called w/o any lock.
   static LSID ComputeId(const LSSet &set) {
     CHECK(set.size() > 0);
     if (set.size() == 1) {
@@ -1051,56 +1538,140 @@ class LockSet {
       return LSID(set.begin()->raw());
     }
     DCHECK(map_);
-    DCHECK(vec_);
     // multiple locks.
+    uintptr_t hash = Hash(set);
+    uintptr_t id = map_->GetIdOrZero(set, hash);
+    if (id != 0)
+      return LSID(-(int32_t)id);
+
     ScopedMallocCostCenter cc("LockSet::ComputeId");
-    int32_t *id = &(*map_)[set];
-    if (*id == 0) {
-      vec_->push_back(set);
-      *id = map_->size();
+    SubsystemTIL til(kLockSetLock);
+    // Someone may have added the same set since we looked.
+    id = map_->GetIdOrZero(set, hash);
+    if (id == 0) {
+      VecPushBack(new Rec(set, hash));
+      id = vec_size_;
+      map_->Insert(id);
       if      (set.size() == 2) G_stats->ls_size_2++;
       else if (set.size() == 3) G_stats->ls_size_3++;
       else if (set.size() == 4) G_stats->ls_size_4++;
       else if (set.size() == 5) G_stats->ls_size_5++;
       else                      G_stats->ls_size_other++;
-      if (*id >= 4096 && ((*id & (*id - 1)) == 0)) {
+      if (id >= 4096 && ((id & (id - 1)) == 0)) {
         Report("INFO: %d LockSet IDs have been allocated "
                "(2: %ld 3: %ld 4: %ld 5: %ld o: %ld)\n",
-               *id,
+               (int)id,
                G_stats->ls_size_2, G_stats->ls_size_3,
                G_stats->ls_size_4, G_stats->ls_size_5,
                G_stats->ls_size_other
                );
       }
     }
-    return LSID(-*id);
+    return LSID(-(int32_t)id);
   }
 
-  typedef map<LSSet, int32_t> Map;
-  static Map *map_;
+  // Open-addressing hash table of all multi-lock sets.
+  // A slot holds 0 (empty) or (-lsid). LockSets are never removed.
+  // Insert() is called under the LockSet lock, GetIdOrZero() may be called
+  // w/o a lock. Tables replaced by Rehash() are never freed since unlocked
+  // readers may still be looking at them.
+  class Map {
+   public:
+    Map() : n_used_(0) {
+      table_ = NewTable(kInitialCapacity);
+    }
+
+    uintptr_t GetIdOrZero(const LSSet &set, uintptr_t hash) {
+      const Table *t = INTERNAL_ANNOTATE_UNPROTECTED_READ(table_);
+      for (uintptr_t i = hash & t->mask; ; i = (i + 1) & t->mask) {
+        uintptr_t slot = INTERNAL_ANNOTATE_UNPROTECTED_READ(t->slots[i]);
+        if (slot == 0) return 0;
+        const Rec *rec = VecAt(slot - 1);
+        if (rec->hash == hash && rec->set.size() == set.size() &&
+            equal(set.begin(), set.end(), rec->set.begin())) {
+          return slot;
+        }
+      }
+    }
 
-  static const char *kLockSetVecAllocCC;
-  typedef vector<LSSet> Vec;
-  static Vec *vec_;
+    void Insert(uintptr_t id) {
+      if ((n_used_ + 1) * 2 > table_->mask + 1) {
+        Rehash();
+      }
+      InsertIntoTable(table_, id);
+      n_used_++;
+    }
 
-//  static const int kPrimeSizeOfLsCache = 307;
-//  static const int kPrimeSizeOfLsCache = 499;
-  static const int kPrimeSizeOfLsCache = 1021;
-  typedef IntPairToIntCache<kPrimeSizeOfLsCache> LSCache;
-  static LSCache *ls_add_cache_;
-  static LSCache *ls_rem_cache_;
-  static LSCache *ls_int_cache_;
-  typedef IntPairToBoolCache<kPrimeSizeOfLsCache> LSIntersectionCache;
-  static LSIntersectionCache *ls_intersection_cache_;
+   private:
+    static const uintptr_t kInitialCapacity = 1 << 10;
+
+    struct Table {
+      uintptr_t mask;
+      uintptr_t slots[1];
+    };
+
+    static Table *NewTable(uintptr_t capacity) {
+      DCHECK((capacity & (capacity - 1)) == 0);
+      size_t size = sizeof(Table) + (capacity - 1) * sizeof(uintptr_t);
+      Table *t = (Table*)new char[size];
+      memset(t, 0, size);
+      t->mask = capacity - 1;
+      return t;
+    }
+
+    static void InsertIntoTable(Table *t, uintptr_t id) {
+      uintptr_t i = VecAt(id - 1)->hash & t->mask;
+      while (t->slots[i] != 0)
+        i = (i + 1) & t->mask;
+      ReleaseStore(&t->slots[i], id);
+    }
+
+    void Rehash() {
+      Table *t = NewTable((table_->mask + 1) * 4);
+      for (uintptr_t i = 0; i <= table_->mask; i++) {
+        if (table_->slots[i] != 0)
+          InsertIntoTable(t, table_->slots[i]);
+      }
+      retired_.push_back(table_);
+      ReleaseStore((uintptr_t*)&table_, (uintptr_t)t);
+    }
+
+    Table *table_;
+    uintptr_t n_used_;
+    vector<Table*> retired_;
+  };
+
+  // All multi-lock sets, indexed by (-lsid - 1).
+  // The chunks never move, so the sets can be looked up w/o a lock.
+  enum {
+    kVecChunkSizeLog = 12,
+    kVecChunkSize = 1 << kVecChunkSizeLog,
+    kMaxNumVecChunks = 1 << 15
+  };
+
+  static INLINE Rec *VecAt(uintptr_t idx) {
+    return vec_chunks_[idx >> kVecChunkSizeLog][idx & (kVecChunkSize - 1)];
+  }
+
+  static void VecPushBack(Rec *rec) {
+    uintptr_t idx = vec_size_;
+    CHECK((idx >> kVecChunkSizeLog) < kMaxNumVecChunks);
+    Rec **&chunk = vec_chunks_[idx >> kVecChunkSizeLog];
+    if (chunk == NULL) {
+      chunk = new Rec*[kVecChunkSize];
+    }
+    chunk[idx & (kVecChunkSize - 1)] = rec;
+    ReleaseStore(&vec_size_, idx + 1);
+  }
+
+  static Map *map_;
+  static Rec ***vec_chunks_;
+  static uintptr_t vec_size_;
 };
 
 LockSet::Map *LockSet::map_;
-LockSet::Vec *LockSet::vec_;
-const char *LockSet::kLockSetVecAllocCC = "kLockSetVecAllocCC";
-LockSet::LSCache *LockSet::ls_add_cache_;
-LockSet::LSCache *LockSet::ls_rem_cache_;
-LockSet::LSCache *LockSet::ls_int_cache_;
-LockSet::LSIntersectionCache *LockSet::ls_intersection_cache_;
+LockSet::Rec ***LockSet::vec_chunks_;
+uintptr_t LockSet::vec_size_;
 
 
 static string TwoLockSetsToString(LSID rd_lockset, LSID wr_lockset) {
@@ -1121,6 +1692,8 @@ static string TwoLockSetsToString(LSID rd_lockset, LSID wr_lockset) {
 
 
 // -------- VTS ------------------ {{{1
+#include "ts_vts_kernels.h"
+
 class VTS {
  public:
   static size_t MemoryRequiredForOneVts(size_t size) {
@@ -1134,7 +1707,36 @@ class VTS {
     return (size + 31) & ~31;
   }
 
-  static VTS *Create(size_t size) {
+  // Per-thread magazines for the free lists of the smallest VTS sizes
+  // (created lazily). A NULL Magazines* means "use the free lists".
+  class Magazines {
+   public:
+    Magazines() { memset(mags_, 0, sizeof(mags_)); }
+    ~Magazines() {
+      for (size_t i = 0; i <= kMaxSize; i++)
+        delete mags_[i];
+    }
+
+    // Returns NULL if rounded_size is not handled by magazines.
+    INLINE FreeListMagazine *Get(size_t rounded_size) {
+      if (rounded_size > kMaxSize) return NULL;
+      FreeListMagazine *&mag = mags_[rounded_size];
+      if (UNLIKELY(mag == NULL))
+        mag = new FreeListMagazine(free_lists_[rounded_size], kVtsPoolLock);
+      return mag;
+    }
+
+    void FlushAll() {
+      for (size_t i = 0; i <= kMaxSize; i++)
+        if (mags_[i]) mags_[i]->FlushAll();
+    }
+
+   private:
+    static const size_t kMaxSize = 64;
+    FreeListMagazine *mags_[kMaxSize + 1];
+  };
+
+  static VTS *Create(size_t size, Magazines *mags = NULL) {
     DCHECK(size > 0);
     void *mem;
     size_t rounded_size = RoundUpSizeForEfficientUseOfFreeList(size);
@@ -1142,12 +1744,22 @@ class VTS {
     if (rounded_size <= kNumberOfFreeLists) {
       // Small chunk, use FreeList.
       ScopedMallocCostCenter cc("VTS::Create (from free list)");
-      mem = free_lists_[rounded_size]->Allocate();
+      FreeListMagazine *mag = mags ? mags->Get(rounded_size) : NULL;
+      if (mag) {
+        mem = mag->Allocate();
+      } else {
+        SubsystemTIL til(kVtsPoolLock);
+        mem = free_lists_[rounded_size]->Allocate();
+      }
       G_stats->vts_create_small++;
     } else {
       // Large chunk, use new/delete instead of FreeList.
       ScopedMallocCostCenter cc("VTS::Create (from new[])");
       mem = new int8_t[MemoryRequiredForOneVts(size)];
+      {
+        SubsystemTIL til(kVtsPoolLock);
+        MemoryAccounting::Add(kMemVts, MemoryRequiredForOneVts(size));
+      }
       G_stats->vts_create_big++;
     }
     VTS *res = new(mem) VTS(size);
@@ -1155,17 +1767,27 @@ class VTS {
     return res;
   }
 
-  static void Unref(VTS *vts) {
+  static void Unref(VTS *vts, Magazines *mags = NULL) {
     if (!vts) return;
     CHECK_GT(vts->ref_count_, 0);
     if (AtomicDecrementRefcount(&vts->ref_count_) == 0) {
       size_t size = vts->size_;  // can't use vts->size().
       size_t rounded_size = RoundUpSizeForEfficientUseOfFreeList(size);
       if (rounded_size <= kNumberOfFreeLists) {
-        free_lists_[rounded_size]->Deallocate(vts);
+        FreeListMagazine *mag = mags ? mags->Get(rounded_size) : NULL;
+        if (mag) {
+          mag->Deallocate(vts);
+        } else {
+          SubsystemTIL til(kVtsPoolLock);
+          free_lists_[rounded_size]->Deallocate(vts);
+        }
         G_stats->vts_delete_small++;
       } else {
         G_stats->vts_delete_big++;
+        {
+          SubsystemTIL til(kVtsPoolLock);
+          MemoryAccounting::Add(kMemVts, -MemoryRequiredForOneVts(size));
+        }
         delete vts;
       }
       G_stats->vts_total_delete += rounded_size;
@@ -1185,77 +1807,104 @@ class VTS {
     return this;
   }
 
-  static VTS *CopyAndTick(const VTS *vts, TID id_to_tick) {
+  static VTS *CopyAndTick(const VTS *vts, TID id_to_tick,
+                          Magazines *mags = NULL) {
     CHECK(vts->ref_count_);
-    VTS *res = Create(vts->size());
-    bool found = false;
-    for (size_t i = 0; i < res->size(); i++) {
-      res->arr_[i] = vts->arr_[i];
-      if (res->arr_[i].tid == id_to_tick.raw()) {
-        res->arr_[i].clk++;
-        found = true;
-      }
-    }
-    CHECK(found);
+    VTS *res = Create(vts->size(), mags);
+    res->dense_width_ = vts->dense_width_;
+    memcpy(res->arr_, vts->arr_, vts->size() * sizeof(TS));
+    int32_t *clk = res->FindClk(id_to_tick);
+    CHECK(clk);
+    (*clk)++;
     return res;
   }
 
-  static VTS *Join(const VTS *vts_a, const VTS *vts_b) {
+  static VTS *Join(const VTS *vts_a, const VTS *vts_b,
+                   Magazines *mags = NULL) {
     CHECK(vts_a->ref_count_);
     CHECK(vts_b->ref_count_);
-    FixedArray<TS> result_ts(vts_a->size() + vts_b->size());
-    TS *t = result_ts.begin();
-    const TS *a = &vts_a->arr_[0];
-    const TS *b = &vts_b->arr_[0];
-    const TS *a_max = a + vts_a->size();
-    const TS *b_max = b + vts_b->size();
-    while (a < a_max && b < b_max) {
-      if (a->tid < b->tid) {
-        *t = *a;
-        a++;
-        t++;
-      } else if (a->tid > b->tid) {
-        *t = *b;
-        b++;
-        t++;
-      } else {
-        if (a->clk >= b->clk) {
-          *t = *a;
-        } else {
-          *t = *b;
-        }
-        a++;
-        b++;
-        t++;
-      }
+    if (vts_a->is_dense() && vts_b->is_dense()) {
+      size_t width = max(vts_a->dense_width_, vts_b->dense_width_);
+      VTS *res = CreateDense(width, mags);
+      DenseVtsJoin(vts_a->dense_clk(), vts_a->dense_width_,
+                   vts_b->dense_clk(), vts_b->dense_width_,
+                   res->dense_clk());
+      return res;
     }
-    while (a < a_max) {
-      *t = *a;
-      a++;
-      t++;
+    if (vts_a->is_dense() || vts_b->is_dense()) {
+      if (vts_b->is_dense()) {
+        const VTS *tmp = vts_a;
+        vts_a = vts_b;
+        vts_b = tmp;
+      }
+      size_t width = max((size_t)vts_a->dense_width_, vts_b->sparse_width());
+      VTS *res = CreateDense(width, mags);
+      DenseSparseVtsJoin(vts_a->dense_clk(), vts_a->dense_width_,
+                         vts_b->arr_, vts_b->size(),
+                         res->dense_clk(), width);
+      return res;
     }
-    while (b < b_max) {
-      *t = *b;
-      b++;
-      t++;
+    FixedArray<TS> result_ts(vts_a->size() + vts_b->size());
+    size_t n = SparseVtsJoin(vts_a->arr_, vts_a->size(),
+                             vts_b->arr_, vts_b->size(), result_ts.begin());
+    size_t width = result_ts[n - 1].tid + 1;
+    if (ShouldBeDense(n, width)) {
+      VTS *res = CreateDense(width, mags);
+      int32_t *clk = res->dense_clk();
+      memset(clk, 0, width * sizeof(int32_t));
+      for (size_t i = 0; i < n; i++) {
+        clk[result_ts[i].tid] = result_ts[i].clk;
+      }
+      return res;
     }
+    VTS *res = VTS::Create(n, mags);
+    memcpy(res->arr_, result_ts.begin(), n * sizeof(TS));
+    return res;
+  }
 
-    VTS *res = VTS::Create(t - result_ts.begin());
-    for (size_t i = 0; i < res->size(); i++) {
-      res->arr_[i] = result_ts[i];
+  // True if the caller holds the only reference to this VTS,
+  // so nobody else can observe an in-place update.
+  bool IsExclusive() const {
+    return INTERNAL_ANNOTATE_UNPROTECTED_READ(ref_count_) == 1;
+  }
+
+  // Same as CopyAndTick(), but updates this VTS.
+  void TickInPlace(TID id_to_tick) {
+    DCHECK(IsExclusive());
+    int32_t *clk = FindClk(id_to_tick);
+    CHECK(clk);
+    (*clk)++;
+    NewUniqId();
+    G_stats->vts_tick_in_place++;
+  }
+
+  // Same as Join(), but updates this VTS. Returns false and leaves the VTS
+  // intact if the result does not fit into the memory of this VTS.
+  bool JoinInPlace(const VTS *other) {
+    DCHECK(IsExclusive());
+    CHECK(other->ref_count_);
+    if (is_dense() && other->is_dense()) {
+      if (other->dense_width_ > dense_width_) return false;
+      DenseVtsJoin(dense_clk(), dense_width_,
+                   other->dense_clk(), other->dense_width_, dense_clk());
+    } else if (is_dense()) {
+      if (other->sparse_width() > dense_width_) return false;
+      DenseSparseVtsJoin(dense_clk(), dense_width_, other->arr_,
+                         other->size(), dense_clk(), dense_width_);
+    } else {
+      if (other->is_dense()) return false;
+      if (!SparseJoinInPlace(other)) return false;
     }
-    return res;
+    NewUniqId();
+    G_stats->vts_join_in_place++;
+    return true;
   }
 
   int32_t clk(TID tid) const {
-    // TODO(dvyukov): this function is sub-optimal,
-    // we only need thread's own clock.
-    for (size_t i = 0; i < size_; i++) {
-      if (arr_[i].tid == tid.raw()) {
-        return arr_[i].clk;
-      }
-    }
-    return 0;
+    // Threads usually need only their own clock which they keep at hand
+    // (see TSanThread::own_clk()), so a binary search is enough here.
+    const int32_t *clk = const_cast<VTS*>(this)->FindClk(tid);
+    return clk ? *clk : 0;
   }
 
   static INLINE void FlushHBCache() {
@@ -1279,35 +1928,22 @@ class VTS {
     CHECK(vts_a->ref_count_);
     CHECK(vts_b->ref_count_);
     G_stats->n_vts_hb++;
-    const TS *a = &vts_a->arr_[0];
-    const TS *b = &vts_b->arr_[0];
-    const TS *a_max = a + vts_a->size();
-    const TS *b_max = b + vts_b->size();
-    bool a_less_than_b = false;
-    while (a < a_max && b < b_max) {
-      if (a->tid < b->tid) {
-        // a->tid is not present in b.
-        return false;
-      } else if (a->tid > b->tid) {
-        // b->tid is not present in a.
-        a_less_than_b = true;
-        b++;
-      } else {
-        // this tid is present in both VTSs. Compare clocks.
-        if (a->clk > b->clk) return false;
-        if (a->clk < b->clk) a_less_than_b = true;
-        a++;
-        b++;
-      }
+    if (vts_a->is_dense() && vts_b->is_dense()) {
+      return DenseVtsHappensBefore(vts_a->dense_clk(), vts_a->dense_width_,
+                                   vts_b->dense_clk(), vts_b->dense_width_);
     }
-    if (a < a_max) {
-      // Some tids are present in a and not in b
-      return false;
+    if (vts_a->is_dense()) {
+      return DenseSparseVtsHappensBefore(vts_a->dense_clk(),
+                                         vts_a->dense_width_,
+                                         vts_b->arr_, vts_b->size());
     }
-    if (b < b_max) {
-      return true;
+    if (vts_b->is_dense()) {
+      return SparseDenseVtsHappensBefore(vts_a->arr_, vts_a->size(),
+                                         vts_b->dense_clk(),
+                                         vts_b->dense_width_);
     }
-    return a_less_than_b;
+    return SparseVtsHappensBefore(vts_a->arr_, vts_a->size(),
+                                  vts_b->arr_, vts_b->size());
   }
 
   size_t size() const {
@@ -1315,13 +1951,23 @@ class VTS {
     return size_;
   }
 
+  bool is_dense() const { return dense_width_ != 0; }
+
   string ToString() const {
     DCHECK(ref_count_);
     string res = "[";
-    for (size_t i = 0; i < size(); i++) {
+    size_t n = is_dense() ? dense_width_ : size_;
+    for (size_t i = 0; i < n; i++) {
+      TS ts = {(int32_t)i, 0};
+      if (is_dense()) {
+        ts.clk = dense_clk()[i];
+        if (!ts.clk) continue;
+      } else {
+        ts = arr_[i];
+      }
       char buff[100];
-      snprintf(buff, sizeof(buff), "%d:%d;", arr_[i].tid, arr_[i].clk);
-      if (i) res += " ";
+      snprintf(buff, sizeof(buff), "%d:%d;", ts.tid, ts.clk);
+      if (res.size() > 1) res += " ";
       res += buff;
     }
     return res + "]";
@@ -1405,12 +2051,14 @@ class VTS {
   }
 
   static void InitClassMembers() {
+    CHECK(sizeof(VTS) % sizeof(int32_t) == 0);
+    CHECK(offsetof(VTS, arr_) == sizeof(VTS));
     hb_cache_ = new HBCache;
     free_lists_ = new FreeList *[kNumberOfFreeLists+1];
     free_lists_[0] = 0;
     for (size_t  i = 1; i <= kNumberOfFreeLists; i++) {
       free_lists_[i] = new FreeList(MemoryRequiredForOneVts(i),
-                                    (kNumberOfFreeLists * 4) / i);
+                                    (kNumberOfFreeLists * 4) / i, kMemVts);
     }
   }
 
@@ -1419,25 +2067,136 @@ class VTS {
  private:
   explicit VTS(size_t size)
     : ref_count_(1),
-      size_(size) {
-    uniq_id_counter_++;
-    // If we've got overflow, we are in trouble, need to have 64-bits...
-    CHECK_GT(uniq_id_counter_, 0);
-    uniq_id_ = uniq_id_counter_;
+      size_(size),
+      dense_width_(0) {
+    NewUniqId();
   }
   ~VTS() {}
 
-  struct TS {
-    int32_t tid;
-    int32_t clk;
-  };
+  // The HB cache is keyed by uniq_id_, so every in-place update
+  // needs a fresh one. VTSes are also created w/o ts_lock
+  // (see UnlockedHandlerGate), hence the atomic increment.
+  void NewUniqId() {
+    uniq_id_ = NoBarrier_AtomicIncrement(&uniq_id_counter_);
+    // If we've got overflow, we are in trouble, need to have 64-bits...
+    CHECK_GT(uniq_id_, 0);
+  }
+
+  typedef VtsTs TS;
 
+  // A VTS becomes dense if its width (max tid + 1) is at least
+  // kMinDenseWidth and it is not bigger than the sparse one (a sparse
+  // element takes 8 bytes, a dense one takes 4). With SSE2 on x86-64 the
+  // dense HappensBefore wins from about 8 tids when all tids are present
+  // and from about 16 tids when half of them are.
+  enum { kMinDenseWidth = 16 };
+
+  static bool ShouldBeDense(size_t n_tids, size_t width) {
+    return width >= kMinDenseWidth && n_tids * 2 >= width;
+  }
+
+  // The clocks are not initialized.
+  static VTS *CreateDense(size_t width, Magazines *mags = NULL) {
+    DCHECK(width > 0);
+    VTS *res = Create((width + 1) / 2, mags);
+    res->dense_width_ = width;
+    G_stats->vts_create_dense++;
+    return res;
+  }
+
+  // Max tid + 1 of a sparse VTS.
+  size_t sparse_width() const {
+    DCHECK(!is_dense());
+    return size_ ? arr_[size_ - 1].tid + 1 : 0;
+  }
+
+  // The dense clocks share the storage of arr_, which starts right after
+  // the object (see InitClassMembers).
+  int32_t *dense_clk() const {
+    DCHECK(is_dense());
+    return reinterpret_cast<int32_t*>(const_cast<VTS*>(this) + 1);
+  }
+
+  // Returns NULL if there is no such tid.
+  int32_t *FindClk(TID tid) {
+    if (is_dense()) {
+      if ((size_t)tid.raw() >= dense_width_) return NULL;
+      int32_t *clk = &dense_clk()[tid.raw()];
+      return *clk ? clk : NULL;
+    }
+    // arr_ is sorted by tid.
+    size_t lo = 0, hi = size_;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (arr_[mid].tid < tid.raw()) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo < size_ && arr_[lo].tid == tid.raw())
+      return &arr_[lo].clk;
+    return NULL;
+  }
+
+  // JoinInPlace() for two sparse VTSs.
+  bool SparseJoinInPlace(const VTS *other) {
+    // Count the tids which are present only in 'other'.
+    size_t n_new = 0;
+    const TS *a = &arr_[0];
+    const TS *a_max = a + size_;
+    const TS *b = &other->arr_[0];
+    const TS *b_max = b + other->size_;
+    while (b < b_max) {
+      if (a < a_max && a->tid < b->tid) {
+        a++;
+        continue;
+      }
+      if (a < a_max && a->tid == b->tid) {
+        a++;
+      } else {
+        n_new++;
+      }
+      b++;
+    }
+    size_t new_size = size_ + n_new;
+    if (new_size != size_) {
+      size_t rounded_size = RoundUpSizeForEfficientUseOfFreeList(size_);
+      if (rounded_size > kNumberOfFreeLists ||
+          RoundUpSizeForEfficientUseOfFreeList(new_size) != rounded_size) {
+        return false;
+      }
+    }
+    // Merge from the back, so that we never overwrite an element of
+    // arr_ which has not been read yet.
+    TS *t = &arr_[new_size];
+    TS *a_cur = &arr_[size_];
+    const TS *b_cur = b_max;
+    while (b_cur > &other->arr_[0]) {
+      if (a_cur > &arr_[0] && (a_cur - 1)->tid > (b_cur - 1)->tid) {
+        *--t = *--a_cur;
+      } else if (a_cur > &arr_[0] && (a_cur - 1)->tid == (b_cur - 1)->tid) {
+        --a_cur;
+        --b_cur;
+        TS ts = *a_cur;
+        ts.clk = max(ts.clk, b_cur->clk);
+        *--t = ts;
+      } else {
+        *--t = *--b_cur;
+      }
+    }
+    // The rest of arr_ is already in place.
+    DCHECK(t == a_cur);
+    size_ = new_size;
+    return true;
+  }
 
   // data members
-  int32_t ref_count_;
-  int32_t uniq_id_;
-  size_t size_;
-  TS     arr_[];  // array of size_ elements.
+  int32_t  ref_count_;
+  int32_t  uniq_id_;
+  uint32_t size_;         // Number of elements in arr_.
+  uint32_t dense_width_;  // Number of clocks if dense, 0 if sparse.
+  TS       arr_[];  // array of size_ elements, or of dense_width_ clocks.
 
 
   // static data members
@@ -1723,6 +2482,14 @@ class Segment {
 
   // static methods
 
+  // Changes whenever `sid` gets new contents. Kept only with
+  // --race_verdict_cache, see Detector::CheckIfRace.
+  static INLINE uint32_t Generation(SID sid) {
+    DCHECK(generations_);
+    DCHECK(sid.valid());
+    return generations_[sid.raw()];
+  }
+
   static INLINE uintptr_t *embedded_stack_trace(SID sid) {
     DCHECK(sid.valid());
     DCHECK(kSizeOfHistoryStackTrace > 0);
@@ -1730,9 +2497,16 @@ class Segment {
     size_t idx       = (unsigned)sid.raw() % kChunkSizeForStacks;
     DCHECK(chunk_idx < n_stack_chunks_);
     DCHECK(all_stacks_[chunk_idx] != NULL);
-    return &all_stacks_[chunk_idx][idx * kSizeOfHistoryStackTrace];
+    return &all_stacks_[chunk_idx][idx * history_words_];
   }
 
+  // With --keep_history=2 the history of a SID is not a stack trace but
+  // kHistoryRingWords words: the position in the EventHistoryRing of the
+  // segment's thread plus one (0 means not filled yet) and
+  // RecentSegmentsCache::TopFramesHash() of the stack at that point.
+  enum { kHistoryRingWords = 2 };
+  static bool HistoryInRing() { return history_in_ring_; }
+
   static void ensure_space_for_stack_trace(SID sid) {
     ScopedMallocCostCenter malloc_cc(__FUNCTION__);
     DCHECK(sid.valid());
@@ -1741,24 +2515,65 @@ class Segment {
     DCHECK(chunk_idx < n_stack_chunks_);
     if (all_stacks_[chunk_idx])
       return;
-    for (size_t i = 0; i <= chunk_idx; i++) {
-      if (all_stacks_[i]) continue;
-      all_stacks_[i] = new uintptr_t[
-          kChunkSizeForStacks * kSizeOfHistoryStackTrace];
-      // we don't clear this memory, it will be clreared later lazily.
-      // We also never delete it because it will be used until the very end.
-    }
+    all_stacks_[chunk_idx] = new uintptr_t[
+        kChunkSizeForStacks * history_words_];
+    // we don't clear this memory, it will be clreared later lazily.
+    MemoryAccounting::Add(kMemHistoryStacks, StackChunkBytes());
+  }
+
+  // Delete the stack trace chunks which hold no allocated SID,
+  // i.e. all of their SIDs are either reusable or not yet allocated.
+  // Returns the number of chunks deleted.
+  static size_t ReleaseDeadHistoryChunks() {
+    if (kSizeOfHistoryStackTrace == 0) return 0;
+    SubsystemTIL til(kSegmentPoolLock);
+    vector<size_t> n_reusable(n_stack_chunks_);
+    for (size_t i = 0; i < reusable_sids_->size(); i++) {
+      n_reusable[(unsigned)(*reusable_sids_)[i].raw() / kChunkSizeForStacks]++;
+    }
+    size_t n_released = 0;
+    // SID 0 is never allocated, but it lives in chunk 0 which we keep.
+    for (size_t i = 1; i < n_stack_chunks_; i++) {
+      if (!all_stacks_[i]) continue;
+      size_t begin = i * kChunkSizeForStacks;
+      size_t n_allocated = (size_t)n_segments_ <= begin ? 0 :
+          min((size_t)n_segments_ - begin, (size_t)kChunkSizeForStacks);
+      if (n_reusable[i] != n_allocated) continue;
+      delete [] all_stacks_[i];
+      all_stacks_[i] = NULL;
+      MemoryAccounting::Add(kMemHistoryStacks, -StackChunkBytes());
+      n_released++;
+    }
+    return n_released;
   }
 
   static string StackTraceString(SID sid) {
     DCHECK(kSizeOfHistoryStackTrace > 0);
-    return StackTrace::EmbeddedStackTraceToString(
-        embedded_stack_trace(sid), kSizeOfHistoryStackTrace);
+    if (!history_in_ring_) {
+      return StackTrace::EmbeddedStackTraceToString(
+          embedded_stack_trace(sid), kSizeOfHistoryStackTrace);
+    }
+    vector<uintptr_t> pcs(kSizeOfHistoryStackTrace);
+    if (!ReplayEventHistory(sid, &pcs[0]))
+      return "    (the stack is no longer in the event history)\n";
+    return StackTrace::EmbeddedStackTraceToString(&pcs[0], pcs.size());
+  }
+
+  // The top frame of the history stack of 'sid', 0 if not known.
+  static uintptr_t HistoryTopPc(SID sid) {
+    DCHECK(kSizeOfHistoryStackTrace > 0);
+    if (!history_in_ring_)
+      return *embedded_stack_trace(sid);
+    vector<uintptr_t> pcs(kSizeOfHistoryStackTrace);
+    if (!ReplayEventHistory(sid, &pcs[0]))
+      return 0;
+    return pcs[0];
   }
 
   // Allocate `n` fresh segments, put SIDs into `fresh_sids`.
   static INLINE void AllocateFreshSegments(size_t n, SID *fresh_sids) {
     ScopedMallocCostCenter malloc_cc(__FUNCTION__);
+    SubsystemTIL til(kSegmentPoolLock);
     size_t i = 0;
     size_t n_reusable = min(n, reusable_sids_->size());
     // First, allocate from reusable_sids_.
@@ -1775,6 +2590,10 @@ class Segment {
       if (ProfileSeg(sid)) {
        Printf("Segment: reused SID %d\n", sid.raw());
       }
+      if (kSizeOfHistoryStackTrace > 0) {
+        // The chunk may have been released by ReleaseDeadHistoryChunks.
+        ensure_space_for_stack_trace(sid);
+      }
       fresh_sids[i] = sid;
     }
     // allocate the rest from new sids.
@@ -1815,6 +2634,20 @@ class Segment {
     seg->lsid_[1] = wr_lockset;
     seg->vts_ = vts;
     seg->lock_era_ = g_lock_era;
+    if (generations_) generations_[sid.raw()]++;
+    if (kSizeOfHistoryStackTrace) {
+      embedded_stack_trace(sid)[0] = 0;
+    }
+  }
+
+  // The owner thread holds the only reference to `sid` and has just
+  // updated its VTS in place. Make the rest of the segment look fresh.
+  static INLINE void RefreshPrivateSid(SID sid) {
+    Segment *seg = GetInternal(sid);
+    DCHECK(seg->seg_ref_count_ == 1);
+    DCHECK(seg->vts_->IsExclusive());
+    seg->lock_era_ = g_lock_era;
+    if (generations_) generations_[sid.raw()]++;
     if (kSizeOfHistoryStackTrace) {
       embedded_stack_trace(sid)[0] = 0;
     }
@@ -1862,6 +2695,7 @@ class Segment {
     Segment *seg = GetInternal(sid);
     seg->tid_ = TID();
     seg->vts_ = NULL;
+    SubsystemTIL til(kSegmentPoolLock);
     reusable_sids_->push_back(sid);
     if (ProfileSeg(sid)) {
       Printf("Segment: recycled SID %d\n", sid.raw());
@@ -1910,6 +2744,7 @@ class Segment {
 
 
   static void ForgetAllState() {
+    SubsystemTIL til(kSegmentPoolLock);
     n_segments_ = 1;
     reusable_sids_->clear();
     // vts_'es will be freed in AddNewSegment.
@@ -1936,13 +2771,15 @@ class Segment {
     return res;
   }
 
-  static bool INLINE HappensBeforeOrSameThread(SID a, SID b) {
+  // Pass use_hb_cache=false when not holding ts_lock.
+  static bool INLINE HappensBeforeOrSameThread(SID a, SID b,
+                                               bool use_hb_cache = true) {
     if (a == b) return true;
     if (Get(a)->tid() == Get(b)->tid()) return true;
-    return HappensBefore(a, b);
+    return HappensBefore(a, b, use_hb_cache);
   }
 
-  static bool INLINE HappensBefore(SID a, SID b) {
+  static bool INLINE HappensBefore(SID a, SID b, bool use_hb_cache = true) {
     DCHECK(a != b);
     G_stats->n_seg_hb++;
     bool res = false;
@@ -1951,7 +2788,8 @@ class Segment {
     DCHECK(seg_a->tid() != seg_b->tid());
     const VTS *vts_a = seg_a->vts();
     const VTS *vts_b = seg_b->vts();
-    res = VTS::HappensBeforeCached(vts_a, vts_b);
+    res = use_hb_cache ? VTS::HappensBeforeCached(vts_a, vts_b)
+                       : VTS::HappensBefore(vts_a, vts_b);
 #if 0
     if (TSAN_DEBUG) {
       Printf("HB = %d\n  %s\n  %s\n", res,
@@ -1963,6 +2801,11 @@ class Segment {
 
   static int32_t NumberOfSegments() { return n_segments_; }
 
+  static int32_t NumberOfSegmentsInUse() {
+    SubsystemTIL til(kSegmentPoolLock);
+    return n_segments_ - reusable_sids_->size();
+  }
+
   static void ShowSegmentStats() {
     Printf("Segment::ShowSegmentStats:\n");
     Printf("n_segments_: %d\n", n_segments_);
@@ -1983,22 +2826,36 @@ class Segment {
   static void InitClassMembers() {
     if (G_flags->keep_history == 0)
       kSizeOfHistoryStackTrace = 0;
+    history_in_ring_ = G_flags->keep_history == 2;
+    history_words_ = history_in_ring_ ? kHistoryRingWords
+                                      : kSizeOfHistoryStackTrace;
     if (G_flags->verbosity >= 0) {
       Report("INFO: Allocating %ldMb (%ld * %ldM) for Segments.\n",
           (sizeof(Segment) * kMaxSID) >> 20,
           sizeof(Segment), kMaxSID >> 20);
       if (kSizeOfHistoryStackTrace) {
         Report("INFO: Will allocate up to %ldMb for 'previous' stack traces.\n",
-            (kSizeOfHistoryStackTrace * sizeof(uintptr_t) * kMaxSID) >> 20);
+            (history_words_ * sizeof(uintptr_t) * kMaxSID) >> 20);
+      }
+      if (G_flags->race_verdict_cache) {
+        Report("INFO: Allocating %ldMb for race verdict cache generations.\n",
+            (sizeof(uint32_t) * kMaxSID) >> 20);
       }
     }
 
     all_segments_  = new Segment[kMaxSID];
     // initialization all segments to 0.
     memset(all_segments_, 0, kMaxSID * sizeof(Segment));
+    MemoryAccounting::Add(kMemSegments, kMaxSID * sizeof(Segment));
     // initialize all_segments_[0] with garbage
     memset(all_segments_, -1, sizeof(Segment));
 
+    if (G_flags->race_verdict_cache) {
+      generations_ = new uint32_t[kMaxSID];
+      memset(generations_, 0, kMaxSID * sizeof(uint32_t));
+      MemoryAccounting::Add(kMemSegments, kMaxSID * sizeof(uint32_t));
+    }
+
     if (kSizeOfHistoryStackTrace > 0) {
       n_stack_chunks_ = kMaxSID / kChunkSizeForStacks;
       if (n_stack_chunks_ * kChunkSizeForStacks < (size_t)kMaxSID)
@@ -2040,27 +2897,106 @@ class Segment {
   // We don't use vector<> or another resizable array to avoid expensive 
   // resizing.
   enum { kChunkSizeForStacks = TSAN_DEBUG ? 512 : 1 * 1024 * 1024 };
+  static intptr_t StackChunkBytes() {
+    return kChunkSizeForStacks * history_words_ * sizeof(uintptr_t);
+  }
   static uintptr_t **all_stacks_;
   static size_t      n_stack_chunks_;
+  // Words per SID in all_stacks_.
+  static size_t      history_words_;
+  static bool        history_in_ring_;
 
   static int32_t n_segments_;
   static vector<SID> *reusable_sids_;
+  // SID => generation, see Generation(). NULL w/o --race_verdict_cache.
+  static uint32_t *generations_;
 };
 
 Segment          *Segment::all_segments_;
 uintptr_t       **Segment::all_stacks_;
 size_t            Segment::n_stack_chunks_;
+size_t            Segment::history_words_;
+bool              Segment::history_in_ring_;
 int32_t           Segment::n_segments_;
 vector<SID>      *Segment::reusable_sids_;
+uint32_t         *Segment::generations_;
 
 // -------- SegmentSet -------------- {{{1
 class SegmentSet {
  public:
-  static NOINLINE SSID AddSegmentToSS(SSID old_ssid, SID new_sid);
-  static NOINLINE SSID RemoveSegmentFromSS(SSID old_ssid, SID sid_to_remove);
+  typedef PairCache<SSID, SID, SSID, 1009, 1> SsidSidToSidCache;
+  // (rd_ssid, wr_ssid) => race verdict, see Detector::CheckIfRace().
+  typedef PairCache<SSID, SSID, int, 1009, 1> VerdictCache;
+
+  // Per-thread state of the SegmentSet code:
+  //  - front caches for AddSegmentToSS()/RemoveSegmentFromSS(),
+  //  - the race verdict cache,
+  //  - SegmentSets whose ref count dropped to zero w/o ts_lock.
+  // The caches are flushed lazily when some SSIDs get recycled.
+  class ThreadCache {
+   public:
+    enum { kMaxNumDeadSsids = 64 };
+    ThreadCache() : epoch_(0) {
+      dead_ssids_.reserve(kMaxNumDeadSsids);
+    }
 
-  static INLINE SSID AddSegmentToTupleSS(SSID ssid, SID new_sid);
-  static INLINE SSID RemoveSegmentFromTupleSS(SSID old_ssid, SID sid_to_remove);
+    INLINE void Sync() {
+      uintptr_t epoch = INTERNAL_ANNOTATE_UNPROTECTED_READ(cache_epoch_);
+      if (UNLIKELY(epoch != epoch_)) {
+        add_cache_.Flush();
+        remove_cache_.Flush();
+        verdict_cache_.Flush();
+        epoch_ = epoch;
+      }
+    }
+
+    VerdictCache *verdict_cache() {
+      Sync();
+      return &verdict_cache_;
+    }
+
+    bool HasRoomForDeadSsids() const {
+      return dead_ssids_.size() < kMaxNumDeadSsids - 2;
+    }
+
+    void ForgetAllState() {
+      dead_ssids_.clear();
+      epoch_ = (uintptr_t)-1;  // Force a flush on next use.
+    }
+
+   private:
+    friend class SegmentSet;
+    SsidSidToSidCache add_cache_;
+    SsidSidToSidCache remove_cache_;
+    VerdictCache verdict_cache_;
+    uintptr_t epoch_;
+    vector<SSID> dead_ssids_;
+  };
+
+  // Must be called under ts_lock.
+  static NOINLINE SSID AddSegmentToSS(SSID old_ssid, SID new_sid,
+                                      ThreadCache *cache);
+  static NOINLINE SSID RemoveSegmentFromSS(SSID old_ssid, SID sid_to_remove,
+                                           ThreadCache *cache);
+
+  // Same as above, but may be called w/o ts_lock.
+  // Return false if a new SegmentSet would have to be created.
+  // The resulting SSID is valid only if TryRef() succeeds on it
+  // and ReuseEpoch() has not changed since before the call.
+  static bool TryAddSegmentToSS(SSID old_ssid, SID new_sid,
+                                ThreadCache *cache, SSID *res);
+  static bool TryRemoveSegmentFromSS(SSID old_ssid, SID sid_to_remove,
+                                     ThreadCache *cache, SSID *res);
+
+  static INLINE bool AddSegmentToTupleSS(SSID ssid, SID new_sid,
+                                         bool unlocked, SSID *res);
+  static INLINE bool RemoveSegmentFromTupleSS(SSID old_ssid, SID sid_to_remove,
+                                              bool unlocked, SSID *res);
+  static INLINE SSID AddSegmentToTupleSS(SSID ssid, SID new_sid) {
+    SSID res;
+    CHECK(AddSegmentToTupleSS(ssid, new_sid, /*unlocked=*/false, &res));
+    return res;
+  }
 
   SSID ComputeSSID() {
     SSID res = map_->GetIdOrZero(this);
@@ -2078,9 +3014,9 @@ class SegmentSet {
       } else {
         DCHECK(ssid.IsTuple());
         int idx = -ssid.raw()-1;
-        DCHECK(idx < static_cast<int>(vec_->size()));
+        DCHECK(idx < static_cast<int>(vec_size_));
         DCHECK(idx >= 0);
-        SegmentSet *res = (*vec_)[idx];
+        SegmentSet *res = VecAt(idx);
         DCHECK(res);
         DCHECK(res->ref_count_ >= 0);
         res->Validate(line);
@@ -2099,21 +3035,22 @@ class SegmentSet {
     DCHECK(!ssid.IsSingleton());
     int idx = -ssid.raw()-1;
     ANNOTATE_IGNORE_READS_BEGIN();
-    DCHECK(idx < static_cast<int>(vec_->size()) && idx >= 0);
+    DCHECK(idx < static_cast<int>(vec_size_) && idx >= 0);
     ANNOTATE_IGNORE_READS_END();
-    SegmentSet *res = (*vec_)[idx];
+    SegmentSet *res = VecAt(idx);
     DCHECK(res);
     DCHECK(res->size() >= 2);
     return res;
   }
 
+  // The caller must have changed ref_count_ from 0 to -1.
   void RecycleOneSegmentSet(SSID ssid) {
-    DCHECK(ref_count_ == 0);
+    DCHECK(ref_count_ == -1);
     DCHECK(ssid.valid());
     DCHECK(!ssid.IsSingleton());
     int idx = -ssid.raw()-1;
-    DCHECK(idx < static_cast<int>(vec_->size()) && idx >= 0);
-    CHECK((*vec_)[idx] == this);
+    DCHECK(idx < static_cast<int>(vec_size_) && idx >= 0);
+    CHECK(VecAt(idx) == this);
     // Printf("SegmentSet::RecycleOneSegmentSet: %d\n", ssid.raw());
     //
     // Recycle segments
@@ -2122,9 +3059,8 @@ class SegmentSet {
       if (sid.raw() == 0) break;
       Segment::Unref(sid, "SegmentSet::Recycle");
     }
-    ref_count_ = -1;
 
-    map_->Erase(this);
+    map_->Erase(this, ssid);
     ready_to_be_reused_->push_back(ssid);
     G_stats->ss_recycle++;
   }
@@ -2138,10 +3074,52 @@ class SegmentSet {
       SegmentSet *sset = Get(ssid);
       // Printf("SSRef   : %d ref=%d %s\n", ssid.raw(), sset->ref_count_, where);
       DCHECK(sset->ref_count_ >= 0);
-      sset->ref_count_++;
+      // Not under a lock when the same SegmentSet is being TryRef-ed.
+      AtomicIncrementRefcount(&sset->ref_count_);
+    }
+  }
+
+  // Ref() for a tuple SSID which may be called w/o ts_lock.
+  // Fails if the SegmentSet has been recycled.
+  static INLINE bool TryRef(SSID ssid) {
+    DCHECK(ssid.IsTuple());
+    SegmentSet *sset = VecAt(-ssid.raw()-1);
+    while (true) {
+      int32_t ref_count = INTERNAL_ANNOTATE_UNPROTECTED_READ(sset->ref_count_);
+      if (ref_count < 0) return false;
+      if (AtomicCompareAndSwap(&sset->ref_count_, ref_count, ref_count + 1))
+        return true;
     }
   }
 
+  // Unref() for a tuple SSID which may be called w/o ts_lock.
+  // If the ref count drops to zero, the SSID is kept in the thread's cache
+  // until FlushDeadSsids() is called under the lock.
+  static INLINE void UnrefNoRecycle(SSID ssid, ThreadCache *cache) {
+    DCHECK(ssid.IsTuple());
+    SegmentSet *sset = Get(ssid);
+    DCHECK(sset->ref_count_ > 0);
+    if (AtomicDecrementRefcount(&sset->ref_count_) == 0) {
+      cache->dead_ssids_.push_back(ssid);
+    }
+  }
+
+  static void FlushDeadSsids(ThreadCache *cache) {
+    AssertTILHeld();
+    for (size_t i = 0; i < cache->dead_ssids_.size(); i++) {
+      SSID ssid = cache->dead_ssids_[i];
+      if (Get(ssid)->ref_count_ == 0) {
+        PushToRecycleQueue(ssid);
+      }
+    }
+    cache->dead_ssids_.clear();
+  }
+
+  // Incremented every time a SegmentSet object gets recycled or reused.
+  static uintptr_t ReuseEpoch() {
+    return INTERNAL_ANNOTATE_UNPROTECTED_READ(reuse_epoch_);
+  }
+
   static void INLINE Unref(SSID ssid, const char *where) {
     AssertTILHeld(); // The reference counting logic below is not thread-safe
     DCHECK(ssid.valid());
@@ -2151,8 +3129,7 @@ class SegmentSet {
       SegmentSet *sset = Get(ssid);
       // Printf("SSUnref : %d ref=%d %s\n", ssid.raw(), sset->ref_count_, where);
       DCHECK(sset->ref_count_ > 0);
-      sset->ref_count_--;
-      if (sset->ref_count_ == 0) {
+      if (AtomicDecrementRefcount(&sset->ref_count_) == 0) {
         // We don't delete unused SSID straightaway due to performance reasons
         // (to avoid flushing caches too often and because SSID may be reused
         // again soon)
@@ -2171,26 +3148,38 @@ class SegmentSet {
         //       it into ready_to_be_reused_
         // 3) When a new SegmentSet is about to be created, we re-use SSID from
         //    ready_to_be_reused_ (if available)
-        ready_to_be_recycled_->push_back(ssid);
-        if (UNLIKELY(ready_to_be_recycled_->size() >
-                     2 * G_flags->segment_set_recycle_queue_size)) {
-          FlushRecycleQueue();
-        }
+        PushToRecycleQueue(ssid);
       }
     }
   }
 
-  static void FlushRecycleQueue() {
-    while (ready_to_be_recycled_->size() >
-        G_flags->segment_set_recycle_queue_size) {
+  static void PushToRecycleQueue(SSID ssid) {
+    SubsystemTIL til(kSegmentSetLock);
+    ready_to_be_recycled_->push_back(ssid);
+    if (UNLIKELY(ready_to_be_recycled_->size() >
+                 2 * G_flags->segment_set_recycle_queue_size)) {
+      FlushRecycleQueue(G_flags->segment_set_recycle_queue_size);
+    }
+  }
+
+  // Recycle all unused SSIDs so that they release their SIDs.
+  static void FlushWholeRecycleQueue() {
+    SubsystemTIL til(kSegmentSetLock);
+    FlushRecycleQueue(0);
+  }
+
+  static void FlushRecycleQueue(size_t max_queue_size) {
+    ReleaseStore(&reuse_epoch_, reuse_epoch_ + 1);
+    while (ready_to_be_recycled_->size() > max_queue_size) {
       SSID rec_ssid = ready_to_be_recycled_->front();
       ready_to_be_recycled_->pop_front();
       int idx = -rec_ssid.raw()-1;
-      SegmentSet *rec_ss = (*vec_)[idx];
+      SegmentSet *rec_ss = VecAt(idx);
       DCHECK(rec_ss);
       DCHECK(rec_ss == Get(rec_ssid));
-      // We should check that this SSID haven't been referenced again.
-      if (rec_ss->ref_count_ == 0) {
+      // We should check that this SSID haven't been referenced again
+      // (possibly w/o a lock, see TryRef()).
+      if (AtomicCompareAndSwap(&rec_ss->ref_count_, 0, -1)) {
         rec_ss->RecycleOneSegmentSet(rec_ssid);
       }
     }
@@ -2219,17 +3208,20 @@ class SegmentSet {
 
   static string ToStringWithLocks(SSID ssid);
 
+  // The per-thread caches will be flushed on their next use.
   static void FlushCaches() {
-    add_segment_cache_->Flush();
-    remove_segment_cache_->Flush();
+    ReleaseStore(&cache_epoch_, cache_epoch_ + 1);
   }
 
   static void ForgetAllState() {
-    for (size_t i = 0; i < vec_->size(); i++) {
-      delete (*vec_)[i];
+    SubsystemTIL til(kSegmentSetLock);
+    for (size_t i = 0; i < vec_size_; i++) {
+      delete VecAt(i);
+      VecAt(i) = NULL;
     }
+    MemoryAccounting::Set(kMemSegmentSets, 0);
     map_->Clear();
-    vec_->clear();
+    vec_size_ = 0;
     ready_to_be_reused_->clear();
     ready_to_be_recycled_->clear();
     FlushCaches();
@@ -2293,16 +3285,17 @@ class SegmentSet {
 
   void NOINLINE Validate(int line) const;
 
-  static size_t NumberOfSegmentSets() { return vec_->size(); }
+  static size_t NumberOfSegmentSets() { return vec_size_; }
 
 
   static void InitClassMembers() {
     map_    = new Map;
-    vec_    = new vector<SegmentSet *>;
+    size_t n_chunks = (kMaxSID >> kVecChunkSizeLog) + 1;
+    vec_chunks_ = new SegmentSet**[n_chunks];
+    memset(vec_chunks_, 0, n_chunks * sizeof(vec_chunks_[0]));
+    vec_size_ = 0;
     ready_to_be_recycled_ = new deque<SSID>;
     ready_to_be_reused_ = new deque<SSID>;
-    add_segment_cache_ = new SsidSidToSidCache;
-    remove_segment_cache_ = new SsidSidToSidCache;
   }
 
  private:
@@ -2335,10 +3328,12 @@ class SegmentSet {
       res_ssid = ready_to_be_reused_->front();
       ready_to_be_reused_->pop_front();
       int idx = -res_ssid.raw()-1;
-      res_ss = (*vec_)[idx];
+      res_ss = VecAt(idx);
       DCHECK(res_ss);
       DCHECK(res_ss->ref_count_ == -1);
       G_stats->ss_reuse++;
+      // Unlocked readers may be looking at the old contents.
+      ReleaseStore(&reuse_epoch_, reuse_epoch_ + 1);
       for (int i = 0; i < kMaxSegmentSetSize; i++) {
         res_ss->sids_[i] = SID(0);
       }
@@ -2347,18 +3342,22 @@ class SegmentSet {
       ScopedMallocCostCenter cc("SegmentSet::CreateNewSegmentSet");
       G_stats->ss_create++;
       res_ss = new SegmentSet;
-      vec_->push_back(res_ss);
-      res_ssid = SSID(-((int32_t)vec_->size()));
+      MemoryAccounting::Add(kMemSegmentSets, sizeof(SegmentSet));
+      res_ss->ref_count_ = -1;
+      VecPushBack(res_ss);
+      res_ssid = SSID(-((int32_t)vec_size_));
       CHECK(res_ssid.valid());
     }
     DCHECK(res_ss);
-    res_ss->ref_count_ = 0;
     for (int i = 0; i < kMaxSegmentSetSize; i++) {
       SID sid = ss->GetSID(i);
       if (sid.raw() == 0) break;
       Segment::Ref(sid, "SegmentSet::FindExistingOrAlocateAndCopy");
       res_ss->SetSID(i, sid);
     }
+    // Make the object visible to TryRef() only when it is complete.
+    DCHECK(res_ss->ref_count_ == -1);
+    CHECK(AtomicCompareAndSwap(&res_ss->ref_count_, -1, 0));
     DCHECK(res_ss == Get(res_ssid));
     map_->Insert(res_ss, res_ssid);
     return res_ssid;
@@ -2384,6 +3383,24 @@ class SegmentSet {
     return AllocateAndCopy(ss);
   }
 
+  static INLINE bool FindExistingOrAllocateAndCopy(SegmentSet *ss,
+                                                   bool unlocked, SSID *res) {
+    if (!unlocked) {
+      *res = FindExistingOrAlocateAndCopy(ss);
+      return true;
+    }
+    *res = map_->GetIdOrZero(ss);
+    return res->raw() != 0;
+  }
+
+  static INLINE bool DoubletonSSID(SID sid1, SID sid2,
+                                   bool unlocked, SSID *res) {
+    SegmentSet tmp;
+    tmp.SetSID(0, sid1);
+    tmp.SetSID(1, sid2);
+    return FindExistingOrAllocateAndCopy(&tmp, unlocked, res);
+  }
+
   static INLINE SSID DoubletonSSID(SID sid1, SID sid2) {
     SegmentSet tmp;
     tmp.SetSID(0, sid1);
@@ -2391,6 +3408,12 @@ class SegmentSet {
     return FindExistingOrAlocateAndCopy(&tmp);
   }
 
+  static bool AddSegmentToSSImpl(SSID old_ssid, SID new_sid,
+                                 ThreadCache *cache, bool unlocked, SSID *res);
+  static bool RemoveSegmentFromSSImpl(SSID old_ssid, SID sid_to_remove,
+                                      ThreadCache *cache, bool unlocked,
+                                      SSID *res);
+
   // testing only
   static SegmentSet *AddSegmentToTupleSS(SegmentSet *ss, SID new_sid) {
     SSID ssid = AddSegmentToTupleSS(ss->ComputeSSID(), new_sid);
@@ -2405,18 +3428,6 @@ class SegmentSet {
   }
 
   // static data members
-  struct Less {
-    INLINE bool operator() (const SegmentSet *ss1,
-                            const SegmentSet *ss2) const {
-      for (int i = 0; i < kMaxSegmentSetSize; i++) {
-        SID sid1 = ss1->sids_[i],
-            sid2 = ss2->sids_[i];
-        if (sid1 != sid2) return sid1 < sid2;
-      }
-      return false;
-    }
-  };
-
   struct SSEq {
     INLINE bool operator() (const SegmentSet *ss1,
                             const SegmentSet *ss2) const {
@@ -2450,74 +3461,155 @@ class SegmentSet {
     }
   };
 
-  struct SSTraits {
-    enum {
-      // These values are taken from the hash_compare defaults.
-      bucket_size = 4,  // Must be greater than zero.
-      min_buckets = 8,  // Must be power of 2.
-    };
-
-    INLINE size_t operator()(const SegmentSet *ss) const {
-      SSHash sshash;
-      return sshash(ss);
-    }
-
-    INLINE bool operator()(const SegmentSet *ss1, const SegmentSet *ss2) const {
-      Less less;
-      return less(ss1, ss2);
-    }
-  };
-
-  template <class MapType>
-  static SSID GetIdOrZeroFromMap(MapType *map, SegmentSet *ss) {
-    typename MapType::iterator it = map->find(ss);
-    if (it == map->end())
-      return SSID(0);
-    return it->second;
-  }
-
+  // Open-addressing hash table that maps SegmentSet contents to SSIDs.
+  // Insert(), Erase() and Clear() are called under ts_lock.
+  // GetIdOrZero() may also be called w/o a lock. In that case it may miss
+  // an entry being inserted or return an SSID which is being recycled or
+  // reused; the unlocked callers validate the result with TryRef() and
+  // ReuseEpoch().
   class Map {
    public:
-    SSID GetIdOrZero(SegmentSet *ss) {
-      return GetIdOrZeroFromMap(&map_, ss);
+    Map() : n_used_(0), n_deleted_(0) {
+      table_ = NewTable(kInitialCapacity);
     }
 
-    void Insert(SegmentSet *ss, SSID id) {
-      map_[ss] = id;
+    SSID GetIdOrZero(const SegmentSet *ss) {
+      const Table *t = INTERNAL_ANNOTATE_UNPROTECTED_READ(table_);
+      SSEq sseq;
+      uintptr_t i = Index(ss, t->mask);
+      for (uintptr_t n = 0; n <= t->mask; n++, i = (i + 1) & t->mask) {
+        uintptr_t slot = INTERNAL_ANNOTATE_UNPROTECTED_READ(t->slots[i]);
+        if (slot == kEmptySlot) break;
+        if (slot == kDeletedSlot) continue;
+        if (sseq(VecAt(slot - 1), ss))
+          return SSID(-(int32_t)slot);
+      }
+      return SSID(0);
     }
 
-    void Erase(SegmentSet *ss) {
-      CHECK(map_.erase(ss));
+    void Insert(SegmentSet *ss, SSID id) {
+      DCHECK(id.IsTuple());
+      if ((n_used_ + n_deleted_ + 1) * 2 > table_->mask + 1) {
+        Rehash(n_used_ + 1);
+      }
+      InsertIntoTable(table_, ss, id);
+      n_used_++;
+    }
+
+    void Erase(SegmentSet *ss, SSID id) {
+      uintptr_t slot = -id.raw();
+      uintptr_t i = Index(ss, table_->mask);
+      for (uintptr_t n = 0; n <= table_->mask; n++, i = (i + 1) & table_->mask) {
+        CHECK(table_->slots[i] != kEmptySlot);
+        if (table_->slots[i] == slot) {
+          ReleaseStore(&table_->slots[i], kDeletedSlot);
+          n_used_--;
+          n_deleted_++;
+          return;
+        }
+      }
+      CHECK(0);
     }
 
+    // Must not run concurrently with GetIdOrZero().
     void Clear() {
-      map_.clear();
+      for (size_t i = 0; i < retired_.size(); i++) {
+        delete [] (char*)retired_[i];
+      }
+      retired_.clear();
+      memset(table_->slots, 0, (table_->mask + 1) * sizeof(uintptr_t));
+      n_used_ = 0;
+      n_deleted_ = 0;
     }
 
    private:
-    // TODO(timurrrr): consider making a custom hash_table.
-#if defined(_MSC_VER)
-    typedef stdext::hash_map<SegmentSet*, SSID, SSTraits > MapType__;
-#elif 1
-    typedef unordered_map<SegmentSet*, SSID, SSHash, SSEq > MapType__;
-#else
-    // Old code, may be useful for debugging.
-    typedef map<SegmentSet*, SSID, Less > MapType__;
-#endif
-    MapType__ map_;
+    // A slot holds 0 (empty), ~0 (deleted) or -ssid.
+    static const uintptr_t kEmptySlot = 0;
+    static const uintptr_t kDeletedSlot = ~(uintptr_t)0;
+    static const uintptr_t kInitialCapacity = 1 << 12;
+
+    struct Table {
+      uintptr_t mask;
+      uintptr_t slots[1];
+    };
+
+    static Table *NewTable(uintptr_t capacity) {
+      DCHECK((capacity & (capacity - 1)) == 0);
+      size_t size = sizeof(Table) + (capacity - 1) * sizeof(uintptr_t);
+      Table *t = (Table*)new char[size];
+      memset(t, 0, size);
+      t->mask = capacity - 1;
+      return t;
+    }
+
+    // SSHash leaves the low bits of the first SID mostly unmixed,
+    // which is bad for linear probing.
+    static INLINE uintptr_t Index(const SegmentSet *ss, uintptr_t mask) {
+      SSHash sshash;
+      uint64_t h = sshash(ss) * 0x9E3779B97F4A7C15ULL;
+      return (uintptr_t)(h >> 32) & mask;
+    }
+
+    static void InsertIntoTable(Table *t, SegmentSet *ss, SSID id) {
+      uintptr_t i = Index(ss, t->mask);
+      while (t->slots[i] != kEmptySlot && t->slots[i] != kDeletedSlot)
+        i = (i + 1) & t->mask;
+      ReleaseStore(&t->slots[i], -id.raw());
+    }
+
+    // Builds a new table w/o deleted slots and publishes it.
+    // The old table is freed only in Clear() as unlocked readers may use it.
+    void Rehash(uintptr_t n_entries) {
+      uintptr_t capacity = table_->mask + 1;
+      while (capacity < 4 * n_entries)
+        capacity *= 2;
+      Table *t = NewTable(capacity);
+      for (uintptr_t i = 0; i <= table_->mask; i++) {
+        uintptr_t slot = table_->slots[i];
+        if (slot == kEmptySlot || slot == kDeletedSlot) continue;
+        InsertIntoTable(t, VecAt(slot - 1), SSID(-(int32_t)slot));
+      }
+      retired_.push_back(table_);
+      ReleaseStore((uintptr_t*)&table_, (uintptr_t)t);
+      n_deleted_ = 0;
+    }
+
+    Table *table_;
+    uintptr_t n_used_;
+    uintptr_t n_deleted_;
+    vector<Table*> retired_;
   };
 
+  // All SegmentSet objects, indexed by (-ssid - 1).
+  // The objects are reused in place and never move (until ForgetAllState),
+  // so they can be looked up w/o a lock.
+  enum { kVecChunkSizeLog = 12, kVecChunkSize = 1 << kVecChunkSizeLog };
+
+  static INLINE SegmentSet *&VecAt(uintptr_t idx) {
+    return vec_chunks_[idx >> kVecChunkSizeLog][idx & (kVecChunkSize - 1)];
+  }
+
+  static void VecPushBack(SegmentSet *ss) {
+    uintptr_t idx = vec_size_;
+    SegmentSet **&chunk = vec_chunks_[idx >> kVecChunkSizeLog];
+    if (chunk == NULL) {
+      chunk = new SegmentSet*[kVecChunkSize];
+    }
+    chunk[idx & (kVecChunkSize - 1)] = ss;
+    ReleaseStore(&vec_size_, idx + 1);
+  }
+
 //  typedef map<SegmentSet*, SSID, Less> Map;
 
   static Map                  *map_;
-  // TODO(kcc): use vector<SegmentSet> instead.
-  static vector<SegmentSet *> *vec_;
+  static SegmentSet         ***vec_chunks_;
+  static uintptr_t             vec_size_;
   static deque<SSID>         *ready_to_be_reused_;
   static deque<SSID>         *ready_to_be_recycled_;
 
-  typedef PairCache<SSID, SID, SSID, 1009, 1> SsidSidToSidCache;
-  static SsidSidToSidCache    *add_segment_cache_;
-  static SsidSidToSidCache    *remove_segment_cache_;
+  // See ThreadCache::Sync() and ReuseEpoch().
+  static uintptr_t             cache_epoch_;
+  static uintptr_t             reuse_epoch_;
 
   // sids_ contains up to kMaxSegmentSetSize SIDs.
   // Contains zeros at the end if size < kMaxSegmentSetSize.
@@ -2526,51 +3618,88 @@ class SegmentSet {
 };
 
 SegmentSet::Map      *SegmentSet::map_;
-vector<SegmentSet *> *SegmentSet::vec_;
+SegmentSet         ***SegmentSet::vec_chunks_;
+uintptr_t             SegmentSet::vec_size_;
 deque<SSID>         *SegmentSet::ready_to_be_reused_;
 deque<SSID>         *SegmentSet::ready_to_be_recycled_;
-SegmentSet::SsidSidToSidCache    *SegmentSet::add_segment_cache_;
-SegmentSet::SsidSidToSidCache    *SegmentSet::remove_segment_cache_;
+uintptr_t             SegmentSet::cache_epoch_;
+uintptr_t             SegmentSet::reuse_epoch_;
+
 
 
 
+SSID SegmentSet::RemoveSegmentFromSS(SSID old_ssid, SID sid_to_remove,
+                                     ThreadCache *cache) {
+  SubsystemTIL til(kSegmentSetLock);
+  SSID res;
+  CHECK(RemoveSegmentFromSSImpl(old_ssid, sid_to_remove, cache,
+                                /*unlocked=*/false, &res));
+  return res;
+}
 
-SSID SegmentSet::RemoveSegmentFromSS(SSID old_ssid, SID sid_to_remove) {
+bool SegmentSet::TryRemoveSegmentFromSS(SSID old_ssid, SID sid_to_remove,
+                                        ThreadCache *cache, SSID *res) {
+  return RemoveSegmentFromSSImpl(old_ssid, sid_to_remove, cache,
+                                 /*unlocked=*/true, res);
+}
+
+// static
+bool SegmentSet::RemoveSegmentFromSSImpl(SSID old_ssid, SID sid_to_remove,
+                                         ThreadCache *cache, bool unlocked,
+                                         SSID *res) {
   DCHECK(old_ssid.IsValidOrEmpty());
   DCHECK(sid_to_remove.valid());
-  SSID res;
-  if (remove_segment_cache_->Lookup(old_ssid, sid_to_remove, &res)) {
-    return res;
+  cache->Sync();
+  if (cache->remove_cache_.Lookup(old_ssid, sid_to_remove, res)) {
+    return true;
   }
 
   if (old_ssid.IsEmpty()) {
-    res = old_ssid;  // Nothing to remove.
+    *res = old_ssid;  // Nothing to remove.
   } else if (LIKELY(old_ssid.IsSingleton())) {
     SID sid = old_ssid.GetSingleton();
-    if (Segment::HappensBeforeOrSameThread(sid, sid_to_remove))
-      res = SSID(0);  // Empty.
+    if (Segment::HappensBeforeOrSameThread(sid, sid_to_remove, !unlocked))
+      *res = SSID(0);  // Empty.
     else
-      res = old_ssid;
-  } else {
-    res = RemoveSegmentFromTupleSS(old_ssid, sid_to_remove);
+      *res = old_ssid;
+  } else if (!RemoveSegmentFromTupleSS(old_ssid, sid_to_remove,
+                                       unlocked, res)) {
+    return false;
   }
-  remove_segment_cache_->Insert(old_ssid, sid_to_remove, res);
+  // Results found w/o a lock are not validated yet, don't cache them.
+  if (!unlocked)
+    cache->remove_cache_.Insert(old_ssid, sid_to_remove, *res);
+  return true;
+}
+
+
+SSID SegmentSet::AddSegmentToSS(SSID old_ssid, SID new_sid,
+                                ThreadCache *cache) {
+  SubsystemTIL til(kSegmentSetLock);
+  SSID res;
+  CHECK(AddSegmentToSSImpl(old_ssid, new_sid, cache,
+                           /*unlocked=*/false, &res));
   return res;
 }
 
+bool SegmentSet::TryAddSegmentToSS(SSID old_ssid, SID new_sid,
+                                   ThreadCache *cache, SSID *res) {
+  return AddSegmentToSSImpl(old_ssid, new_sid, cache, /*unlocked=*/true, res);
+}
 
 // static
 //
-// This method returns a SSID of a SegmentSet containing "new_sid" and all those
-// segments from "old_ssid" which do not happen-before "new_sid".
+// This method computes a SSID of a SegmentSet containing "new_sid" and all
+// those segments from "old_ssid" which do not happen-before "new_sid".
 //
 // For details, see
 // http://code.google.com/p/data-race-test/wiki/ThreadSanitizerAlgorithm#State_machine
-SSID SegmentSet::AddSegmentToSS(SSID old_ssid, SID new_sid) {
+bool SegmentSet::AddSegmentToSSImpl(SSID old_ssid, SID new_sid,
+                                    ThreadCache *cache, bool unlocked,
+                                    SSID *res) {
   DCHECK(old_ssid.raw() == 0 || old_ssid.valid());
   DCHECK(new_sid.valid());
   Segment::AssertLive(new_sid, __LINE__);
-  SSID res;
 
   // These two TIDs will only be used if old_ssid.IsSingleton() == true.
   TID old_tid;
@@ -2583,32 +3712,38 @@ SSID SegmentSet::AddSegmentToSS(SSID old_ssid, SID new_sid) {
 
     if (UNLIKELY(old_sid == new_sid)) {
       // The new segment equals the old one - nothing has changed.
-      return old_ssid;
+      *res = old_ssid;
+      return true;
     }
 
     old_tid = Segment::Get(old_sid)->tid();
     new_tid = Segment::Get(new_sid)->tid();
     if (LIKELY(old_tid == new_tid)) {
       // The new segment is in the same thread - just replace the SID.
-      return SSID(new_sid);
+      *res = SSID(new_sid);
+      return true;
     }
 
-    if (Segment::HappensBefore(old_sid, new_sid)) {
+    if (Segment::HappensBefore(old_sid, new_sid, !unlocked)) {
       // The new segment is in another thread, but old segment
       // happens before the new one - just replace the SID.
-      return SSID(new_sid);
+      *res = SSID(new_sid);
+      return true;
     }
 
-    DCHECK(!Segment::HappensBefore(new_sid, old_sid));
+    DCHECK(!Segment::HappensBefore(new_sid, old_sid, !unlocked));
     // The only other case is Signleton->Doubleton transition, see below.
   } else if (LIKELY(old_ssid.IsEmpty())) {
-    return SSID(new_sid);
+    *res = SSID(new_sid);
+    return true;
   }
 
   // Lookup the cache.
-  if (add_segment_cache_->Lookup(old_ssid, new_sid, &res)) {
-    SegmentSet::AssertLive(res, __LINE__);
-    return res;
+  cache->Sync();
+  if (cache->add_cache_.Lookup(old_ssid, new_sid, res)) {
+    if (!unlocked)
+      SegmentSet::AssertLive(*res, __LINE__);
+    return true;
   }
 
   if (LIKELY(old_ssid.IsSingleton())) {
@@ -2620,27 +3755,32 @@ SSID SegmentSet::AddSegmentToSS(SSID old_ssid, SID new_sid) {
     SID old_sid(old_ssid.raw());
     DCHECK(old_sid.valid());
 
-    DCHECK(!Segment::HappensBefore(new_sid, old_sid));
-    DCHECK(!Segment::HappensBefore(old_sid, new_sid));
-    res = (old_tid < new_tid
-      ? DoubletonSSID(old_sid, new_sid)
-      : DoubletonSSID(new_sid, old_sid));
-    SegmentSet::AssertLive(res, __LINE__);
-  } else {
-    res = AddSegmentToTupleSS(old_ssid, new_sid);
-    SegmentSet::AssertLive(res, __LINE__);
+    DCHECK(!Segment::HappensBefore(new_sid, old_sid, !unlocked));
+    DCHECK(!Segment::HappensBefore(old_sid, new_sid, !unlocked));
+    if (!(old_tid < new_tid
+          ? DoubletonSSID(old_sid, new_sid, unlocked, res)
+          : DoubletonSSID(new_sid, old_sid, unlocked, res))) {
+      return false;
+    }
+  } else if (!AddSegmentToTupleSS(old_ssid, new_sid, unlocked, res)) {
+    return false;
   }
 
   // Put the result into cache.
-  add_segment_cache_->Insert(old_ssid, new_sid, res);
-
-  return res;
+  // Results found w/o a lock are not validated yet, don't cache them.
+  if (!unlocked) {
+    SegmentSet::AssertLive(*res, __LINE__);
+    cache->add_cache_.Insert(old_ssid, new_sid, *res);
+  }
+  return true;
 }
 
-SSID SegmentSet::RemoveSegmentFromTupleSS(SSID ssid, SID sid_to_remove) {
+bool SegmentSet::RemoveSegmentFromTupleSS(SSID ssid, SID sid_to_remove,
+                                          bool unlocked, SSID *res) {
   DCHECK(ssid.IsTuple());
   DCHECK(ssid.valid());
-  AssertLive(ssid, __LINE__);
+  if (!unlocked)
+    AssertLive(ssid, __LINE__);
   SegmentSet *ss = Get(ssid);
 
   int32_t old_size = 0, new_size = 0;
@@ -2653,27 +3793,39 @@ SSID SegmentSet::RemoveSegmentFromTupleSS(SSID ssid, SID sid_to_remove) {
     if (sid.raw() == 0) break;
     DCHECK(sid.valid());
     Segment::AssertLive(sid, __LINE__);
-    if (Segment::HappensBeforeOrSameThread(sid, sid_to_remove))
+    if (Segment::HappensBeforeOrSameThread(sid, sid_to_remove, !unlocked))
       continue;  // Skip this segment from the result.
     tmp_sids[new_size++] = sid;
   }
 
-  if (new_size == old_size) return ssid;
-  if (new_size == 0) return SSID(0);
-  if (new_size == 1) return SSID(tmp_sids[0]);
+  if (new_size == old_size) {
+    *res = ssid;
+    return true;
+  }
+  if (new_size == 0) {
+    *res = SSID(0);
+    return true;
+  }
+  if (new_size == 1) {
+    *res = SSID(tmp_sids[0]);
+    return true;
+  }
 
-  if (TSAN_DEBUG) tmp.Validate(__LINE__);
+  if (TSAN_DEBUG && !unlocked) tmp.Validate(__LINE__);
 
-  SSID res = FindExistingOrAlocateAndCopy(&tmp);
-  if (TSAN_DEBUG) Get(res)->Validate(__LINE__);
-  return res;
+  if (!FindExistingOrAllocateAndCopy(&tmp, unlocked, res))
+    return false;
+  if (TSAN_DEBUG && !unlocked) Get(*res)->Validate(__LINE__);
+  return true;
 }
 
 //  static
-SSID SegmentSet::AddSegmentToTupleSS(SSID ssid, SID new_sid) {
+bool SegmentSet::AddSegmentToTupleSS(SSID ssid, SID new_sid,
+                                     bool unlocked, SSID *res) {
   DCHECK(ssid.IsTuple());
   DCHECK(ssid.valid());
-  AssertLive(ssid, __LINE__);
+  if (!unlocked)
+    AssertLive(ssid, __LINE__);
   SegmentSet *ss = Get(ssid);
 
   Segment::AssertLive(new_sid, __LINE__);
@@ -2696,7 +3848,8 @@ SSID SegmentSet::AddSegmentToTupleSS(SSID ssid, SID new_sid) {
     if (sid == new_sid) {
       // we are trying to insert a sid which is already there.
       // SS will not change.
-      return ssid;
+      *res = ssid;
+      return true;
     }
 
     if (tid == new_tid) {
@@ -2706,7 +3859,8 @@ SSID SegmentSet::AddSegmentToTupleSS(SSID ssid, SID new_sid) {
         // Optimization: if a segment with the same VTS and LS
         // as in the current is already inside SS, don't modify the SS.
         // Improves performance with --keep-history >= 1.
-        return ssid;
+        *res = ssid;
+        return true;
       }
       // we have another segment from the same thread => replace it.
       tmp_sids[new_size++] = new_sid;
@@ -2720,8 +3874,8 @@ SSID SegmentSet::AddSegmentToTupleSS(SSID ssid, SID new_sid) {
       inserted_new_sid = true;
     }
 
-    if (!Segment::HappensBefore(sid, new_sid)) {
-      DCHECK(!Segment::HappensBefore(new_sid, sid));
+    if (!Segment::HappensBefore(sid, new_sid, !unlocked)) {
+      DCHECK(!Segment::HappensBefore(new_sid, sid, !unlocked));
       tmp_sids[new_size++] = sid;
     }
   }
@@ -2732,7 +3886,8 @@ SSID SegmentSet::AddSegmentToTupleSS(SSID ssid, SID new_sid) {
 
   CHECK_GT(new_size, 0);
   if (new_size == 1) {
-    return SSID(new_sid.raw());  // Singleton.
+    *res = SSID(new_sid.raw());  // Singleton.
+    return true;
   }
 
   if (new_size > kMaxSegmentSetSize) {
@@ -2764,11 +3919,12 @@ SSID SegmentSet::AddSegmentToTupleSS(SSID ssid, SID new_sid) {
   SegmentSet tmp;
   for (int i = 0; i < new_size; i++)
     tmp.sids_[i] = tmp_sids[i];  // TODO(timurrrr): avoid copying?
-  if (TSAN_DEBUG) tmp.Validate(__LINE__);
+  if (TSAN_DEBUG && !unlocked) tmp.Validate(__LINE__);
 
-  SSID res = FindExistingOrAlocateAndCopy(&tmp);
-  if (TSAN_DEBUG) Get(res)->Validate(__LINE__);
-  return res;
+  if (!FindExistingOrAllocateAndCopy(&tmp, unlocked, res))
+    return false;
+  if (TSAN_DEBUG && !unlocked) Get(*res)->Validate(__LINE__);
+  return true;
 }
 
 
@@ -2952,6 +4108,57 @@ class ShadowValue {
   int32_t wr_ssid_;
 };
 
+// -------- ShadowGeneration --------------- {{{1
+// Generations of lazily cleared memory (see LazyShadowClear).
+// Every large ClearMemoryState() bumps the current generation and stores it
+// for the 64K regions it covers (regions are hashed into a small table).
+// A CacheLine remembers the generation at which it was brought up to date;
+// if it is older than its region's generation, it may have stale contents.
+// Read w/o a lock on the fast path, modified under ts_lock.
+class ShadowGeneration {
+ public:
+  static uint64_t current() { return current_; }
+
+  INLINE static bool IsStale(uintptr_t tag, uint64_t line_generation) {
+    return line_generation < regions_[RegionIndex(tag)];
+  }
+
+  // Must be called under ts_lock.
+  static uint64_t BumpForRange(uintptr_t a, uintptr_t b) {
+    current_++;
+    uintptr_t first = a >> kRegionSizeLog;
+    uintptr_t last = (b - 1) >> kRegionSizeLog;
+    if (last - first + 1 >= kNumRegions) {
+      for (uintptr_t i = 0; i < kNumRegions; i++)
+        regions_[i] = current_;
+    } else {
+      for (uintptr_t r = first; r <= last; r++)
+        regions_[r & (kNumRegions - 1)] = current_;
+    }
+    return current_;
+  }
+
+  static void InitClassMembers() {
+    ANNOTATE_BENIGN_RACE_SIZED(regions_, sizeof(regions_),
+                               "ShadowGeneration::regions_");
+    ANNOTATE_BENIGN_RACE(&current_, "ShadowGeneration::current_");
+  }
+
+ private:
+  static const uintptr_t kRegionSizeLog = 16;
+  static const uintptr_t kNumRegions = 4096;
+
+  INLINE static uintptr_t RegionIndex(uintptr_t tag) {
+    return (tag >> kRegionSizeLog) & (kNumRegions - 1);
+  }
+
+  static uint64_t current_;
+  static uint64_t regions_[kNumRegions];
+};
+
+uint64_t ShadowGeneration::current_;
+uint64_t ShadowGeneration::regions_[ShadowGeneration::kNumRegions];
+
 // -------- CacheLine --------------- {{{1
 // The CacheLine is a set of Mask::kNBits (32 or 64) Shadow Values.
 // The shadow values in a cache line are grouped in subsets of 8 values.
@@ -2998,23 +4205,47 @@ class CacheLine {
   static const uintptr_t kLineSizeBits = Mask::kNBitsLog;  // Don't change this.
   static const uintptr_t kLineSize = Mask::kNBits;
 
-  static CacheLine *CreateNewCacheLine(uintptr_t tag) {
+  // Both take an optional per-thread magazine, see NewMagazine().
+  static CacheLine *CreateNewCacheLine(uintptr_t tag,
+                                       FreeListMagazine *mag = NULL) {
     ScopedMallocCostCenter cc("CreateNewCacheLine");
-    void *mem = free_list_->Allocate();
+    void *mem;
+    if (mag) {
+      mem = mag->Allocate();
+    } else {
+      SubsystemTIL til(kCacheLinePoolLock);
+      mem = free_list_->Allocate();
+    }
     DCHECK(mem);
     return new (mem) CacheLine(tag);
   }
 
-  static void Delete(CacheLine *line) {
+  static void Delete(CacheLine *line, FreeListMagazine *mag = NULL) {
+    if (mag) {
+      mag->Deallocate(line);
+      return;
+    }
+    SubsystemTIL til(kCacheLinePoolLock);
     free_list_->Deallocate(line);
   }
 
+  static FreeListMagazine *NewMagazine() {
+    return new FreeListMagazine(free_list_, kCacheLinePoolLock);
+  }
+
   const Mask &has_shadow_value() const { return has_shadow_value_;  }
   Mask &traced() { return traced_; }
   Mask &published() { return published_; }
   Mask &racey()  { return racey_; }
   uintptr_t tag() { return tag_; }
 
+  // See ShadowGeneration.
+  uint64_t generation() const { return generation_; }
+  void set_generation(uint64_t generation) { generation_ = generation; }
+  INLINE bool IsStale() const {
+    return ShadowGeneration::IsStale(tag_, generation_);
+  }
+
   void DebugTrace(uintptr_t off, const char *where_str, int where_int) {
     (void)off;
     (void)where_str;
@@ -3040,6 +4271,13 @@ class CacheLine {
 #endif
   }
 
+  // Drop the shadow value at 'off'. The caller is responsible for Unref.
+  void ClearSvalAtOffset(uintptr_t off) {
+    DebugTrace(off, __FUNCTION__, __LINE__);
+    DCHECK(has_shadow_value().Get(off));
+    has_shadow_value_.Clear(off);
+  }
+
   // Add a new shadow value to a place where there was no shadow value before.
   ShadowValue *AddNewSvalAtOffset(uintptr_t off) {
     DebugTrace(off, __FUNCTION__, __LINE__);
@@ -3240,17 +4478,19 @@ class CacheLine {
     if (TSAN_DEBUG) {
       Printf("sizeof(CacheLine) = %ld\n", sizeof(CacheLine));
     }
-    free_list_ = new FreeList(sizeof(CacheLine), 1024);
+    free_list_ = new FreeList(sizeof(CacheLine), 1024, kMemCacheLines);
   }
 
  private:
   explicit CacheLine(uintptr_t tag) {
     tag_ = tag;
+    generation_ = ShadowGeneration::current();
     Clear();
   }
   ~CacheLine() { }
 
   uintptr_t tag_;
+  uint64_t generation_;
 
   // data members
   Mask has_shadow_value_;
@@ -3266,6 +4506,258 @@ class CacheLine {
 
 FreeList *CacheLine::free_list_;
 
+// -------- LineMagazines --------------- {{{1
+// Per-thread magazines for the CacheLine and CompressedCacheLine objects
+// which Cache::WriteBackAndFetch() creates and deletes, possibly w/o ts_lock.
+// See CompressedCacheLine::InitMagazines().
+struct LineMagazines {
+  LineMagazines() : line(NULL), uniform(NULL), compressed(NULL) { }
+  ~LineMagazines() {
+    delete line;
+    delete uniform;
+    delete compressed;
+  }
+  bool initialized() const { return line != NULL; }
+  void FlushAll() {
+    if (!initialized()) return;
+    line->FlushAll();
+    uniform->FlushAll();
+    compressed->FlushAll();
+  }
+
+  FreeListMagazine *line;
+  FreeListMagazine *uniform;
+  FreeListMagazine *compressed;
+};
+
+// NULL if the thread should use the free lists directly.
+static LineMagazines *line_magazines(TSanThread *t);
+
+// -------- CompressedCacheLine --------------- {{{1
+// A cold CacheLine (i.e. one evicted from Cache::lines_ into the storage)
+// with --compress_cache_lines. Most lines hold very few different shadow
+// values (e.g. memset-ed or bulk-initialized buffers), so instead of
+// kLineSize values we keep up to kMaxValues different ones plus a 2-bit
+// index per offset. A line with a single value has no index at all.
+// Lines with traced, racey or published bytes are never compressed.
+// The shadow values keep their references while compressed.
+class CompressedCacheLine {
+ public:
+  static const uintptr_t kMaxValues = 4;
+
+  // Returns NULL if the line can not be compressed.
+  // The line is not modified or deleted.
+  static CompressedCacheLine *Compress(CacheLine *line,
+                                       LineMagazines *mags = NULL) {
+    if (!line->traced().Empty() || !line->racey().Empty() ||
+        !line->published().Empty())
+      return NULL;
+    ShadowValue values[kMaxValues];
+    uint8_t index[CacheLine::kLineSize];
+    uintptr_t n_values = 0;
+    Mask mask(line->has_shadow_value());
+    for (uintptr_t off = 0; off < CacheLine::kLineSize; off++) {
+      if (!mask.Get(off)) continue;
+      ShadowValue sval = line->GetValue(off);
+      uintptr_t i = 0;
+      while (i < n_values && values[i] != sval) i++;
+      if (i == n_values) {
+        if (n_values == kMaxValues) return NULL;
+        values[n_values++] = sval;
+      }
+      index[off] = i;
+    }
+    ScopedMallocCostCenter cc("CompressedCacheLine::Compress");
+    void *mem;
+    if (mags) {
+      mem = (n_values <= 1 ? mags->uniform : mags->compressed)->Allocate();
+    } else {
+      SubsystemTIL til(kCacheLinePoolLock);
+      mem = (n_values <= 1 ? uniform_free_list_ : free_list_)->Allocate();
+    }
+    CompressedCacheLine *res = new (mem) CompressedCacheLine;
+    DCHECK(reinterpret_cast<uintptr_t>(res->values_) ==
+           reinterpret_cast<uintptr_t>(res) + kHeaderSize);
+    res->tag_ = line->tag();
+    res->generation_ = line->generation();
+    res->has_shadow_value_ = mask;
+    res->n_values_ = n_values;
+    for (uintptr_t i = 0; i < CacheLine::kLineSize / 8; i++)
+      res->granularity_[i] = *line->granularity_mask(i * 8);
+    for (uintptr_t i = 0; i < n_values; i++)
+      res->values_[i] = values[i];
+    if (n_values > 1) {
+      uint8_t *packed = res->index();
+      memset(packed, 0, kIndexSize);
+      for (uintptr_t off = 0; off < CacheLine::kLineSize; off++) {
+        if (mask.Get(off))
+          packed[off / 4] |= index[off] << (2 * (off % 4));
+      }
+    }
+    return res;
+  }
+
+  // Create a CacheLine with the same contents.
+  CacheLine *Inflate(LineMagazines *mags = NULL) {
+    CacheLine *line = CacheLine::CreateNewCacheLine(tag_,
+                                                    mags ? mags->line : NULL);
+    line->set_generation(generation_);
+    for (uintptr_t i = 0; i < CacheLine::kLineSize / 8; i++)
+      *line->granularity_mask(i * 8) = granularity_[i];
+    Mask mask(has_shadow_value_);
+    while (!mask.Empty()) {
+      uintptr_t off = mask.GetSomeSetBit();
+      mask.Clear(off);
+      *line->AddNewSvalAtOffset(off) = GetValue(off);
+    }
+    return line;
+  }
+
+  static void Delete(CompressedCacheLine *line, LineMagazines *mags = NULL) {
+    bool uniform = line->n_values_ <= 1;
+    if (mags) {
+      (uniform ? mags->uniform : mags->compressed)->Deallocate(line);
+      return;
+    }
+    SubsystemTIL til(kCacheLinePoolLock);
+    (uniform ? uniform_free_list_ : free_list_)->Deallocate(line);
+  }
+
+  uintptr_t tag() const { return tag_; }
+  const Mask &has_shadow_value() const { return has_shadow_value_; }
+  uintptr_t n_values() const { return n_values_; }
+
+  ShadowValue GetValue(uintptr_t off) {
+    DCHECK(has_shadow_value_.Get(off));
+    if (n_values_ <= 1) return values_[0];
+    return values_[(index()[off / 4] >> (2 * (off % 4))) & 3];
+  }
+
+  // Number of bytes this line occupies.
+  uintptr_t MemSize() const {
+    return n_values_ <= 1 ? kUniformSize : kSize;
+  }
+  static uintptr_t MaxMemSize() { return kSize; }
+
+  static void InitClassMembers() {
+    if (TSAN_DEBUG) {
+      Printf("sizeof(CompressedCacheLine) = %ld/%ld\n", kUniformSize, kSize);
+    }
+    uniform_free_list_ = new FreeList(kUniformSize, 1024, kMemCompressedLines);
+    free_list_ = new FreeList(kSize, 1024, kMemCompressedLines);
+  }
+
+  static void InitMagazines(LineMagazines *mags) {
+    mags->line = CacheLine::NewMagazine();
+    mags->uniform = new FreeListMagazine(uniform_free_list_,
+                                         kCacheLinePoolLock);
+    mags->compressed = new FreeListMagazine(free_list_, kCacheLinePoolLock);
+  }
+
+ private:
+  static const uintptr_t kIndexSize = CacheLine::kLineSize / 4;
+  static const uintptr_t kHeaderSize =
+      sizeof(uintptr_t) + sizeof(Mask) + 2 * (CacheLine::kLineSize / 8) +
+      sizeof(uint64_t) + sizeof(uintptr_t);
+  static const uintptr_t kUniformSize = kHeaderSize + sizeof(ShadowValue);
+  static const uintptr_t kSize =
+      kHeaderSize + kMaxValues * sizeof(ShadowValue) + kIndexSize;
+
+  // The index follows the kMaxValues values.
+  uint8_t *index() {
+    return reinterpret_cast<uint8_t*>(&values_[kMaxValues]);
+  }
+
+  uintptr_t tag_;
+  Mask has_shadow_value_;
+  uint16_t granularity_[CacheLine::kLineSize / 8];
+  uint64_t generation_;
+  uintptr_t n_values_;
+  // Actually n_values_ (at least one) elements followed by the index.
+  ShadowValue values_[1];
+
+  static FreeList *uniform_free_list_;
+  static FreeList *free_list_;
+};
+
+FreeList *CompressedCacheLine::uniform_free_list_;
+FreeList *CompressedCacheLine::free_list_;
+
+// -------- ShadowSpill --------------- {{{1
+// Optional backing store for cold shadow (--shadow_spill_dir).
+// When we are over --mem_budget_in_mb, compressed lines are copied into
+// fixed-size slots of a memory-mapped file and the storage keeps the slot
+// number instead (see Cache::EvictCompressedLines), so the kernel may write
+// them out instead of keeping them in RAM. Cache::WriteBackAndFetch faults
+// a spilled line back in. The shadow values keep their references while
+// spilled. The file is unlinked right after it is created.
+class ShadowSpill {
+ public:
+  static bool Enabled() { return base_ != NULL; }
+
+  // Returns false if the file is full.
+  static bool Put(CompressedCacheLine *cline, uintptr_t *slot) {
+    {
+      SubsystemTIL til(kShadowSpillLock);
+      if (!free_slots_->empty()) {
+        *slot = free_slots_->back();
+        free_slots_->pop_back();
+      } else if (n_slots_used_ < n_slots_) {
+        *slot = n_slots_used_++;
+      } else {
+        return false;
+      }
+    }
+    memcpy(Get(*slot), cline, cline->MemSize());
+    return true;
+  }
+
+  // The spilled line stays valid until Free(slot).
+  static CompressedCacheLine *Get(uintptr_t slot) {
+    DCHECK(slot < n_slots_used_);
+    return reinterpret_cast<CompressedCacheLine*>(
+        base_ + slot * CompressedCacheLine::MaxMemSize());
+  }
+
+  static void Free(uintptr_t slot) {
+    SubsystemTIL til(kShadowSpillLock);
+    free_slots_->push_back(slot);
+  }
+
+  static void ForgetAllState() {
+    SubsystemTIL til(kShadowSpillLock);
+    free_slots_->clear();
+    n_slots_used_ = 0;
+  }
+
+  static void InitClassMembers() {
+    free_slots_ = new vector<uintptr_t>;
+    if (G_flags->shadow_spill_dir.empty()) return;
+    char buff[100];
+    snprintf(buff, sizeof(buff), "/tsan-spill.%d", getpid());
+    string file_name = G_flags->shadow_spill_dir + buff;
+    size_t size = (size_t)G_flags->shadow_spill_mb << 20;
+    base_ = reinterpret_cast<uint8_t*>(MapTemporaryFile(file_name, size));
+    if (!base_) {
+      Report("WARNING: can not map %s; will not spill shadow memory\n",
+             file_name.c_str());
+      return;
+    }
+    n_slots_ = size / CompressedCacheLine::MaxMemSize();
+  }
+
+ private:
+  static uint8_t *base_;
+  static uintptr_t n_slots_;
+  static uintptr_t n_slots_used_;  // Slots [0, n_slots_used_) were given out.
+  static vector<uintptr_t> *free_slots_;
+};
+
+uint8_t           *ShadowSpill::base_;
+uintptr_t          ShadowSpill::n_slots_;
+uintptr_t          ShadowSpill::n_slots_used_;
+vector<uintptr_t> *ShadowSpill::free_slots_;
+
 // If range [a,b) fits into one line, return that line's tag.
 // Else range [a,b) is broken into these ranges:
 //   [a, line1_tag)
@@ -3285,15 +4777,180 @@ uintptr_t GetCacheLinesForRange(uintptr_t a, uintptr_t b,
 }
 
 
+// -------- CacheLineStorage ------- {{{1
+// Maps tags to CacheLines which are not necessarily in Cache::lines_.
+// Two backends, selected with --radix_shadow_storage:
+//  - a hash map (default);
+//  - a radix tree indexed by the tag bits. Its leaves are arrays of
+//    CacheLine pointers which are allocated on first use and never freed
+//    until Clear(), so a miss never rehashes and a range of addresses
+//    w/o shadow can be skipped a leaf at a time (see SkipEmptyLines()).
+// Tags above kRadixAddressBits (not expected in practice) go to the hash map
+// in either mode.
+// All methods must be called under a lock.
+class CacheLineStorage {
+ public:
+  explicit CacheLineStorage(bool radix)
+      : radix_(radix), size_(0), n_leaves_(0), top_(NULL) {
+    if (radix_) {
+      top_ = new Leaf**[kTopSize];
+      memset(top_, 0, kTopSize * sizeof(Leaf**));
+    }
+  }
+
+  size_t size() const { return size_; }
+  uintptr_t n_leaves() const { return n_leaves_; }
+
+  // Returns the slot for tag, or NULL if there is none and !create.
+  // A created slot is NULL and must be filled by the caller.
+  INLINE CacheLine **Lookup(uintptr_t tag, bool create) {
+    if (radix_ && tag <= kRadixMaxTag) {
+      uintptr_t idx = tag >> CacheLine::kLineSizeBits;
+      Leaf **&mid = top_[idx >> (kMidBits + kLeafBits)];
+      if (mid == NULL) {
+        if (!create) return NULL;
+        mid = new Leaf*[kMidSize];
+        memset(mid, 0, kMidSize * sizeof(Leaf*));
+      }
+      Leaf *&leaf = mid[(idx >> kLeafBits) & (kMidSize - 1)];
+      if (leaf == NULL) {
+        if (!create) return NULL;
+        leaf = new Leaf;
+        memset(leaf, 0, sizeof(Leaf));
+        n_leaves_++;
+      }
+      CacheLine **slot = &leaf->lines[idx & (kLeafSize - 1)];
+      if (*slot == NULL) {
+        if (!create) return NULL;
+        size_++;
+      }
+      return slot;
+    }
+    if (create) {
+      CacheLine **slot = &map_[tag];
+      if (*slot == NULL) size_++;
+      return slot;
+    }
+    Map::iterator it = map_.find(tag);
+    if (it == map_.end()) return NULL;
+    return &it->second;
+  }
+
+  void Erase(uintptr_t tag) {
+    if (radix_ && tag <= kRadixMaxTag) {
+      CacheLine **slot = Lookup(tag, false);
+      CHECK(slot);
+      *slot = NULL;
+    } else {
+      CHECK(map_.erase(tag) == 1);
+    }
+    size_--;
+  }
+
+  // Returns the first tag in [tag, end) which may have a line, or end.
+  // Both tag and end are line-aligned.
+  uintptr_t SkipEmptyLines(uintptr_t tag, uintptr_t end) {
+    if (!radix_) return tag;
+    const uintptr_t kLeafSpan = (uintptr_t)kLeafSize << CacheLine::kLineSizeBits;
+    while (tag < end && tag <= kRadixMaxTag) {
+      uintptr_t idx = tag >> CacheLine::kLineSizeBits;
+      Leaf **mid = top_[idx >> (kMidBits + kLeafBits)];
+      Leaf *leaf = mid ? mid[(idx >> kLeafBits) & (kMidSize - 1)] : NULL;
+      if (leaf == NULL) {
+        // Skip to the next leaf.
+        uintptr_t next = (tag & ~(kLeafSpan - 1)) + kLeafSpan;
+        if (next <= tag) return end;  // Overflow.
+        tag = next;
+        continue;
+      }
+      if (leaf->lines[idx & (kLeafSize - 1)] != NULL)
+        return tag;
+      tag += CacheLine::kLineSize;
+    }
+    return min(tag, end);
+  }
+
+  void GetAllLines(vector<CacheLine*> *res) {
+    res->reserve(size_);
+    for (Map::iterator it = map_.begin(); it != map_.end(); ++it) {
+      res->push_back(it->second);
+    }
+    if (!radix_) return;
+    for (uintptr_t t = 0; t < kTopSize; t++) {
+      if (!top_[t]) continue;
+      for (uintptr_t m = 0; m < kMidSize; m++) {
+        Leaf *leaf = top_[t][m];
+        if (!leaf) continue;
+        for (uintptr_t i = 0; i < kLeafSize; i++) {
+          if (leaf->lines[i])
+            res->push_back(leaf->lines[i]);
+        }
+      }
+    }
+  }
+
+  // Forgets all lines; does not delete them.
+  void Clear() {
+    map_.clear();
+    size_ = 0;
+    if (!radix_) return;
+    for (uintptr_t t = 0; t < kTopSize; t++) {
+      if (!top_[t]) continue;
+      for (uintptr_t m = 0; m < kMidSize; m++) {
+        delete top_[t][m];
+      }
+      delete [] top_[t];
+      top_[t] = NULL;
+    }
+    n_leaves_ = 0;
+  }
+
+ private:
+  static const uintptr_t kRadixAddressBits = sizeof(uintptr_t) == 8 ? 48 : 32;
+  static const uintptr_t kRadixMaxTag =
+      ~(uintptr_t)0 >> (sizeof(uintptr_t) * 8 - kRadixAddressBits);
+  static const uintptr_t kIndexBits =
+      kRadixAddressBits - CacheLine::kLineSizeBits;
+  static const uintptr_t kLeafBits = 14;
+  static const uintptr_t kMidBits = 14;
+  static const uintptr_t kTopBits =
+      kIndexBits > kLeafBits + kMidBits ? kIndexBits - kLeafBits - kMidBits : 0;
+  static const uintptr_t kLeafSize = 1 << kLeafBits;
+  static const uintptr_t kMidSize = 1 << kMidBits;
+  static const uintptr_t kTopSize = 1 << kTopBits;
+
+  struct Leaf {
+    CacheLine *lines[kLeafSize];
+  };
+
+  typedef unordered_map<uintptr_t, CacheLine*> Map;
+
+  bool radix_;
+  size_t size_;
+  uintptr_t n_leaves_;
+  Leaf ***top_;
+  Map map_;
+};
+
 // -------- Cache ------------------ {{{1
+static void ApplyPendingShadowClears(CacheLine *line);
+
 class Cache {
  public:
   Cache() {
     memset(lines_, 0, sizeof(lines_));
     ANNOTATE_BENIGN_RACE_SIZED(lines_, sizeof(lines_),
                                "Cache::lines_ accessed without a lock");
+    n_shards_ = max(G_flags->shadow_shards, (intptr_t)1);
+    shards_ = new Shard[n_shards_];
+    sharded_ = TS_SERIALIZED == 0 && G_flags->shadow_shards > 0 &&
+        G_flags->locking_scheme >= 2;
   }
 
+  // If true, a thread which owns a slot in lines_ may bring a line from the
+  // storage into it w/o ts_lock (see FetchIntoAcquiredSlot).
+  bool sharded() const { return sharded_; }
+
   INLINE static CacheLine *kLineIsLocked() {
     return (CacheLine*)1;
   }
@@ -3378,6 +5035,22 @@ class Cache {
     }
   }
 
+  // The caller owns the slot for tag (TryAcquireLine returned 'old_line',
+  // which is not kLineIsLocked) and does not hold ts_lock.
+  // Writes back the old line and fetches (or creates) the line for tag
+  // under the locks of the affected shards only.
+  CacheLine *FetchIntoAcquiredSlot(TSanThread *thr, uintptr_t tag,
+                                   CacheLine *old_line) {
+    DCHECK(sharded_);
+    DCHECK(old_line != kLineIsLocked());
+    DCHECK(old_line == NULL || old_line->tag() != tag);
+    CacheLine *res = WriteBackAndFetch(thr, old_line, tag,
+                                       ComputeCacheLineIndexInCache(tag),
+                                       /*create_new_if_need=*/true);
+    DCHECK(res);
+    return res;
+  }
+
   void AcquireAllLines(TSanThread *thr) {
     CHECK(TS_SERIALIZED == 0);
     for (size_t i = 0; i < (size_t)kNumLines; i++) {
@@ -3404,7 +5077,7 @@ class Cache {
       // There is no such line in the cache, nor should it be in the storage.
       // Check that the storage indeed does not have this line.
       // Such DCHECK is racey if tsan is multi-threaded.
-      DCHECK(TS_SERIALIZED == 0 || storage_.count(tag) == 0);
+      DCHECK(TS_SERIALIZED == 0 || ShardFor(tag).storage.Lookup(tag, false) == NULL);
       return NULL;
     }
 
@@ -3423,6 +5096,9 @@ class Cache {
         ReleaseLine(thr, a, line, call_site);
       }
     }
+    if (res && UNLIKELY(res->IsStale())) {
+      ApplyPendingShadowClears(res);
+    }
     if (TSAN_DEBUG && debug_cache) {
       if (res)
         Printf("GetLine %p empty=%d tag=%lx\n", res, res->Empty(), res->tag());
@@ -3432,6 +5108,25 @@ class Cache {
     return res;
   }
 
+  // Returns the first tag in [tag, end) which may have a line, or end.
+  // Should be called under a lock.
+  uintptr_t SkipEmptyLines(uintptr_t tag, uintptr_t end) {
+    if (n_shards_ == 1) {
+      ScopedShardLocks locks(this, tag, tag);
+      return shards_[0].storage.SkipEmptyLines(tag, end);
+    }
+    // Each shard region lives entirely in one shard.
+    while (tag < end) {
+      uintptr_t region_end = (tag | (kShardRegionSize - 1)) + 1;
+      if (region_end == 0 || region_end > end) region_end = end;
+      ScopedShardLocks locks(this, tag, tag);
+      uintptr_t res = ShardFor(tag).storage.SkipEmptyLines(tag, region_end);
+      if (res < region_end) return res;
+      tag = region_end;
+    }
+    return end;
+  }
+
   INLINE CacheLine *GetLineOrCreateNew(TSanThread *thr, uintptr_t a, int call_site) {
     return GetLine(thr, a, true, call_site);
   }
@@ -3442,17 +5137,35 @@ class Cache {
   void ForgetAllState(TSanThread *thr) {
     for (int i = 0; i < kNumLines; i++) {
       if (TS_SERIALIZED == 0) CHECK(LineIsNullOrLocked(lines_[i]));
-      lines_[i] = NULL;
     }
     map<uintptr_t, Mask> racey_masks;
-    for (Map::iterator i = storage_.begin(); i != storage_.end(); ++i) {
-      CacheLine *line = i->second;
+    vector<CacheLine*> all_lines;
+    GetAllLines(&all_lines);
+    for (size_t i = 0; i < all_lines.size(); i++) {
+      CacheLine *line = all_lines[i];
+      if (IsCompressed(line)) {
+        // Compressed lines are never racey.
+        CompressedCacheLine::Delete(AsCompressed(line));
+        continue;
+      }
+      if (IsSpilled(line)) continue;  // See ShadowSpill::ForgetAllState().
       if (!line->racey().Empty()) {
         racey_masks[line->tag()] = line->racey();
       }
       CacheLine::Delete(line);
     }
-    storage_.clear();
+    // No one can fetch a line now: all slots in lines_ are ours
+    // until the loop below (see FetchIntoAcquiredSlot).
+    for (size_t i = 0; i < n_shards_; i++) {
+      shards_[i].storage.Clear();
+      shards_[i].n_compressed_lines = 0;
+      shards_[i].compressed_bytes = 0;
+      shards_[i].n_spilled_lines = 0;
+    }
+    ShadowSpill::ForgetAllState();
+    for (int i = 0; i < kNumLines; i++) {
+      lines_[i] = NULL;
+    }
     // Restore the racey masks.
     for (map<uintptr_t, Mask>::iterator it = racey_masks.begin();
          it != racey_masks.end(); it++) {
@@ -3463,21 +5176,113 @@ class Cache {
     }
   }
 
+  // May be racey if sharded().
+  size_t StorageSize() {
+    size_t res = 0;
+    for (size_t i = 0; i < n_shards_; i++)
+      res += shards_[i].storage.size();
+    return res;
+  }
+
+  // Tags of all lines in the storage. Must be called under ts_lock.
+  // Fetching a spilled line brings it back into memory, so skip those
+  // unless they really need to be visited.
+  void GetAllTags(vector<uintptr_t> *res, bool include_spilled) {
+    vector<CacheLine*> all_lines;
+    GetAllLines(&all_lines);
+    res->reserve(res->size() + all_lines.size());
+    for (size_t i = 0; i < all_lines.size(); i++) {
+      CacheLine *line = all_lines[i];
+      if (IsSpilled(line) && !include_spilled) continue;
+      CompressedCacheLine *cline = AsCompressedOrSpilled(line);
+      res->push_back(cline ? cline->tag() : line->tag());
+    }
+  }
+
+  // Spill (see ShadowSpill) or, if we can't, forget compressed (i.e. cold)
+  // lines until at least `bytes` are freed or none are left.
+  // Returns the number of bytes freed; *n_dropped is the number of lines
+  // forgotten. Must be called under ts_lock.
+  uintptr_t EvictCompressedLines(uintptr_t bytes, uintptr_t *n_dropped) {
+    AssertTILHeld();
+    vector<uintptr_t> tags;
+    for (size_t i = 0; i < n_shards_; i++) {
+      vector<CacheLine*> all_lines;
+      if (sharded_) shards_[i].lock.Lock();
+      shards_[i].storage.GetAllLines(&all_lines);
+      for (size_t j = 0; j < all_lines.size(); j++) {
+        if (IsCompressed(all_lines[j]))
+          tags.push_back(AsCompressed(all_lines[j])->tag());
+      }
+      if (sharded_) shards_[i].lock.Unlock();
+    }
+    uintptr_t freed = 0;
+    size_t spill_start_time = TimeInMicroSeconds();
+    *n_dropped = 0;
+    for (size_t i = 0; i < tags.size() && freed < bytes; i++) {
+      uintptr_t tag = tags[i];
+      ShadowValue svals[CacheLine::kLineSize];
+      uintptr_t n_svals = 0;
+      {
+        ScopedShardLocks locks(this, tag, tag);
+        Shard &shard = ShardFor(tag);
+        CacheLine **slot = shard.storage.Lookup(tag, false);
+        // The line could have been inflated since we collected the tags.
+        if (!slot || !*slot || !IsCompressed(*slot)) continue;
+        CompressedCacheLine *cline = AsCompressed(*slot);
+        shard.n_compressed_lines--;
+        shard.compressed_bytes -= cline->MemSize();
+        freed += cline->MemSize();
+        uintptr_t spill_slot;
+        if (ShadowSpill::Enabled() && ShadowSpill::Put(cline, &spill_slot)) {
+          *slot = reinterpret_cast<CacheLine*>((spill_slot << 2) |
+                                               kSpilledBit);
+          shard.n_spilled_lines++;
+          CompressedCacheLine::Delete(cline);
+          G_stats->spill_lines++;
+          continue;
+        }
+        Mask mask(cline->has_shadow_value());
+        while (!mask.Empty()) {
+          uintptr_t off = mask.GetSomeSetBit();
+          mask.Clear(off);
+          svals[n_svals++] = cline->GetValue(off);
+        }
+        G_stats->mem_dropped_line_bytes += cline->MemSize();
+        shard.storage.Erase(tag);
+        CompressedCacheLine::Delete(cline);
+      }
+      // Unref outside of the shard lock: this may recycle SegmentSets.
+      for (uintptr_t j = 0; j < n_svals; j++)
+        svals[j].Unref("Cache::EvictCompressedLines");
+      (*n_dropped)++;
+      G_stats->mem_dropped_lines++;
+    }
+    if (ShadowSpill::Enabled())
+      G_stats->spill_time_us += TimeInMicroSeconds() - spill_start_time;
+    return freed;
+  }
+
   void PrintStorageStats() {
     if (!G_flags->show_stats) return;
     set<ShadowValue> all_svals;
     map<size_t, int> sizes;
-    for (Map::iterator it = storage_.begin(); it != storage_.end(); ++it) {
-      CacheLine *line = it->second;
+    vector<CacheLine*> all_lines;
+    GetAllLines(&all_lines);
+    for (size_t i = 0; i < all_lines.size(); i++) {
+      CacheLine *line = all_lines[i];
       // uintptr_t cli = ComputeCacheLineIndexInCache(line->tag());
       //if (lines_[cli] == line) {
         // this line is in cache -- ignore it.
       //  continue;
       //}
       set<ShadowValue> s;
+      CompressedCacheLine *cline = AsCompressedOrSpilled(line);
       for (uintptr_t i = 0; i < CacheLine::kLineSize; i++) {
-        if (line->has_shadow_value().Get(i)) {
-          ShadowValue sval = *(line->GetValuePointer(i));
+        if (cline ? cline->has_shadow_value().Get(i)
+                  : line->has_shadow_value().Get(i)) {
+          ShadowValue sval = cline ? cline->GetValue(i)
+                                   : *(line->GetValuePointer(i));
           s.insert(sval);
           all_svals.insert(sval);
         }
@@ -3486,7 +5291,38 @@ class Cache {
       if (size > 10) size = 10;
       sizes[size]++;
     }
-    Printf("Storage sizes: %ld\n", storage_.size());
+    uintptr_t storage_size = StorageSize();
+    uintptr_t n_leaves = 0, n_compressed_lines = 0, compressed_bytes = 0;
+    uintptr_t n_spilled_lines = 0;
+    for (size_t i = 0; i < n_shards_; i++) {
+      n_leaves += shards_[i].storage.n_leaves();
+      n_compressed_lines += shards_[i].n_compressed_lines;
+      compressed_bytes += shards_[i].compressed_bytes;
+      n_spilled_lines += shards_[i].n_spilled_lines;
+    }
+    Printf("Storage sizes: %ld\n", storage_size);
+    if (n_shards_ > 1) {
+      Printf("Storage shards: %ld\n", n_shards_);
+    }
+    if (G_flags->radix_shadow_storage) {
+      Printf("Storage radix leaves: %ld\n", n_leaves);
+    }
+    if (ShadowSpill::Enabled()) {
+      Printf("Storage spilled lines: %ld\n", n_spilled_lines);
+    }
+    if (G_flags->compress_cache_lines) {
+      uintptr_t n_plain = storage_size - n_compressed_lines - n_spilled_lines;
+      uintptr_t plain_bytes = n_plain * sizeof(CacheLine);
+      uintptr_t uncompressed_bytes = storage_size * sizeof(CacheLine);
+      Printf("Storage compressed lines: %ld (%ldK instead of %ldK); "
+             "shadow: %ldK instead of %ldK, ratio %.2f\n",
+             n_compressed_lines, compressed_bytes >> 10,
+             (n_compressed_lines * sizeof(CacheLine)) >> 10,
+             (plain_bytes + compressed_bytes) >> 10,
+             uncompressed_bytes >> 10,
+             (double)uncompressed_bytes /
+                 (double)max(plain_bytes + compressed_bytes, (uintptr_t)1));
+    }
     for (size_t size = 0; size <= CacheLine::kLineSize; size++) {
       if (sizes[size]) {
         Printf("  %ld => %d\n", size, sizes[size]);
@@ -3520,6 +5356,65 @@ class Cache {
   }
 
  private:
+  // The storage is split into shards by kShardRegionSize-aligned address
+  // regions (consecutive regions go to different shards), so that the
+  // radix leaves stay dense and a thread which owns a slot in lines_ needs
+  // only the lock of one or two shards to swap lines (--shadow_shards).
+  // Lock order: ts_lock, then shard locks in index order, then
+  // kCacheLinePoolLock.
+  static const uintptr_t kShardRegionSize = 1 << 20;
+  struct Shard {
+    Shard() : storage(G_flags->radix_shadow_storage),
+              n_compressed_lines(0), compressed_bytes(0),
+              n_spilled_lines(0) { }
+    CacheLineStorage storage;
+    TSLock lock;
+    uintptr_t n_compressed_lines;
+    uintptr_t compressed_bytes;
+    uintptr_t n_spilled_lines;
+    char padding[64];  // The locks are hot, avoid false sharing.
+  };
+
+  INLINE size_t ShardIndex(uintptr_t tag) {
+    return (tag / kShardRegionSize) & (n_shards_ - 1);
+  }
+  INLINE Shard &ShardFor(uintptr_t tag) { return shards_[ShardIndex(tag)]; }
+
+  // Holds the locks of the shards of tag1 and tag2 if sharded().
+  class ScopedShardLocks {
+   public:
+    ScopedShardLocks(Cache *cache, uintptr_t tag1, uintptr_t tag2)
+        : lock1_(NULL), lock2_(NULL) {
+      if (!cache->sharded_) return;
+      size_t i1 = cache->ShardIndex(tag1), i2 = cache->ShardIndex(tag2);
+      if (i1 > i2) {
+        size_t tmp = i1;
+        i1 = i2;
+        i2 = tmp;
+      }
+      lock1_ = &cache->shards_[i1].lock;
+      lock1_->Lock();
+      if (i2 != i1) {
+        lock2_ = &cache->shards_[i2].lock;
+        lock2_->Lock();
+      }
+    }
+    ~ScopedShardLocks() {
+      if (lock2_) lock2_->Unlock();
+      if (lock1_) lock1_->Unlock();
+    }
+   private:
+    TSLock *lock1_, *lock2_;
+  };
+
+  void GetAllLines(vector<CacheLine*> *res) {
+    for (size_t i = 0; i < n_shards_; i++) {
+      if (sharded_) shards_[i].lock.Lock();
+      shards_[i].storage.GetAllLines(res);
+      if (sharded_) shards_[i].lock.Unlock();
+    }
+  }
+
   INLINE uintptr_t ComputeCacheLineIndexInCache(uintptr_t addr) {
     return (addr >> CacheLine::kLineSizeBits) & (kNumLines - 1);
   }
@@ -3529,33 +5424,56 @@ class Cache {
                                         bool create_new_if_need) {
     ScopedMallocCostCenter cc("Cache::WriteBackAndFetch");
     CacheLine *res;
-    size_t old_storage_size = storage_.size();
+    LineMagazines *mags = line_magazines(thr);
+    ScopedShardLocks locks(this, tag, old_line ? old_line->tag() : tag);
+    Shard &shard = ShardFor(tag);
+    size_t old_storage_size = shard.storage.size();
     (void)old_storage_size;
-    CacheLine **line_for_this_tag = NULL;
-    if (create_new_if_need) {
-      line_for_this_tag = &storage_[tag];
-    } else {
-      Map::iterator it = storage_.find(tag);
-      if (it == storage_.end()) {
-        if (TSAN_DEBUG && debug_cache) {
-          Printf("WriteBackAndFetch: old_line=%ld tag=%lx cli=%ld\n",
-                 old_line, tag, cli);
-        }
-        return NULL;
+    CacheLine **line_for_this_tag =
+        shard.storage.Lookup(tag, create_new_if_need);
+    if (line_for_this_tag == NULL) {
+      if (TSAN_DEBUG && debug_cache) {
+        Printf("WriteBackAndFetch: old_line=%ld tag=%lx cli=%ld\n",
+               old_line, tag, cli);
       }
-      line_for_this_tag = &(it->second);
+      return NULL;
     }
-    CHECK(line_for_this_tag);
     DCHECK(old_line != kLineIsLocked());
     if (*line_for_this_tag == NULL) {
       // creating a new cache line
-      CHECK(storage_.size() == old_storage_size + 1);
-      res = CacheLine::CreateNewCacheLine(tag);
+      CHECK(shard.storage.size() == old_storage_size + 1);
+      res = CacheLine::CreateNewCacheLine(tag, mags ? mags->line : NULL);
       if (TSAN_DEBUG && debug_cache) {
         Printf("%s %d new line %p cli=%lx\n", __FUNCTION__, __LINE__, res, cli);
       }
       *line_for_this_tag = res;
       G_stats->cache_new_line++;
+    } else if (IsCompressed(*line_for_this_tag)) {
+      // taking a compressed cache line from storage.
+      CompressedCacheLine *cline = AsCompressed(*line_for_this_tag);
+      res = cline->Inflate(mags);
+      DCHECK(!res->Empty());
+      shard.n_compressed_lines--;
+      shard.compressed_bytes -= cline->MemSize();
+      CompressedCacheLine::Delete(cline, mags);
+      *line_for_this_tag = res;
+      G_stats->cache_fetch++;
+      G_stats->cache_inflate++;
+    } else if (IsSpilled(*line_for_this_tag)) {
+      // faulting a spilled line back in.
+      size_t start_time = TimeInMicroSeconds();
+      uintptr_t spill_slot = SpillSlot(*line_for_this_tag);
+      res = ShadowSpill::Get(spill_slot)->Inflate(mags);
+      DCHECK(!res->Empty());
+      ShadowSpill::Free(spill_slot);
+      shard.n_spilled_lines--;
+      *line_for_this_tag = res;
+      G_stats->cache_fetch++;
+      G_stats->spill_faults++;
+      size_t latency = TimeInMicroSeconds() - start_time;
+      G_stats->spill_fault_time_us += latency;
+      G_stats->spill_fault_max_us = max(G_stats->spill_fault_max_us,
+                                        (uintptr_t)latency);
     } else {
       // taking an existing cache line from storage.
       res = *line_for_this_tag;
@@ -3580,56 +5498,221 @@ class Cache {
                old_line, old_line->Empty());
       }
       if (old_line->Empty()) {
-        storage_.erase(old_line->tag());
-        CacheLine::Delete(old_line);
+        ShardFor(old_line->tag()).storage.Erase(old_line->tag());
+        CacheLine::Delete(old_line, mags ? mags->line : NULL);
         G_stats->cache_delete_empty_line++;
       } else {
         if (debug_cache) {
           DebugOnlyCheckCacheLineWhichWeReplace(old_line, res);
         }
+        if (G_flags->compress_cache_lines)
+          MaybeCompress(old_line, mags);
       }
     }
     DCHECK(res->tag() == tag);
 
-    if (G_stats->cache_max_storage_size < storage_.size()) {
-      G_stats->cache_max_storage_size = storage_.size();
+    size_t storage_size = StorageSize();
+    if (G_stats->cache_max_storage_size < storage_size) {
+      G_stats->cache_max_storage_size = storage_size;
     }
 
     return res;
   }
 
-  void DebugOnlyCheckCacheLineWhichWeReplace(CacheLine *old_line,
-                                             CacheLine *new_line) {
-    static int c = 0;
-    c++;
-    if ((c % 1024) == 1) {
-      set<int64_t> s;
-      for (uintptr_t i = 0; i < CacheLine::kLineSize; i++) {
-        if (old_line->has_shadow_value().Get(i)) {
-          int64_t sval = *reinterpret_cast<int64_t*>(
-                            old_line->GetValuePointer(i));
-          s.insert(sval);
-        }
-      }
-      Printf("\n[%d] Cache Size=%ld %s different values: %ld\n", c,
-             storage_.size(), old_line->has_shadow_value().ToString().c_str(),
-             s.size());
-
-      Printf("new line: %p %p\n", new_line->tag(), new_line->tag()
-             + CacheLine::kLineSize);
-      G_stats->PrintStatsForCache();
+  // Replace a line which has just left lines_ with its compressed version.
+  // Called with the line's shard locked.
+  void MaybeCompress(CacheLine *line, LineMagazines *mags = NULL) {
+    CompressedCacheLine *cline = CompressedCacheLine::Compress(line, mags);
+    if (!cline) return;
+    Shard &shard = ShardFor(line->tag());
+    CacheLine **slot = shard.storage.Lookup(line->tag(), false);
+    CHECK(slot && *slot == line);
+    *slot = reinterpret_cast<CacheLine*>(
+        reinterpret_cast<uintptr_t>(cline) | kCompressedBit);
+    CacheLine::Delete(line, mags ? mags->line : NULL);
+    shard.n_compressed_lines++;
+    shard.compressed_bytes += cline->MemSize();
+    G_stats->cache_compress++;
+  }
+
+  // The storage keeps compressed lines as tagged CacheLine pointers.
+  static const uintptr_t kCompressedBit = 1;
+  static bool IsCompressed(CacheLine *line) {
+    return reinterpret_cast<uintptr_t>(line) & kCompressedBit;
+  }
+  static CompressedCacheLine *AsCompressed(CacheLine *line) {
+    DCHECK(IsCompressed(line));
+    return reinterpret_cast<CompressedCacheLine*>(
+        reinterpret_cast<uintptr_t>(line) & ~kCompressedBit);
+  }
+  // A spilled line is kept as its ShadowSpill slot shifted left by two.
+  static const uintptr_t kSpilledBit = 2;
+  static bool IsSpilled(CacheLine *line) {
+    return reinterpret_cast<uintptr_t>(line) & kSpilledBit;
+  }
+  static uintptr_t SpillSlot(CacheLine *line) {
+    DCHECK(IsSpilled(line));
+    return reinterpret_cast<uintptr_t>(line) >> 2;
+  }
+  // NULL if the line is neither compressed nor spilled.
+  static CompressedCacheLine *AsCompressedOrSpilled(CacheLine *line) {
+    if (IsCompressed(line)) return AsCompressed(line);
+    if (IsSpilled(line)) return ShadowSpill::Get(SpillSlot(line));
+    return NULL;
+  }
+
+  void DebugOnlyCheckCacheLineWhichWeReplace(CacheLine *old_line,
+                                             CacheLine *new_line) {
+    static int c = 0;
+    c++;
+    if ((c % 1024) == 1) {
+      set<int64_t> s;
+      for (uintptr_t i = 0; i < CacheLine::kLineSize; i++) {
+        if (old_line->has_shadow_value().Get(i)) {
+          int64_t sval = *reinterpret_cast<int64_t*>(
+                            old_line->GetValuePointer(i));
+          s.insert(sval);
+        }
+      }
+      Printf("\n[%d] Cache Size=%ld %s different values: %ld\n", c,
+             StorageSize(), old_line->has_shadow_value().ToString().c_str(),
+             s.size());
+
+      Printf("new line: %p %p\n", new_line->tag(), new_line->tag()
+             + CacheLine::kLineSize);
+      G_stats->PrintStatsForCache();
+    }
+  }
+
+  static const int kNumLines = 1 << (TSAN_DEBUG ? 14 : 21);
+  CacheLine *lines_[kNumLines];
+
+  // tag => CacheLine, or a tagged CompressedCacheLine (see IsCompressed).
+  Shard *shards_;
+  size_t n_shards_;
+  bool sharded_;
+};
+
+static  Cache *G_cache;
+
+// -------- OwnedLineCache ------------ {{{1
+// Per-thread L0 cache in front of G_cache: the lines which this thread has
+// acquired with Cache::TryAcquireLine() and has not released yet.
+// While a line is here, its slot in Cache::lines_ stays kLineIsLocked(),
+// so the owner may keep using it w/o any atomic operations.
+//
+// Hand-off protocol: other threads either fail TryAcquireLine() and take
+// the slow path or spin in AcquireLine() under ts_lock. So the owner must
+// give all the lines back (ReleaseAll) before it takes ts_lock or finishes
+// handling the current trace; this bounds the time anyone has to spin.
+class OwnedLineCache {
+ public:
+  OwnedLineCache() : size_(0), next_victim_(0) { }
+
+  bool Empty() const { return size_ == 0; }
+
+  INLINE CacheLine *Lookup(uintptr_t tag) {
+    for (int i = 0; i < size_; i++) {
+      if (lines_[i]->tag() == tag)
+        return lines_[i];
+    }
+    return NULL;
+  }
+
+  // line has been acquired by thr; keep it (and maybe release another one).
+  INLINE void Insert(TSanThread *thr, CacheLine *line) {
+    DCHECK(!Cache::LineIsNullOrLocked(line));
+    if (size_ < kSize) {
+      lines_[size_++] = line;
+      return;
+    }
+    CacheLine *victim = lines_[next_victim_];
+    G_cache->ReleaseLine(thr, victim->tag(), victim, __LINE__);
+    lines_[next_victim_] = line;
+    next_victim_ = (next_victim_ + 1) % kSize;
+  }
+
+  INLINE void ReleaseAll(TSanThread *thr) {
+    for (int i = 0; i < size_; i++) {
+      G_cache->ReleaseLine(thr, lines_[i]->tag(), lines_[i], __LINE__);
+    }
+    size_ = 0;
+    next_victim_ = 0;
+  }
+
+ private:
+  static const int kSize = 4;
+  CacheLine *lines_[kSize];
+  int size_;
+  int next_victim_;
+};
+
+// -------- SegmentAccessFilter ------------ {{{1
+// Per-thread set of the accesses done in the current segment.
+// Within one segment, repeating an access (or reading after a write) of the
+// same address and size cannot change the race verdict, so such mops are
+// dropped before we touch G_cache or the shadow state.
+// Direct-mapped, so a conflict just forgets the older entry.
+//
+// The thread clears the filter whenever its segment changes. Everything
+// that may remove the segment from the shadow memory (ClearMemoryState,
+// Detector::EnforceMemoryBudget, ForgetAllStateAndStartOver) calls
+// InvalidateAll(), which makes every thread clear its filter on the next
+// lookup.
+class SegmentAccessFilter {
+ public:
+  SegmentAccessFilter() : epoch_(1), seen_generation_(generation_) {
+    memset(entries_, 0, sizeof(entries_));
+  }
+
+  void Clear() {
+    if (++epoch_ == 0) {
+      memset(entries_, 0, sizeof(entries_));
+      epoch_ = 1;
+    }
+  }
+
+  // Returns true if this access has already been done in this segment.
+  // Otherwise, remembers it and returns false.
+  INLINE bool TestAndInsert(uintptr_t addr, MopInfo *mop) {
+    if (seen_generation_ != generation_) {
+      seen_generation_ = generation_;
+      Clear();
+    }
+    Entry *e = &entries_[(addr >> 2) % kSize];
+    uint32_t size = mop->size();
+    if (e->epoch == epoch_ && e->addr == addr && e->size == size) {
+      if (e->is_write || !mop->is_write())
+        return true;
+      e->is_write = true;
+      return false;
     }
+    e->addr = addr;
+    e->epoch = epoch_;
+    e->size = size;
+    e->is_write = mop->is_write();
+    return false;
   }
 
-  static const int kNumLines = 1 << (TSAN_DEBUG ? 14 : 21);
-  CacheLine *lines_[kNumLines];
+  // Called under ts_lock; read w/o a lock.
+  static void InvalidateAll() { generation_++; }
 
-  // tag => CacheLine
-  typedef unordered_map<uintptr_t, CacheLine*> Map;
-  Map storage_;
+ private:
+  struct Entry {
+    uintptr_t addr;
+    uint32_t epoch;
+    uint16_t size;
+    uint16_t is_write;
+  };
+  static const size_t kSize = 256;
+  static uint32_t generation_;
+
+  Entry entries_[kSize];
+  uint32_t epoch_;
+  uint32_t seen_generation_;
 };
 
-static  Cache *G_cache;
+uint32_t SegmentAccessFilter::generation_;
 
 // -------- Published range -------------------- {{{1
 struct PublishInfo {
@@ -3873,16 +5956,17 @@ struct LockHistory {
   // and the same amount of unlocks.
   LockHistory(size_t size): size_(size) { }
 
-  // Record a Lock event.
+  // Record a Lock event. Lock events may be handled w/o ts_lock,
+  // so g_lock_era is incremented atomically.
   void OnLock(LID lid) {
-    g_lock_era++;
-    Push(LockHistoryElement(lid, g_lock_era), &locks_);
+    Push(LockHistoryElement(lid, NoBarrier_AtomicIncrement(&g_lock_era)),
+         &locks_);
   }
 
   // Record an Unlock event.
   void OnUnlock(LID lid) {
-    g_lock_era++;
-    Push(LockHistoryElement(lid, g_lock_era), &unlocks_);
+    Push(LockHistoryElement(lid, NoBarrier_AtomicIncrement(&g_lock_era)),
+         &unlocks_);
   }
 
   // Find locks such that:
@@ -4005,14 +6089,23 @@ struct RecentSegmentsCache {
       // If they match the current segment stack, don't create a new segment.
       // This can probably lead to a little bit wrong stack traces in rare
       // occasions but we don't really care that much.
+      // With the event history ring we compare the hashes.
       if (kSizeOfHistoryStackTrace > 0) {
         size_t n = curr_stack->size();
         uintptr_t *emb_trace = Segment::embedded_stack_trace(sid);
-        if(*emb_trace &&  // This stack trace was filled
-           curr_stack->size() >= 3 &&
-           emb_trace[0] == (*curr_stack)[n-1] &&
-           emb_trace[1] == (*curr_stack)[n-2] &&
-           emb_trace[2] == (*curr_stack)[n-3]) {
+        bool same_top;
+        if (Segment::HistoryInRing()) {
+          same_top = emb_trace[0] &&  // The position was filled
+                     n >= 3 &&
+                     emb_trace[1] == TopFramesHash(curr_stack);
+        } else {
+          same_top = *emb_trace &&  // This stack trace was filled
+                     n >= 3 &&
+                     emb_trace[0] == (*curr_stack)[n-1] &&
+                     emb_trace[1] == (*curr_stack)[n-2] &&
+                     emb_trace[2] == (*curr_stack)[n-3];
+        }
+        if (same_top) {
           *needs_refill = false;
           return sid;
         }
@@ -4022,6 +6115,13 @@ struct RecentSegmentsCache {
     return SID();
   }
 
+  // Hash of the three top frames, 0 if the stack is shorter.
+  static uintptr_t TopFramesHash(CallStack *stack) {
+    size_t n = stack->size();
+    if (n < 3) return 0;
+    return ((*stack)[n-1] * 31 + (*stack)[n-2]) * 31 + (*stack)[n-3];
+  }
+
  private:
   void ShortenQueue(size_t flush_to_length) {
     while (queue_.size() > flush_to_length) {
@@ -4235,12 +6335,219 @@ static void HandleAtomicityRegion(AtomicityRegion *atomicity_region) {
   }
 }
 
+// -------- EventHistoryRing ------------------ {{{1
+// History of the call stack of one thread (--keep_history=2).
+// Instead of copying the top of the call stack into every new segment
+// (Segment::embedded_stack_trace), the thread appends its RTN_CALL,
+// RTN_EXIT and SBLOCK_ENTER events to this ring and a segment remembers
+// only the current position. At report time the stack is rebuilt by
+// replaying the ring up to that position.
+//
+// The ring is a fixed array of blocks. Each block starts with a checkpoint
+// (the depth of the call stack and up to kCheckpointFrames top frames),
+// so a block can be replayed without the older ones. The events are varints
+// of (zigzag-encoded delta from the previous pc) << 2 | type:
+//   kCall:   caller pc; followed by a varint with the callee pc,
+//   kPush:   callee pc (a call from an empty stack),
+//   kSetTop: new pc of the top frame,
+//   kExit:   no pc, one byte.
+// Positions are byte offsets from the start of the thread. Once the writer
+// wraps around, the oldest block (and every position in it) is lost.
+class EventHistoryRing {
+ public:
+  explicit EventHistoryRing(CallStack *call_stack)
+    : call_stack_(call_stack),
+      cur_block_((uint64_t)-1) {
+    n_blocks_ = max((size_t)2,
+        (size_t)(G_flags->history_ring_kb << 10) / kBlockSize);
+    buf_ = new uint8_t[n_blocks_ * kBlockSize];
+    MemoryAccounting::Add(kMemHistoryStacks, n_blocks_ * kBlockSize);
+    StartNewBlock();
+  }
+
+  ~EventHistoryRing() {
+    delete [] buf_;
+    MemoryAccounting::Add(kMemHistoryStacks, -(n_blocks_ * kBlockSize));
+  }
+
+  uint64_t Position() const { return cur_block_ * kBlockSize + cur_off_; }
+
+  // Called after the call stack changed.
+  INLINE void Call(uintptr_t caller_pc, uintptr_t callee_pc) {
+    if (!HaveRoom()) return StartNewBlock();
+    PutPc(caller_pc, kCall);
+    PutPc(callee_pc, 0);
+    top_pc_ = callee_pc;
+  }
+
+  INLINE void Push(uintptr_t callee_pc) {
+    if (!HaveRoom()) return StartNewBlock();
+    PutPc(callee_pc, kPush);
+    top_pc_ = callee_pc;
+  }
+
+  INLINE void Exit() {
+    if (!HaveRoom()) return StartNewBlock();
+    cur_[cur_off_++] = kExit;
+    top_pc_ = 0;  // Unknown, the next SetTop() will write it.
+  }
+
+  INLINE void SetTop(uintptr_t pc) {
+    if (pc == top_pc_) return;
+    if (!HaveRoom()) return StartNewBlock();
+    PutPc(pc, kSetTop);
+    top_pc_ = pc;
+  }
+
+  // Rebuild the call stack as of 'pos' and put up to 'n' top frames into
+  // 'pcs', top first, 0-terminated if shorter than 'n'.
+  // 'pos' may be Position() truncated to uintptr_t.
+  // Returns false if the position has already been overwritten.
+  bool Replay(uintptr_t pos, uintptr_t *pcs, size_t n) const {
+    // Restore the high bits on 32-bit hosts.
+    uint64_t full_pos = Position() - (uintptr_t)(Position() - pos);
+    uint64_t blk = full_pos / kBlockSize;
+    if (!IsLive(blk)) return false;
+    const uint8_t *p = buf_ + (blk % n_blocks_) * kBlockSize;
+    const uint8_t *end = p + full_pos % kBlockSize;
+    const uint8_t *limit = p + kBlockSize;
+
+    uintptr_t last_pc = 0;
+    size_t depth = GetVarint(&p, limit);
+    size_t n_frames = min((size_t)GetVarint(&p, limit),
+                          (size_t)kCheckpointFrames);
+    vector<uintptr_t> stack;
+    for (size_t i = 0; i < n_frames; i++)
+      stack.push_back(GetPc(&p, limit, &last_pc));
+    // Frames below the checkpoint which we don't know.
+    size_t n_unknown = depth > n_frames ? depth - n_frames : 0;
+
+    while (p < end) {
+      uint64_t v = GetVarint(&p, limit);
+      int type = v & 3;
+      if (type == kExit) {
+        if (!stack.empty())
+          stack.pop_back();
+        else if (n_unknown)
+          n_unknown--;
+        continue;
+      }
+      uintptr_t pc = last_pc + UnZigZag(v >> 2);
+      last_pc = pc;
+      if (type == kCall || type == kSetTop) {
+        if (stack.empty() && n_unknown) {
+          n_unknown--;
+          stack.push_back(pc);
+        } else if (!stack.empty()) {
+          stack.back() = pc;
+        }
+      }
+      if (type == kCall)
+        pc = GetPc(&p, limit, &last_pc);
+      if ((type == kCall || type == kPush) && stack.size() < kMaxCallStackSize)
+        stack.push_back(pc);
+    }
+    // The owner thread may have overwritten the block while we were reading.
+    if (!IsLive(blk)) return false;
+
+    size_t i = 0;
+    for (; i < n && i < stack.size(); i++)
+      pcs[i] = stack[stack.size() - 1 - i];
+    if (i < n)
+      pcs[i] = 0;
+    return true;
+  }
+
+ private:
+  enum { kCall = 0, kPush = 1, kSetTop = 2, kExit = 3 };
+  enum { kBlockSize = TSAN_DEBUG ? 1024 : 4096 };
+  // Two 64-bit varints.
+  enum { kMaxEventSize = 20 };
+  // The checkpoint (at most 2 + kCheckpointFrames varints) and one event
+  // always fit into a block.
+  enum { kCheckpointFrames = 64 };
+
+  bool HaveRoom() const { return cur_off_ + kMaxEventSize <= kBlockSize; }
+
+  bool IsLive(uint64_t blk) const {
+    uint64_t cur = cur_block_;
+    return blk <= cur && cur < blk + n_blocks_;
+  }
+
+  void NOINLINE StartNewBlock() {
+    cur_block_++;
+    cur_ = buf_ + (cur_block_ % n_blocks_) * kBlockSize;
+    cur_off_ = 0;
+    last_pc_ = 0;
+    size_t depth = call_stack_->size();
+    size_t n_frames = min(depth, (size_t)kCheckpointFrames);
+    PutVarint(depth);
+    PutVarint(n_frames);
+    for (size_t i = depth - n_frames; i < depth; i++)
+      PutPc((*call_stack_)[i], 0);
+    top_pc_ = depth ? call_stack_->back() : 0;
+    G_stats->history_ring_blocks++;
+  }
+
+  static uint64_t ZigZag(uintptr_t pc, uintptr_t prev) {
+    int64_t d = (intptr_t)(pc - prev);
+    return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+  }
+
+  static uintptr_t UnZigZag(uint64_t v) {
+    return (uintptr_t)((v >> 1) ^ -(int64_t)(v & 1));
+  }
+
+  INLINE void PutVarint(uint64_t v) {
+    uint8_t *p = cur_ + cur_off_;
+    while (v >= 0x80) {
+      *p++ = (uint8_t)(v | 0x80);
+      v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    cur_off_ = p - cur_;
+  }
+
+  INLINE void PutPc(uintptr_t pc, int type) {
+    PutVarint(ZigZag(pc, last_pc_) << 2 | type);
+    last_pc_ = pc;
+  }
+
+  static uint64_t GetVarint(const uint8_t **p, const uint8_t *limit) {
+    uint64_t v = 0;
+    for (int shift = 0; *p < limit && shift < 64; shift += 7) {
+      uint8_t b = *(*p)++;
+      v |= (uint64_t)(b & 0x7f) << shift;
+      if (!(b & 0x80)) break;
+    }
+    return v;
+  }
+
+  static uintptr_t GetPc(const uint8_t **p, const uint8_t *limit,
+                         uintptr_t *last_pc) {
+    *last_pc += UnZigZag(GetVarint(p, limit) >> 2);
+    return *last_pc;
+  }
+
+  CallStack *call_stack_;
+  uint8_t *buf_;
+  size_t n_blocks_;
+  // The writer state.
+  uint64_t cur_block_;
+  uint8_t *cur_;
+  size_t cur_off_;
+  uintptr_t last_pc_;
+  // The pc of the top frame as the replay would see it, 0 if unknown.
+  uintptr_t top_pc_;
+};
+
 // -------- TSanThread ------------------ {{{1
 struct TSanThread {
  public:
   ThreadLocalStats stats;
 
-  TSanThread(TID tid, TID parent_tid, VTS *vts, StackTrace *creation_context,
+  TSanThread(TID tid, TID parent_tid, VTS *vts,
+             StackDepot::Id creation_context,
          CallStack *call_stack)
     : is_running_(true),
       tid_(tid),
@@ -4252,6 +6559,7 @@ struct TSanThread {
       fun_r_ignore_(0),
       min_sp_for_ignore_(0),
       n_mops_since_start_(0),
+      own_clk_(0),
       creation_context_(creation_context),
       announced_(false),
       rd_lockset_(0),
@@ -4259,9 +6567,12 @@ struct TSanThread {
       expensive_bits_(0),
       vts_at_exit_(NULL),
       call_stack_(call_stack),
+      history_ring_(Segment::HistoryInRing() ?
+                    new EventHistoryRing(call_stack) : NULL),
       lock_history_(128),
       recent_segments_cache_(G_flags->recent_segments_cache_size),
       inside_atomic_op_(),
+      mem_check_counter_(0),
       rand_state_((unsigned)(tid.raw() + (uintptr_t)vts
                       + (uintptr_t)creation_context
                       + (uintptr_t)call_stack)) {
@@ -4270,11 +6581,8 @@ struct TSanThread {
     ignore_depth_[0] = ignore_depth_[1] = 0;
 
     HandleRtnCall(0, 0, IGNORE_BELOW_RTN_UNKNOWN);
-    ignore_context_[0] = NULL;
-    ignore_context_[1] = NULL;
-    if (tid != TID(0) && parent_tid.valid()) {
-      CHECK(creation_context_);
-    }
+    ignore_context_[0] = 0;
+    ignore_context_[1] = 0;
 
     // Add myself to the array of threads.
     CHECK(tid.raw() < G_flags->max_n_threads);
@@ -4283,6 +6591,8 @@ struct TSanThread {
     all_threads_[tid.raw()] = this;
     dead_sids_.reserve(kMaxNumDeadSids);
     fresh_sids_.reserve(kMaxNumFreshSids);
+    without_ts_lock_ = false;
+    CompressedCacheLine::InitMagazines(&line_magazines_);
     ComputeExpensiveBits();
   }
 
@@ -4338,7 +6648,7 @@ struct TSanThread {
       if (G_flags->announce_threads) {
         Report("INFO: T%d has been created by T%d at this point: {{{\n%s}}}\n",
                tid_.raw(), parent_tid_.raw(),
-               creation_context_->ToString().c_str());
+               StackDepot::ToString(creation_context_).c_str());
         TSanThread * parent = GetIfExists(parent_tid_);
         CHECK(parent);
         parent->Announce();
@@ -4365,10 +6675,15 @@ struct TSanThread {
 
   bool is_running() const { return is_running_; }
 
-  INLINE void ComputeExpensiveBits() {
-    bool has_expensive_flags = G_flags->trace_level > 0 ||
-        G_flags->show_stats > 1                      ||
+  // These flags make us collect more data on every memory access.
+  static bool HasExpensiveFlags() {
+    return G_flags->trace_level > 0 ||
+        G_flags->show_stats > 1     ||
         G_flags->sample_events > 0;
+  }
+
+  INLINE void ComputeExpensiveBits() {
+    bool has_expensive_flags = HasExpensiveFlags();
 
     expensive_bits_ =
         (ignore_depth_[0] != 0) |
@@ -4386,8 +6701,7 @@ struct TSanThread {
     CHECK(ignore_depth_[is_w] >= 0);
     ComputeExpensiveBits();
     if (on && G_flags->save_ignore_context) {
-      StackTrace::Delete(ignore_context_[is_w]);
-      ignore_context_[is_w] = CreateStackTrace(0, 3);
+      ignore_context_[is_w] = CreateStackDepotId(0, 3);
     }
   }
   INLINE void set_ignore_all_accesses(bool on) {
@@ -4395,7 +6709,7 @@ struct TSanThread {
     set_ignore_accesses(true, on);
   }
 
-  StackTrace *GetLastIgnoreContext(bool is_w) {
+  StackDepot::Id GetLastIgnoreContext(bool is_w) {
     return ignore_context_[is_w];
   }
 
@@ -4425,6 +6739,9 @@ struct TSanThread {
     CHECK(vts_at_exit_);
     FlushDeadSids();
     ReleaseFreshSids();
+    // From now on line_magazines() and vts_magazines() return NULL.
+    line_magazines_.FlushAll();
+    vts_magazines_.FlushAll();
     delete call_stack_;
     call_stack_ = NULL;
   }
@@ -4508,15 +6825,15 @@ struct TSanThread {
     if (is_w_lock) {
       // Recursive locks are properly handled because LockSet is in fact a
       // multiset.
-      wr_lockset_ = LockSet::Add(wr_lockset_, lock);
-      rd_lockset_ = LockSet::Add(rd_lockset_, lock);
-      lock->WrLock(tid_, CreateStackTrace());
+      wr_lockset_ = LockSet::Add(wr_lockset_, lock, &ls_cache_);
+      rd_lockset_ = LockSet::Add(rd_lockset_, lock, &ls_cache_);
+      lock->WrLock(tid_, CreateStackDepotId());
     } else {
       if (lock->wr_held()) {
         ReportStackTrace();
       }
-      rd_lockset_ = LockSet::Add(rd_lockset_, lock);
-      lock->RdLock(CreateStackTrace());
+      rd_lockset_ = LockSet::Add(rd_lockset_, lock, &ls_cache_);
+      lock->RdLock(CreateStackDepotId());
     }
 
     if (lock->is_pure_happens_before()) {
@@ -4547,7 +6864,7 @@ struct TSanThread {
       report->tid = tid();
       report->lock_addr = lock_addr;
       report->stack_trace = CreateStackTrace();
-      ThreadSanitizerPrintReport(report);
+      PrintReport(report);
       return;
     }
     bool is_w_lock = lock->wr_held();
@@ -4577,18 +6894,18 @@ struct TSanThread {
       report->tid = tid();
       report->lid = lock->lid();
       report->stack_trace = CreateStackTrace();
-      ThreadSanitizerPrintReport(report);
+      PrintReport(report);
       return;
     }
 
     bool removed = false;
     if (is_w_lock) {
       lock->WrUnlock();
-      removed =  LockSet::Remove(wr_lockset_, lock, &wr_lockset_)
-              && LockSet::Remove(rd_lockset_, lock, &rd_lockset_);
+      removed =  LockSet::Remove(wr_lockset_, lock, &wr_lockset_, &ls_cache_)
+              && LockSet::Remove(rd_lockset_, lock, &rd_lockset_, &ls_cache_);
     } else {
       lock->RdUnlock();
-      removed = LockSet::Remove(rd_lockset_, lock, &rd_lockset_);
+      removed = LockSet::Remove(rd_lockset_, lock, &rd_lockset_, &ls_cache_);
     }
 
     if (!removed) {
@@ -4598,7 +6915,7 @@ struct TSanThread {
       report->tid = tid();
       report->lid = lock->lid();
       report->stack_trace = CreateStackTrace();
-      ThreadSanitizerPrintReport(report);
+      PrintReport(report);
     }
 
     if (G_flags->suggest_happens_before_arcs) {
@@ -4618,6 +6935,7 @@ struct TSanThread {
                        size_t size);
 
   void HandleForgetSignaller(uintptr_t cv) {
+    SubsystemTIL til(kSignallerMapLock);
     SignallerMap::iterator it = signaller_map_->find(cv);
     if (it != signaller_map_->end()) {
       if (debug_happens_before) {
@@ -4640,7 +6958,7 @@ struct TSanThread {
 
   // SIGNAL/WAIT events.
   void HandleWait(uintptr_t cv) {
-
+    SubsystemTIL til(kSignallerMapLock);
     SignallerMap::iterator it = signaller_map_->find(cv);
     if (it != signaller_map_->end()) {
       const VTS *signaller_vts = it->second.vts;
@@ -4659,12 +6977,14 @@ struct TSanThread {
   }
 
   void HandleSignal(uintptr_t cv) {
+    SubsystemTIL til(kSignallerMapLock);
     Signaller *signaller = &(*signaller_map_)[cv];
     if (!signaller->vts) {
       signaller->vts = vts()->Clone();
-    } else {
-      VTS *new_vts = VTS::Join(signaller->vts, vts());
-      VTS::Unref(signaller->vts);
+    } else if (!signaller->vts->IsExclusive() ||
+               !signaller->vts->JoinInPlace(vts())) {
+      VTS *new_vts = VTS::Join(signaller->vts, vts(), vts_magazines());
+      VTS::Unref(signaller->vts, vts_magazines());
       signaller->vts = new_vts;
     }
     NewSegmentForSignal();
@@ -4689,10 +7009,12 @@ struct TSanThread {
       recent_segments_cache_.Clear();
     }
     sid_ = new_sid;
+    access_filter_.Clear();
     Segment::Ref(new_sid, "TSanThread::NewSegmentWithoutUnrefingOld");
+    own_clk_ = new_vts->clk(tid());
 
     if (kSizeOfHistoryStackTrace > 0) {
-      FillEmbeddedStackTrace(Segment::embedded_stack_trace(sid()));
+      FillSegmentHistory();
     }
     if (0)
     Printf("2: %s T%d/S%d old_sid=%d NewSegment: %s\n", call_site,
@@ -4703,7 +7025,7 @@ struct TSanThread {
   void INLINE NewSegment(const char *call_site, VTS *new_vts) {
     SID old_sid = sid();
     NewSegmentWithoutUnrefingOld(call_site, new_vts);
-    Segment::Unref(old_sid, "TSanThread::NewSegment");
+    UnrefSegment(old_sid, "TSanThread::NewSegment");
   }
 
   void NewSegmentForLockingEvent() {
@@ -4755,10 +7077,11 @@ struct TSanThread {
         Segment::Ref(match, "TSanThread::HandleSblockEnter");
         this->AddDeadSid(sid_, "TSanThread::HandleSblockEnter");
         sid_ = match;
+        access_filter_.Clear();
       }
       if (refill_stack) {
         this->stats.history_reuses_segment++;
-        FillEmbeddedStackTrace(Segment::embedded_stack_trace(sid()));
+        FillSegmentHistory();
       } else {
         this->stats.history_uses_same_segment++;
       }
@@ -4771,8 +7094,9 @@ struct TSanThread {
       this->AddDeadSid(sid_, "TSanThread::HandleSblockEnter-1");
       Segment::Ref(fresh_sid, "TSanThread::HandleSblockEnter-1");
       sid_ = fresh_sid;
+      access_filter_.Clear();
       recent_segments_cache_.Push(sid());
-      FillEmbeddedStackTrace(Segment::embedded_stack_trace(sid()));
+      FillSegmentHistory();
       this->stats.history_uses_preallocated_segment++;
     } else {
       if (!allow_slow_path) return false;
@@ -4783,35 +7107,91 @@ struct TSanThread {
     return true;
   }
 
+  // If nothing but this thread refers to the current segment (no shadow
+  // value, segment set, heap block, signaller or recent segments cache)
+  // and the segment is the only owner of its VTS, nobody can observe
+  // the segment any more. Then a signal or wait may update the segment
+  // and its VTS in place instead of allocating new ones.
+  bool CurrentSegmentIsPrivate() {
+    Segment *seg = segment();
+    return seg->ref_count() == 1 && seg->vts()->IsExclusive();
+  }
+
+  void UpdatedCurrentSegmentInPlace() {
+    Segment::RefreshPrivateSid(sid());
+    access_filter_.Clear();
+    if (kSizeOfHistoryStackTrace > 0) {
+      FillSegmentHistory();
+    }
+  }
+
   void NewSegmentForWait(const VTS *signaller_vts) {
-    const VTS *current_vts   = vts();
+    VTS *current_vts   = vts();
     if (0)
     Printf("T%d NewSegmentForWait: \n  %s\n  %s\n", tid().raw(),
            current_vts->ToString().c_str(),
            signaller_vts->ToString().c_str());
     // We don't want to create a happens-before arc if it will be redundant.
-    if (!VTS::HappensBeforeCached(signaller_vts, current_vts)) {
-      VTS *new_vts = VTS::Join(current_vts, signaller_vts);
-      NewSegment("NewSegmentForWait", new_vts);
+    // The HB cache may be used only under ts_lock.
+    bool hb = without_ts_lock_
+        ? VTS::HappensBefore(signaller_vts, current_vts)
+        : VTS::HappensBeforeCached(signaller_vts, current_vts);
+    if (!hb) {
+      recent_segments_cache_.Clear();
+      if (CurrentSegmentIsPrivate() &&
+          current_vts->JoinInPlace(signaller_vts)) {
+        own_clk_ = current_vts->clk(tid());
+        UpdatedCurrentSegmentInPlace();
+      } else {
+        VTS *new_vts = VTS::Join(current_vts, signaller_vts, vts_magazines());
+        NewSegment("NewSegmentForWait", new_vts);
+      }
     }
-    DCHECK(VTS::HappensBeforeCached(signaller_vts, vts()));
+    DCHECK(VTS::HappensBefore(signaller_vts, vts()));
   }
 
   void NewSegmentForSignal() {
     VTS *cur_vts = vts();
-    VTS *new_vts = VTS::CopyAndTick(cur_vts, tid());
+    recent_segments_cache_.Clear();
+    if (CurrentSegmentIsPrivate()) {
+      cur_vts->TickInPlace(tid());
+      own_clk_++;
+      UpdatedCurrentSegmentInPlace();
+      DCHECK(own_clk_ == cur_vts->clk(tid()));
+      return;
+    }
+    VTS *new_vts = VTS::CopyAndTick(cur_vts, tid(), vts_magazines());
     NewSegment("NewSegmentForSignal", new_vts);
   }
 
+  // The clock of this thread in its current VTS.
+  int32_t own_clk() const {
+    DCHECK(own_clk_ == vts()->clk(tid()));
+    return own_clk_;
+  }
+
   // When creating a child thread, we need to know
   // 1. where the thread was created (ctx)
   // 2. What was the vector clock of the parent thread (vts).
 
   struct ThreadCreateInfo {
-    StackTrace *ctx;
-    VTS        *vts;
+    StackDepot::Id ctx;
+    VTS           *vts;
   };
 
+  // True if `vts` happens-before the VTS of every child thread which
+  // this thread has created (THR_CREATE_BEFORE) but which has not
+  // started yet. Such a child will start with that VTS.
+  bool HappensBeforeChildrenToStart(const VTS *vts) const {
+    for (map<TID, ThreadCreateInfo>::const_iterator it =
+             child_tid_to_create_info_.begin();
+         it != child_tid_to_create_info_.end(); ++it) {
+      if (!VTS::HappensBeforeCached(vts, it->second.vts))
+        return false;
+    }
+    return true;
+  }
+
   static void StopIgnoringAccessesInT0BecauseNewThreadStarted() {
     AssertTILHeld();
     if (g_so_far_only_one_thread) {
@@ -4827,9 +7207,9 @@ struct TSanThread {
     StopIgnoringAccessesInT0BecauseNewThreadStarted();
     // Store ctx and vts under TID(0).
     ThreadCreateInfo info;
-    info.ctx = CreateStackTrace(pc);
+    info.ctx = CreateStackDepotId(pc);
     info.vts = vts()->Clone();
-    CHECK(info.ctx && info.vts);
+    CHECK(info.vts);
     child_tid_to_create_info_[TID(0)] = info;
     // Tick vts.
     this->NewSegmentForSignal();
@@ -4854,23 +7234,24 @@ struct TSanThread {
     }
   }
 
-  void HandleChildThreadStart(TID child_tid, VTS **vts, StackTrace **ctx) {
+  void HandleChildThreadStart(TID child_tid, VTS **vts,
+                              StackDepot::Id *ctx) {
     TSanThread *parent = this;
     ThreadCreateInfo info;
     if (child_tid_to_create_info_.count(child_tid)) {
       // We already seen THR_CREATE_AFTER, so the info is under child_tid.
       info = child_tid_to_create_info_[child_tid];
       child_tid_to_create_info_.erase(child_tid);
-      CHECK(info.ctx && info.vts);
+      CHECK(info.vts);
     } else if (child_tid_to_create_info_.count(TID(0))){
       // We have not seen THR_CREATE_AFTER, but already seen THR_CREATE_BEFORE.
       info = child_tid_to_create_info_[TID(0)];
       child_tid_to_create_info_.erase(TID(0));
-      CHECK(info.ctx && info.vts);
+      CHECK(info.vts);
     } else {
       // We have not seen THR_CREATE_BEFORE/THR_CREATE_AFTER.
       // If the tool is single-threaded (valgrind) these events are redundant.
-      info.ctx = parent->CreateStackTrace();
+      info.ctx = parent->CreateStackDepotId();
       info.vts = parent->vts()->Clone();
       parent->NewSegmentForSignal();
     }
@@ -4887,7 +7268,7 @@ struct TSanThread {
              parent->vts()->ToString().c_str(),
              (*vts)->ToString().c_str());
       if (G_flags->announce_threads) {
-        Printf("%s\n", (*ctx)->ToString().c_str());
+        Printf("%s\n", StackDepot::ToString(*ctx).c_str());
       }
     }
 
@@ -4946,6 +7327,7 @@ struct TSanThread {
     if (info.calls_before_reset == 0) {
       // We are blocking the first time after reset. Clear the VTS.
       info.calls_before_reset = info.barrier_count;
+      SubsystemTIL til(kSignallerMapLock);
       Signaller &signaller = (*signaller_map_)[barrier + epoch];
       VTS::Unref(signaller.vts);
       signaller.vts = NULL;
@@ -4979,6 +7361,7 @@ struct TSanThread {
   void PopCallStack() {
     CHECK(!call_stack_->empty());
     call_stack_->pop_back();
+    if (history_ring_) history_ring_->Exit();
   }
 
   void HandleRtnCall(uintptr_t call_pc, uintptr_t target_pc,
@@ -4988,6 +7371,13 @@ struct TSanThread {
       call_stack_->back() = call_pc;
     }
     call_stack_->push_back(target_pc);
+    if (history_ring_) {
+      size_t n = call_stack_->size();
+      if (n >= 2)
+        history_ring_->Call((*call_stack_)[n - 2], target_pc);
+      else
+        history_ring_->Push(target_pc);
+    }
 
     bool ignore = false;
     if (ignore_below == IGNORE_BELOW_RTN_UNKNOWN) {
@@ -5018,6 +7408,7 @@ struct TSanThread {
     this->stats.events[RTN_EXIT]++;
     if (!call_stack_->empty()) {
       call_stack_->pop_back();
+      if (history_ring_) history_ring_->Exit();
       if (fun_r_ignore_) {
         if (--fun_r_ignore_ == 0) {
           set_ignore_all_accesses(false);
@@ -5054,6 +7445,21 @@ struct TSanThread {
     return call_stack_->back();
   }
 
+  // Remember the current call stack as the history of the current segment.
+  INLINE void FillSegmentHistory() {
+    uintptr_t *emb_trace = Segment::embedded_stack_trace(sid());
+    if (!history_ring_) {
+      FillEmbeddedStackTrace(emb_trace);
+      return;
+    }
+    if (!call_stack_->empty())
+      history_ring_->SetTop(call_stack_->back());
+    emb_trace[0] = (uintptr_t)history_ring_->Position() + 1;
+    emb_trace[1] = RecentSegmentsCache::TopFramesHash(call_stack_);
+  }
+
+  EventHistoryRing *history_ring() { return history_ring_; }
+
   INLINE void FillEmbeddedStackTrace(uintptr_t *emb_trace) {
     size_t size = min(call_stack_->size(), (size_t)kSizeOfHistoryStackTrace);
     size_t idx = call_stack_->size() - 1;
@@ -5091,6 +7497,25 @@ struct TSanThread {
     return res;
   }
 
+  // Same as CreateStackTrace(), but the result is interned in StackDepot.
+  StackDepot::Id CreateStackDepotId(uintptr_t pc = 0, int max_len = -1) {
+    if (!call_stack_->empty() && pc) {
+      call_stack_->back() = pc;
+    }
+    if (max_len <= 0) {
+      max_len = G_flags->num_callers;
+    }
+    size_t size = min(call_stack_->size(), (size_t)max_len);
+    if (size == 0) return 0;
+    depot_scratch_.resize(size);
+    size_t idx = call_stack_->size() - 1;
+    uintptr_t *pcs = call_stack_->pcs();
+    for (size_t i = 0; i < size; i++, idx--) {
+      depot_scratch_[i] = pcs[idx];
+    }
+    return StackDepot::Put(&depot_scratch_[0], size);
+  }
+
   void ReportStackTrace(uintptr_t pc = 0, int max_len = -1) {
     StackTrace *trace = CreateStackTrace(pc, max_len);
     Report("%s", trace->ToString().c_str());
@@ -5121,7 +7546,9 @@ struct TSanThread {
       }
       thr->dead_sids_.clear();
       thr->fresh_sids_.clear();
+      thr->ss_cache_.ForgetAllState();
     }
+    SubsystemTIL til(kSignallerMapLock);
     signaller_map_->ClearAndDeleteElements();
   }
 
@@ -5158,6 +7585,8 @@ struct TSanThread {
 
   INLINE void FlushDeadSids() {
     if (TS_SERIALIZED) return;
+    // SegmentSets hold references to segments, so flush them first.
+    SegmentSet::FlushDeadSsids(&ss_cache_);
     size_t n = dead_sids_.size();
     for (size_t i = 0; i < n; i++) {
       SID sid = dead_sids_[i];
@@ -5170,7 +7599,56 @@ struct TSanThread {
 
   INLINE bool HasRoomForDeadSids() const {
     return TS_SERIALIZED ? false :
-        dead_sids_.size() < kMaxNumDeadSids - 2;
+        dead_sids_.size() < kMaxNumDeadSids - 2 &&
+        ss_cache_.HasRoomForDeadSsids();
+  }
+
+  // Set while handling an event w/o ts_lock, see UnlockedHandlerGate.
+  // In this mode the segments are released with AddDeadSid, the HB cache
+  // is not used and the reports are printed later under ts_lock.
+  void set_without_ts_lock(bool x) { without_ts_lock_ = x; }
+
+  void UnrefSegment(SID sid, const char *where) {
+    if (without_ts_lock_) {
+      AddDeadSid(sid, where);
+    } else {
+      Segment::Unref(sid, where);
+    }
+  }
+
+  void PrintReport(ThreadSanitizerReport *report) {
+    if (without_ts_lock_) {
+      deferred_reports_.push_back(report);
+    } else {
+      ThreadSanitizerPrintReport(report);
+    }
+  }
+
+  bool HasDeferredReports() const { return !deferred_reports_.empty(); }
+
+  void PrintDeferredReports() {
+    AssertTILHeld();
+    for (size_t i = 0; i < deferred_reports_.size(); i++) {
+      ThreadSanitizerPrintReport(deferred_reports_[i]);
+    }
+    deferred_reports_.clear();
+  }
+
+  SegmentSet::ThreadCache *ss_cache() { return &ss_cache_; }
+  // Per-thread allocator magazines; NULL after the thread has ended.
+  LineMagazines *line_magazines() {
+    return is_running_ ? &line_magazines_ : NULL;
+  }
+  VTS::Magazines *vts_magazines() {
+    return is_running_ ? &vts_magazines_ : NULL;
+  }
+  LockSet::ThreadCache *ls_cache() { return &ls_cache_; }
+  OwnedLineCache *owned_lines() { return &owned_lines_; }
+  SegmentAccessFilter *access_filter() { return &access_filter_; }
+
+  // True once in kMemCheckPeriod calls; see Detector::CheckMemoryBudget.
+  bool TimeToCheckMemory() {
+    return (++mem_check_counter_ % kMemCheckPeriod) == 0;
   }
 
   void GetSomeFreshSids() {
@@ -5207,7 +7685,8 @@ struct TSanThread {
   uintptr_t  fun_r_ignore_;  // > 0 if we are inside a fun_r-ed function.
   uintptr_t  min_sp_for_ignore_;
   uintptr_t  n_mops_since_start_;
-  StackTrace *creation_context_;
+  int32_t    own_clk_;  // See own_clk().
+  StackDepot::Id creation_context_;
   bool      announced_;
 
   LSID   rd_lockset_;
@@ -5220,15 +7699,32 @@ struct TSanThread {
   // bit 3 -- have expensive flags
   int expensive_bits_;
   int ignore_depth_[2];
-  StackTrace *ignore_context_[2];
+  StackDepot::Id ignore_context_[2];
+  // Scratch space for CreateStackDepotId().
+  vector<uintptr_t> depot_scratch_;
 
   VTS *vts_at_exit_;
 
   CallStack *call_stack_;
+  // NULL unless --keep_history=2. Kept after the thread ends: the segments
+  // of a finished thread may still appear in reports.
+  EventHistoryRing *history_ring_;
 
   vector<SID> dead_sids_;
   vector<SID> fresh_sids_;
 
+  // True while an event is handled w/o ts_lock (see UnlockedHandlerGate).
+  bool without_ts_lock_;
+  // Reports found while without_ts_lock_ is set.
+  vector<ThreadSanitizerReport*> deferred_reports_;
+
+  SegmentSet::ThreadCache ss_cache_;
+  LockSet::ThreadCache ls_cache_;
+  OwnedLineCache owned_lines_;
+  SegmentAccessFilter access_filter_;
+  LineMagazines line_magazines_;
+  VTS::Magazines vts_magazines_;
+
   PtrToBoolCache<251> ignore_below_cache_;
 
   LockHistory lock_history_;
@@ -5243,6 +7739,9 @@ struct TSanThread {
   // however plain memory accesses can race with atomic memory accesses.
   int inside_atomic_op_;
 
+  static const uint32_t kMemCheckPeriod = 1024;
+  uint32_t mem_check_counter_;
+
   prng_t rand_state_;
 
   struct Signaller {
@@ -5272,6 +7771,10 @@ INLINE static int32_t raw_tid(TSanThread *t) {
   return t->tid().raw();
 }
 
+INLINE static LineMagazines *line_magazines(TSanThread *t) {
+  return t ? t->line_magazines() : NULL;
+}
+
 // TSanThread:: static members
 TSanThread                    **TSanThread::all_threads_;
 int                         TSanThread::n_threads_;
@@ -5279,6 +7782,22 @@ TSanThread::SignallerMap       *TSanThread::signaller_map_;
 TSanThread::CyclicBarrierMap   *TSanThread::cyclic_barrier_map_;
 
 
+// Rebuild the history stack of 'sid' from the ring of its thread.
+static bool ReplayEventHistory(SID sid, uintptr_t *pcs) {
+  uintptr_t pos = Segment::embedded_stack_trace(sid)[0];
+  if (pos == 0) {
+    pcs[0] = 0;
+    return true;
+  }
+  TSanThread *thr = TSanThread::Get(Segment::Get(sid)->tid());
+  G_stats->history_ring_replays++;
+  if (!thr->history_ring()->Replay(pos - 1, pcs, kSizeOfHistoryStackTrace)) {
+    G_stats->history_ring_lost++;
+    return false;
+  }
+  return true;
+}
+
 // -------- TsanAtomicCore ------------------ {{{1
 
 // Responsible for handling of atomic memory accesses.
@@ -5363,30 +7882,155 @@ static void INLINE UnrefSegmentsInMemoryRange(uintptr_t a, uintptr_t b,
   }
 }
 
+static void ClearRangeInLine(CacheLine *line, uintptr_t beg, uintptr_t end) {
+  DCHECK(beg < CacheLine::kLineSize);
+  DCHECK(end <= CacheLine::kLineSize);
+  DCHECK(beg < end);
+  Mask published = line->published();
+  if (UNLIKELY(!published.Empty())) {
+    Mask mask(published.GetRange(beg, end));
+    ClearPublishedAttribute(line, mask);
+  }
+  Mask old_used = line->ClearRangeAndReturnOldUsed(beg, end);
+  UnrefSegmentsInMemoryRange(beg, end, old_used, line);
+}
+
 void INLINE ClearMemoryStateInOneLine(TSanThread *thr, uintptr_t addr,
                                       uintptr_t beg, uintptr_t end) {
   AssertTILHeld();
   CacheLine *line = G_cache->GetLineIfExists(thr, addr, __LINE__);
   // CacheLine *line = G_cache->GetLineOrCreateNew(addr, __LINE__);
   if (line) {
-    DCHECK(beg < CacheLine::kLineSize);
-    DCHECK(end <= CacheLine::kLineSize);
-    DCHECK(beg < end);
-    Mask published = line->published();
-    if (UNLIKELY(!published.Empty())) {
-      Mask mask(published.GetRange(beg, end));
-      ClearPublishedAttribute(line, mask);
-    }
-    Mask old_used = line->ClearRangeAndReturnOldUsed(beg, end);
-    UnrefSegmentsInMemoryRange(beg, end, old_used, line);
+    ClearRangeInLine(line, beg, end);
     G_cache->ReleaseLine(thr, addr, line, __LINE__);
   }
 }
 
-// clear memory state for [a,b)
-void NOINLINE ClearMemoryState(TSanThread *thr, uintptr_t a, uintptr_t b) {
-  if (a == b) return;
-  CHECK(a < b);
+// -------- LazyShadowClear ------------------ {{{1
+// Clearing the state of a large range (free() of a big buffer, munmap(),
+// a stack of a finished thread) used to walk every line of the range
+// under ts_lock. Instead, ranges of at least --lazy_clear_min_lines lines
+// are recorded here with a new generation (see ShadowGeneration), and each
+// line is cleared when it is fetched next time (Cache::GetLine), or when
+// it is about to be used on the unlocked fast path (which then falls back
+// to the slow path).
+// Lines which are not touched again keep their stale shadow values (and
+// references to segment sets) until --lazy_clear_max_pending ranges
+// are recorded; then Flush() brings all such lines up to date at once.
+// All methods must be called under ts_lock.
+class LazyShadowClear {
+ public:
+  static bool ShouldDefer(uintptr_t a, uintptr_t b) {
+    return G_flags->lazy_clear_min_lines > 0 &&
+        (b - a) >= (uintptr_t)G_flags->lazy_clear_min_lines *
+                   CacheLine::kLineSize;
+  }
+
+  static void Record(TSanThread *thr, uintptr_t a, uintptr_t b) {
+    AssertTILHeld();
+    DCHECK(a < b);
+    if (pending_->size() >= (size_t)G_flags->lazy_clear_max_pending)
+      Flush(thr);
+    PendingClear clear;
+    clear.a = a;
+    clear.b = b;
+    clear.generation = ShadowGeneration::BumpForRange(a, b);
+    pending_->push_back(clear);
+    pending_lines_ += (b - a) / CacheLine::kLineSize + 1;
+    G_stats->lazy_clear_ranges++;
+  }
+
+  // Clear the parts of the line recorded after the line's generation.
+  static void Apply(CacheLine *line) {
+    uint64_t generation = line->generation();
+    uintptr_t tag = line->tag();
+    uintptr_t next_tag = tag + CacheLine::kLineSize;
+    // pending_ is sorted by generation; find the first newer range.
+    size_t lo = 0, hi = pending_->size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if ((*pending_)[mid].generation <= generation)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    // Go from the newest range: once the whole line is cleared,
+    // the older ranges have nothing to add.
+    bool cleared = false;
+    for (size_t i = pending_->size(); i > lo; i--) {
+      const PendingClear &clear = (*pending_)[i - 1];
+      if (clear.b <= tag || clear.a >= next_tag) continue;
+      uintptr_t beg = max(clear.a, tag) - tag;
+      uintptr_t end = min(clear.b, next_tag) - tag;
+      ClearRangeInLine(line, beg, end);
+      cleared = true;
+      if (beg == 0 && end == CacheLine::kLineSize) break;
+    }
+    if (cleared)
+      G_stats->lazy_clear_lines++;
+    line->set_generation(ShadowGeneration::current());
+  }
+
+  // Apply all pending ranges and forget them.
+  static void Flush(TSanThread *thr) {
+    AssertTILHeld();
+    size_t start_time = TimeInMilliSeconds();
+    if (pending_lines_ > G_cache->StorageSize()) {
+      // Cheaper to visit every line we have.
+      vector<uintptr_t> tags;
+      G_cache->GetAllTags(&tags, true);
+      for (size_t i = 0; i < tags.size(); i++)
+        FetchLine(thr, tags[i]);
+    } else {
+      for (size_t i = 0; i < pending_->size(); i++) {
+        uintptr_t a = CacheLine::ComputeTag((*pending_)[i].a);
+        uintptr_t b = (*pending_)[i].b;
+        for (uintptr_t tag = G_cache->SkipEmptyLines(a, b); tag < b;
+             tag = G_cache->SkipEmptyLines(tag + CacheLine::kLineSize, b))
+          FetchLine(thr, tag);
+      }
+    }
+    pending_->clear();
+    pending_lines_ = 0;
+    G_stats->lazy_clear_flushes++;
+    G_stats->lazy_clear_flush_ms += TimeInMilliSeconds() - start_time;
+  }
+
+  static void ForgetAllState() {
+    pending_->clear();
+    pending_lines_ = 0;
+  }
+
+  static void InitClassMembers() {
+    pending_ = new vector<PendingClear>;
+  }
+
+ private:
+  struct PendingClear {
+    uintptr_t a, b;
+    uint64_t generation;
+  };
+
+  // Fetching a line brings it up to date (see Cache::GetLine).
+  static void FetchLine(TSanThread *thr, uintptr_t tag) {
+    CacheLine *line = G_cache->GetLineIfExists(thr, tag, __LINE__);
+    if (line)
+      G_cache->ReleaseLine(thr, tag, line, __LINE__);
+  }
+
+  static vector<PendingClear> *pending_;
+  static uintptr_t pending_lines_;
+};
+
+vector<LazyShadowClear::PendingClear> *LazyShadowClear::pending_;
+uintptr_t LazyShadowClear::pending_lines_;
+
+static void ApplyPendingShadowClears(CacheLine *line) {
+  LazyShadowClear::Apply(line);
+}
+
+static void ClearMemoryStateEagerly(TSanThread *thr,
+                                    uintptr_t a, uintptr_t b) {
   uintptr_t line1_tag = 0, line2_tag = 0;
   uintptr_t single_line_tag = GetCacheLinesForRange(a, b,
                                                     &line1_tag, &line2_tag);
@@ -5399,14 +8043,28 @@ void NOINLINE ClearMemoryState(TSanThread *thr, uintptr_t a, uintptr_t b) {
   uintptr_t a_tag = CacheLine::ComputeTag(a);
   ClearMemoryStateInOneLine(thr, a, a - a_tag, CacheLine::kLineSize);
 
-  for (uintptr_t tag_i = line1_tag; tag_i < line2_tag;
-       tag_i += CacheLine::kLineSize) {
+  for (uintptr_t tag_i = G_cache->SkipEmptyLines(line1_tag, line2_tag);
+       tag_i < line2_tag;
+       tag_i = G_cache->SkipEmptyLines(tag_i + CacheLine::kLineSize,
+                                       line2_tag)) {
     ClearMemoryStateInOneLine(thr, tag_i, 0, CacheLine::kLineSize);
   }
 
   if (b > line2_tag) {
     ClearMemoryStateInOneLine(thr, line2_tag, 0, b - line2_tag);
   }
+}
+
+// clear memory state for [a,b)
+void NOINLINE ClearMemoryState(TSanThread *thr, uintptr_t a, uintptr_t b) {
+  if (a == b) return;
+  CHECK(a < b);
+  SegmentAccessFilter::InvalidateAll();
+  if (LazyShadowClear::ShouldDefer(a, b)) {
+    LazyShadowClear::Record(thr, a, b);
+  } else {
+    ClearMemoryStateEagerly(thr, a, b);
+  }
 
   if (TSAN_DEBUG && G_flags->debug_level >= 2) {
     // Check that we've cleared it. Slow!
@@ -5456,6 +8114,200 @@ struct ThreadStackInfo {
 
 static HeapMap<ThreadStackInfo> *G_thread_stack_map;
 
+// -------- Incremental GC -------- {{{1
+// Instead of waiting until we run out of SIDs and forgetting everything,
+// walk the shadow memory in small slices (under ts_lock) and drop
+// the segments which happen-before the current segment of every running
+// thread and the VTS of every child thread which is created but not
+// started yet. Every thread with a parent will happen-after such a segment,
+// so it can not take part in a race any more: the state machine would
+// remove it from the segment set on the next access anyway.
+// Once nothing refers to a segment, its SID (and the SSIDs which contained
+// it) is recycled, so the number of SIDs in use stops growing.
+// Deadness is monotonic, but SIDs may be recycled between slices, so the
+// verdicts are cached only within one slice.
+// A thread created w/o a parent (see HandleThreadStart) does not
+// happen-after anything, so nothing is dead for it. Hence the GC is off
+// by default, and it is turned off for good once such a thread starts.
+class ShadowGC {
+ public:
+  static bool Enabled() { return G_flags->gc_lines_per_slice > 0; }
+
+  // Called when a thread w/o a parent starts. Must be called under ts_lock.
+  static void HandleThreadWithoutParent(TID tid) {
+    if (!Enabled()) return;
+    Report("INFO: T%d has no parent; turning off the shadow memory GC\n",
+           tid.raw());
+    G_flags->gc_lines_per_slice = 0;
+  }
+
+  // Run a slice if the number of SIDs has grown since the previous one.
+  // Must be called under ts_lock.
+  static void MaybeRunSlice(TSanThread *thr) {
+    int32_t n_segments = Segment::NumberOfSegments();
+    if (n_segments <= kMaxSIDBeforeFlush / 2 ||
+        n_segments == n_segments_at_last_slice_)
+      return;
+    n_segments_at_last_slice_ = n_segments;
+    RunSlice(thr, G_flags->gc_lines_per_slice);
+  }
+
+  // Called instead of flushing when we are out of SIDs.
+  // Returns true if the GC has freed enough SIDs to go on w/o a flush.
+  // Must be called under ts_lock.
+  static bool AvoidFlush(TSanThread *thr) {
+    MaybeRunSlice(thr);
+    int32_t n_segments = Segment::NumberOfSegments();
+    if (n_segments <= kMaxSIDBeforeFlush)
+      return true;
+    // The SIDs freed by the GC are reused before n_segments_ grows,
+    // so there is nothing new to collect until it grows again.
+    if (n_segments == n_segments_at_last_full_cycle_)
+      return true;
+    n_segments_at_last_full_cycle_ = n_segments;
+    RunFullCycle(thr);
+    if (Segment::NumberOfSegmentsInUse() > (kMaxSIDBeforeFlush * 7) / 8)
+      return false;
+    G_stats->gc_avoided_flushes++;
+    return true;
+  }
+
+  // Finish the current cycle and do one more full cycle.
+  // Returns the number of shadow values changed.
+  static uintptr_t RunFullCycle(TSanThread *thr) {
+    uintptr_t changed = 0;
+    while (pos_ < tags_->size())
+      changed += RunSlice(thr, G_flags->gc_lines_per_slice);
+    do {
+      changed += RunSlice(thr, G_flags->gc_lines_per_slice);
+    } while (pos_ < tags_->size());
+    SegmentSet::FlushDeadSsids(thr->ss_cache());
+    SegmentSet::FlushWholeRecycleQueue();
+    G_stats->gc_full_cycles++;
+    return changed;
+  }
+
+  static void ForgetAllState() {
+    tags_->clear();
+    pos_ = 0;
+    n_segments_at_last_slice_ = 0;
+    n_segments_at_last_full_cycle_ = 0;
+  }
+
+  static void InitClassMembers() {
+    tags_ = new vector<uintptr_t>;
+    dead_cache_ = new unordered_map<int32_t, bool>;
+  }
+
+ private:
+  static uintptr_t RunSlice(TSanThread *thr, uintptr_t n_lines) {
+    AssertTILHeld();
+    size_t start_time = TimeInMilliSeconds();
+    if (pos_ >= tags_->size()) {
+      // Start a new cycle.
+      tags_->clear();
+      // Spilled lines keep their references to dead segments.
+      G_cache->GetAllTags(tags_, false);
+      pos_ = 0;
+    }
+    dead_cache_->clear();
+    uintptr_t changed = 0;
+    size_t end = min(tags_->size(), pos_ + n_lines);
+    G_stats->gc_lines_scanned += end - pos_;
+    for (; pos_ < end; pos_++) {
+      uintptr_t tag = (*tags_)[pos_];
+      CacheLine *line = G_cache->GetLineIfExists(thr, tag, __LINE__);
+      if (!line) continue;
+      changed += CollectInLine(thr, line);
+      G_cache->ReleaseLine(thr, tag, line, __LINE__);
+    }
+    G_stats->gc_slices++;
+    size_t pause = TimeInMilliSeconds() - start_time;
+    G_stats->gc_total_pause_ms += pause;
+    G_stats->gc_max_pause_ms = max(G_stats->gc_max_pause_ms, (uintptr_t)pause);
+    return changed;
+  }
+
+  static uintptr_t CollectInLine(TSanThread *thr, CacheLine *line) {
+    uintptr_t changed = 0;
+    Mask mask(line->has_shadow_value());
+    while (!mask.Empty()) {
+      uintptr_t off = mask.GetSomeSetBit();
+      mask.Clear(off);
+      ShadowValue *sval_p = line->GetValuePointer(off);
+      ShadowValue old_sval = *sval_p;
+      SSID new_rd_ssid = RemoveDeadSegments(thr, old_sval.rd_ssid());
+      SSID new_wr_ssid = RemoveDeadSegments(thr, old_sval.wr_ssid());
+      if (new_rd_ssid == old_sval.rd_ssid() &&
+          new_wr_ssid == old_sval.wr_ssid())
+        continue;
+      changed++;
+      ShadowValue new_sval;
+      new_sval.set(new_rd_ssid, new_wr_ssid);
+      if (new_sval.IsNew()) {
+        line->ClearSvalAtOffset(off);
+        G_stats->gc_svals_cleared++;
+      } else {
+        new_sval.Ref("ShadowGC");
+        *sval_p = new_sval;
+        G_stats->gc_svals_shrunk++;
+      }
+      old_sval.Unref("ShadowGC");
+    }
+    return changed;
+  }
+
+  static SSID RemoveDeadSegments(TSanThread *thr, SSID ssid) {
+    if (ssid.IsEmpty()) return ssid;
+    if (ssid.IsSingleton())
+      return IsDead(ssid.GetSingleton()) ? SSID(0) : ssid;
+    SSID res = ssid;
+    int size = SegmentSet::Size(ssid);
+    for (int i = 0; i < size; i++) {
+      SID sid = SegmentSet::GetSID(ssid, i, __LINE__);
+      if (IsDead(sid))
+        res = SegmentSet::RemoveSegmentFromSS(res, sid, thr->ss_cache());
+    }
+    return res;
+  }
+
+  static bool IsDead(SID sid) {
+    unordered_map<int32_t, bool>::iterator it = dead_cache_->find(sid.raw());
+    if (it != dead_cache_->end())
+      return it->second;
+    Segment *seg = Segment::Get(sid);
+    TID tid = seg->tid();
+    bool dead = true;
+    for (int i = 0; dead && i < TSanThread::NumberOfThreads(); i++) {
+      TSanThread *thr = TSanThread::Get(TID(i));
+      // A thread which has exited may still have children to start.
+      dead = thr->HappensBeforeChildrenToStart(seg->vts());
+      if (!dead || !thr->is_running()) continue;
+      if (thr->sid() == sid)
+        dead = false;
+      else if (thr->tid() == tid)
+        dead = true;  // An older segment of the same thread.
+      else
+        dead = Segment::HappensBefore(sid, thr->sid());
+    }
+    (*dead_cache_)[sid.raw()] = dead;
+    return dead;
+  }
+
+  static vector<uintptr_t> *tags_;  // Tags of the current cycle.
+  static size_t pos_;
+  static int32_t n_segments_at_last_slice_;
+  static int32_t n_segments_at_last_full_cycle_;
+  static unordered_map<int32_t, bool> *dead_cache_;
+};
+
+vector<uintptr_t> *ShadowGC::tags_;
+size_t ShadowGC::pos_;
+int32_t ShadowGC::n_segments_at_last_slice_;
+int32_t ShadowGC::n_segments_at_last_full_cycle_;
+unordered_map<int32_t, bool> *ShadowGC::dead_cache_;
+
+
 // -------- Forget all state -------- {{{1
 // We need to forget all state and start over because we've
 // run out of some resources (most likely, segment IDs).
@@ -5465,6 +8317,9 @@ static void ForgetAllStateAndStartOver(TSanThread *thr, const char *reason) {
   size_t start_time = g_last_flush_time = TimeInMilliSeconds();
   Report("T%d INFO: %s. Flushing state.\n", raw_tid(thr), reason);
 
+  // Wait for the event handlers running w/o ts_lock and keep new ones out.
+  UnlockedHandlerGate::Close();
+
   if (TS_SERIALIZED == 0) {
     // We own the lock, but we also must acquire all cache lines
     // so that the fast-path (unlocked) code does not execute while
@@ -5486,12 +8341,18 @@ static void ForgetAllStateAndStartOver(TSanThread *thr, const char *reason) {
 
   G_stats->n_forgets++;
 
+  SegmentAccessFilter::InvalidateAll();
+  ShadowGC::ForgetAllState();
+  LazyShadowClear::ForgetAllState();
   Segment::ForgetAllState();
   SegmentSet::ForgetAllState();
   TSanThread::ForgetAllState();
   VTS::FlushHBCache();
 
-  G_heap_map->Clear();
+  {
+    SubsystemTIL til(kHeapMapLock);
+    G_heap_map->Clear();
+  }
 
   g_publish_info_map->clear();
 
@@ -5507,6 +8368,7 @@ static void ForgetAllStateAndStartOver(TSanThread *thr, const char *reason) {
   // Must be the last one to flush as it effectively releases the
   // cach lines and enables fast path code to run in other threads.
   G_cache->ForgetAllState(thr);
+  UnlockedHandlerGate::Open();
 
   size_t stop_time = TimeInMilliSeconds();
   if (TSAN_DEBUG || (stop_time - start_time > 0)) {
@@ -5516,6 +8378,8 @@ static void ForgetAllStateAndStartOver(TSanThread *thr, const char *reason) {
 }
 
 static INLINE void FlushStateIfOutOfSegments(TSanThread *thr) {
+  if (ShadowGC::Enabled() && ShadowGC::AvoidFlush(thr))
+    return;
   if (Segment::NumberOfSegments() > kMaxSIDBeforeFlush) {
     // too few sids left -- flush state.
     if (TSAN_DEBUG) {
@@ -5790,7 +8654,7 @@ class ReportStorage {
       SID concurrent_sid = SegmentSet::GetSID(ssid, s, __LINE__);
       Segment *seg = Segment::Get(concurrent_sid);
       if (Segment::HappensBeforeOrSameThread(concurrent_sid, sid)) continue;
-      if (!LockSet::IntersectionIsEmpty(lsid, seg->lsid(is_w))) continue;
+      if (!LockSet::IntersectionIsEmpty(lsid, seg->lsid(is_w), NULL)) continue;
       if (concurrent_sids) {
         concurrent_sids->insert(concurrent_sid);
       }
@@ -5846,7 +8710,7 @@ class ReportStorage {
     for (set<SID>::iterator it = concurrent_sids.begin();
          it != concurrent_sids.end(); ++it) {
       // Take the first pc of the concurrent stack trace.
-      uintptr_t concurrent_pc = *Segment::embedded_stack_trace(*it);
+      uintptr_t concurrent_pc = Segment::HistoryTopPc(*it);
       snprintf(buf, 100, ",%p", (void*)concurrent_pc);
       s += buf;
     }
@@ -5962,38 +8826,14 @@ class ReportStorage {
 #endif
   }
 
-  bool PrintReport(ThreadSanitizerReport *report) {
-    CHECK(report);
-    // Check if we have a suppression.
-    vector<string> funcs_mangled;
-    vector<string> funcs_demangled;
-    vector<string> objects;
-
-    CHECK(!g_race_verifier_active);
-    CHECK(report->stack_trace);
-    CHECK(report->stack_trace->size());
-    for (size_t i = 0; i < report->stack_trace->size(); i++) {
-      uintptr_t pc = report->stack_trace->Get(i);
-      string img, rtn, file;
-      int line;
-      PcToStrings(pc, false, &img, &rtn, &file, &line);
-      if (rtn == "(below main)" || rtn == "ThreadSanitizerStartThread")
-        break;
-
-      funcs_mangled.push_back(rtn);
-      funcs_demangled.push_back(NormalizeFunctionName(PcToRtnName(pc, true)));
-      objects.push_back(img);
-
-      if (rtn == "main")
-        break;
-    }
-    string suppression_name;
-    if (suppressions_.StackTraceSuppressed("ThreadSanitizer",
-                                           report->ReportName(),
-                                           funcs_mangled,
-                                           funcs_demangled,
-                                           objects,
-                                           &suppression_name)) {
+  bool PrintReport(ThreadSanitizerReport *report) {
+    CHECK(report);
+    CHECK(!g_race_verifier_active);
+    CHECK(report->stack_trace);
+    CHECK(report->stack_trace->size());
+    // Check if we have a suppression.
+    string suppression_name = SuppressionForReport(report);
+    if (!suppression_name.empty()) {
       used_suppressions_[suppression_name]++;
       return false;
     }
@@ -6053,6 +8893,11 @@ class ReportStorage {
 
     // Generate a suppression.
     if (G_flags->generate_suppressions) {
+      vector<string> funcs_mangled;
+      vector<string> funcs_demangled;
+      vector<string> objects;
+      SymbolizeForSuppressions(report->stack_trace, &funcs_mangled,
+                               &funcs_demangled, &objects);
       string supp = "{\n";
       supp += "  <Put your suppression name here>\n";
       supp += string("  ThreadSanitizer:") + report->ReportName() + "\n";
@@ -6111,6 +8956,7 @@ class ReportStorage {
       }
     }
 
+    SubsystemTIL til(kHeapMapLock);
     HeapInfo *heap_info = G_heap_map->GetInfo(a);
     if (heap_info) {
       snprintf(buff, sizeof(buff),
@@ -6177,6 +9023,65 @@ class ReportStorage {
   }
 
  private:
+  // Returns the name of the suppression matching the report's stack or "".
+  // Reports in a benign race storm come from a few stacks, so the verdict
+  // is cached by the report type and the raw pcs: a hit costs neither
+  // symbolization nor matching.
+  string SuppressionForReport(ThreadSanitizerReport *report) {
+    vector<uintptr_t> key(1, report->type);
+    for (size_t i = 0; i < report->stack_trace->size(); i++)
+      key.push_back(report->stack_trace->Get(i));
+    map<vector<uintptr_t>, string>::iterator it =
+        suppression_verdicts_.find(key);
+    if (it != suppression_verdicts_.end()) {
+      G_stats->suppression_verdict_cache_hit++;
+      return it->second;
+    }
+    G_stats->suppression_verdict_cache_miss++;
+
+    vector<string> funcs_mangled;
+    vector<string> funcs_demangled;
+    vector<string> objects;
+    SymbolizeForSuppressions(report->stack_trace, &funcs_mangled,
+                             &funcs_demangled, &objects);
+    string suppression_name;
+    suppressions_.StackTraceSuppressed("ThreadSanitizer",
+                                       report->ReportName(),
+                                       funcs_mangled,
+                                       funcs_demangled,
+                                       objects,
+                                       &suppression_name);
+    if (suppression_verdicts_.size() >= kMaxSuppressionVerdicts)
+      suppression_verdicts_.clear();
+    suppression_verdicts_[key] = suppression_name;
+    return suppression_name;
+  }
+
+  void SymbolizeForSuppressions(StackTrace *stack_trace,
+                                vector<string> *funcs_mangled,
+                                vector<string> *funcs_demangled,
+                                vector<string> *objects) {
+    for (size_t i = 0; i < stack_trace->size(); i++) {
+      uintptr_t pc = stack_trace->Get(i);
+      string img, rtn, file;
+      int line;
+      PcToStrings(pc, false, &img, &rtn, &file, &line);
+      if (rtn == "(below main)" || rtn == "ThreadSanitizerStartThread")
+        break;
+
+      funcs_mangled->push_back(rtn);
+      funcs_demangled->push_back(NormalizeFunctionName(PcToRtnName(pc, true)));
+      objects->push_back(img);
+
+      if (rtn == "main")
+        break;
+    }
+  }
+
+  // See SuppressionForReport().
+  static const size_t kMaxSuppressionVerdicts = 1 << 16;
+  map<vector<uintptr_t>, string> suppression_verdicts_;
+
   map<StackTrace *, int, StackTrace::Less> reported_stacks_;
   int n_reports;
   int n_race_reports;
@@ -6265,15 +9170,45 @@ int64_t EventSampler::print_after_this_number_of_samples_;
 // Collection of event handlers.
 class Detector {
  public:
+  // The memory access path (HandleTraceImpl and everything it calls) is
+  // instantiated for each combination of these modes, which are fixed once
+  // the flags are known. HandleTrace() picks the instantiation.
+  enum {
+    // Pure happens-before and no hybrid locks (NON_HB_LOCK) so far:
+    // CheckIfRace() does not need to look at the locksets.
+    kPureHappensBeforeMode = 1,
+    // TSanThread::HasExpensiveFlags().
+    kExpensiveFlagsMode = 2,
+    kNumAccessModes = 4
+  };
+
+  Detector()
+    : hybrid_locks_seen_(false),
+      last_mem_report_time_(0),
+      mem_soft_limit_(0) {
+    SelectMemoryAccessPath();
+  }
+
+  // Traces with at most this many mops are handled a cache line at a time
+  // (see HandleTraceLoopByLine).
+  static const size_t kMaxMopsToGroupByLine = 64;
+
+  template <int kMode>
   void INLINE HandleTraceLoop(TSanThread *thr, uintptr_t pc,
                               MopInfo *mops,
                               uintptr_t *tleb, size_t n,
                               int expensive_bits, bool need_locking) {
-    bool has_expensive_flags = (expensive_bits & 4) != 0;
+    const bool has_expensive_flags = (kMode & kExpensiveFlagsMode) != 0;
     size_t i = 0;
     uintptr_t sblock_pc = pc;
     size_t n_locks = 0;
-    do {
+    bool use_filter = UseAccessFilter(thr, &sblock_pc, need_locking);
+    if (n > 1 && n <= kMaxMopsToGroupByLine &&
+        !(TS_ATOMICITY && G_flags->atomicity)) {
+      n_locks = HandleTraceLoopByLine<kMode>(thr, &sblock_pc, mops, tleb, n,
+                                             expensive_bits, use_filter,
+                                             need_locking);
+    } else do {
       uintptr_t addr = tleb[i];
       if (addr == 0) continue;  // This mop was not executed.
       MopInfo *mop = &mops[i];
@@ -6282,10 +9217,13 @@ class Detector {
       DCHECK(mop->pc() != 0);
       if ((expensive_bits & 1) && mop->is_write() == false) continue;
       if ((expensive_bits & 2) && mop->is_write() == true) continue;
-      n_locks += HandleMemoryAccessInternal(thr, &sblock_pc, addr, mop,
-                                 has_expensive_flags,
-                                 need_locking);
+      if (use_filter && FilterOutAccess(thr, addr, mop)) continue;
+      n_locks += HandleMemoryAccessInternal<kMode>(thr, &sblock_pc, addr,
+                                                   mop, need_locking);
     } while (++i < n);
+    if (need_locking) {
+      thr->owned_lines()->ReleaseAll(thr);
+    }
     if (has_expensive_flags) {
       const size_t mop_stat_size = TS_ARRAY_SIZE(thr->stats.mops_per_trace);
       thr->stats.mops_per_trace[min(n, mop_stat_size - 1)]++;
@@ -6294,33 +9232,153 @@ class Detector {
     }
   }
 
+  INLINE void HandleTrace(TSanThread *thr, MopInfo *mops, size_t n,
+                          uintptr_t pc, uintptr_t *tleb, bool need_locking) {
+    // access_mode_ may change under our feet, the table does not.
+    (this->*kHandleTraceImpl[access_mode_])(thr, mops, n, pc, tleb,
+                                            need_locking);
+  }
+
+  // Called at startup and whenever one of the modes above may have changed.
+  void SelectMemoryAccessPath() {
+    int mode = 0;
+    if (G_flags->pure_happens_before && !hybrid_locks_seen_)
+      mode |= kPureHappensBeforeMode;
+    if (TSanThread::HasExpensiveFlags())
+      mode |= kExpensiveFlagsMode;
+    access_mode_ = mode;
+  }
+
+  template <int kMode>
 #ifdef _MSC_VER
   NOINLINE
   // With MSVC, INLINE would cause the compilation to be insanely slow.
 #else
   INLINE
 #endif
-  void HandleTrace(TSanThread *thr, MopInfo *mops, size_t n, uintptr_t pc,
-                   uintptr_t *tleb, bool need_locking) {
+  void HandleTraceImpl(TSanThread *thr, MopInfo *mops, size_t n,
+                       uintptr_t pc, uintptr_t *tleb, bool need_locking) {
     DCHECK(n);
     // 0 bit - ignore reads, 1 bit -- ignore writes,
     // 2 bit - has_expensive_flags.
     int expensive_bits = thr->expensive_bits();
 
     if (expensive_bits == 0) {
-      HandleTraceLoop(thr, pc, mops, tleb, n, 0, need_locking);
+      HandleTraceLoop<kMode>(thr, pc, mops, tleb, n, 0, need_locking);
     } else {
       if ((expensive_bits & 3) == 3) {
         // everything is ignored, just clear the tleb.
         for (size_t i = 0; i < n; i++) tleb[i] = 0;
       } else {
-        HandleTraceLoop(thr, pc, mops, tleb, n, expensive_bits, need_locking);
+        HandleTraceLoop<kMode>(thr, pc, mops, tleb, n, expensive_bits,
+                               need_locking);
       }
     }
     // At the end, the tleb must be cleared.
     for (size_t i = 0; i < n; i++) DCHECK(tleb[i] == 0);
   }
 
+  // Consumes the executed mops of a trace and handles them grouped by
+  // cache line (the order of mops within one line is preserved).
+  // On the slow path, all mops of a line are handled with one lock
+  // acquisition and one GetLine; on the parallel fast path, the first mop
+  // leaves the line in thr->owned_lines() and the rest hit it.
+  // Returns the number of times the lock was taken.
+  template <int kMode>
+  size_t HandleTraceLoopByLine(TSanThread *thr, uintptr_t *sblock_pc,
+                               MopInfo *mops, uintptr_t *tleb, size_t n,
+                               int expensive_bits, bool use_filter,
+                               bool need_locking) {
+    const bool has_expensive_flags = (kMode & kExpensiveFlagsMode) != 0;
+    uintptr_t tags[kMaxMopsToGroupByLine];
+    uintptr_t addrs[kMaxMopsToGroupByLine];
+    MopInfo *line_mops[kMaxMopsToGroupByLine];
+    size_t n_mops = 0;
+    DCHECK(n <= kMaxMopsToGroupByLine);
+    for (size_t i = 0; i < n; i++) {
+      uintptr_t addr = tleb[i];
+      if (addr == 0) continue;  // This mop was not executed.
+      MopInfo *mop = &mops[i];
+      tleb[i] = 0;  // we've consumed this mop, clear it.
+      DCHECK(mop->size() != 0);
+      DCHECK(mop->pc() != 0);
+      if ((expensive_bits & 1) && mop->is_write() == false) continue;
+      if ((expensive_bits & 2) && mop->is_write() == true) continue;
+      if (use_filter && FilterOutAccess(thr, addr, mop)) continue;
+      // Stable insertion sort by tag; traces are short and mostly sorted.
+      uintptr_t tag = CacheLine::ComputeTag(addr);
+      size_t j = n_mops++;
+      for (; j > 0 && tags[j - 1] > tag; j--) {
+        tags[j] = tags[j - 1];
+        addrs[j] = addrs[j - 1];
+        line_mops[j] = line_mops[j - 1];
+      }
+      tags[j] = tag;
+      addrs[j] = addr;
+      line_mops[j] = mop;
+    }
+
+    bool parallel_fast_path = TS_SERIALIZED == 0 && need_locking &&
+        thr->HasRoomForDeadSids();
+    size_t n_locks = 0;
+    for (size_t beg = 0, end = 0; beg < n_mops; beg = end) {
+      for (end = beg + 1; end < n_mops && tags[end] == tags[beg]; end++) { }
+      if (end - beg == 1 || parallel_fast_path) {
+        for (size_t i = beg; i < end; i++) {
+          n_locks += HandleMemoryAccessInternal<kMode>(thr, sblock_pc,
+                                                       addrs[i], line_mops[i],
+                                                       need_locking);
+        }
+        continue;
+      }
+      size_t k = end - beg;
+      if (has_expensive_flags) {
+        for (size_t i = beg; i < end; i++) {
+          CountMemoryAccessStats(thr, addrs[i], line_mops[i]);
+        }
+        if (need_locking) thr->stats.locked_access[6] += k;
+        thr->stats.mops_grouped_by_line += k;
+      }
+      if (need_locking) {
+        // Other threads may spin on our lines while holding ts_lock.
+        thr->owned_lines()->ReleaseAll(thr);
+      }
+      TIL til(ts_lock, 2, need_locking);
+      thr->HandleSblockEnter(*sblock_pc, /*allow_slow_path=*/true);
+      *sblock_pc = 0;  // don't do SblockEnter any more.
+      HandleMemoryAccessSlowLocked<kMode>(thr, addrs + beg, line_mops + beg,
+                                          k, need_locking);
+      n_locks++;
+    }
+    return n_locks;
+  }
+
+  // The SegmentAccessFilter is valid for the current segment only, so we
+  // may use it only after the segment for this trace is known: enter the
+  // sblock now if this can be done w/o a lock.
+  INLINE bool UseAccessFilter(TSanThread *thr, uintptr_t *sblock_pc,
+                              bool need_locking) {
+    if (!G_flags->segment_access_filter) return false;
+    // Atomic accesses must not hide the plain ones.
+    if (!thr->ShouldReportRaces()) return false;
+    if (*sblock_pc == 0) return true;
+    if (TS_SERIALIZED == 0 && need_locking && !thr->HasRoomForDeadSids())
+      return false;
+    if (!thr->HandleSblockEnter(*sblock_pc, /*allow_slow_path=*/false))
+      return false;
+    *sblock_pc = 0;  // don't do SblockEnter any more.
+    return true;
+  }
+
+  INLINE bool FilterOutAccess(TSanThread *thr, uintptr_t addr, MopInfo *mop) {
+    if (thr->access_filter()->TestAndInsert(addr, mop)) {
+      thr->stats.segment_filter_hit++;
+      return true;
+    }
+    thr->stats.segment_filter_miss++;
+    return false;
+  }
+
   // Special case of a trace with just one mop and no sblock.
   void INLINE HandleMemoryAccess(TSanThread *thr, uintptr_t pc,
                                  uintptr_t addr, uintptr_t size,
@@ -6334,9 +9392,10 @@ class Detector {
     // check if there is not deleted memory
     // (for debugging free() interceptors, not for leak detection)
     if (TSAN_DEBUG && G_flags->debug_level >= 1) {
-      for (HeapMap<HeapInfo>::iterator it = G_heap_map->begin();
-           it != G_heap_map->end(); ++it) {
-        HeapInfo &info = it->second;
+      vector<HeapInfo*> blocks;
+      G_heap_map->GetAll(&blocks);
+      for (size_t i = 0; i < blocks.size(); i++) {
+        HeapInfo &info = *blocks[i];
         Printf("Not free()-ed memory: %p [%p, %p)\n%s\n",
                info.size, info.ptr, info.ptr + info.size,
                info.StackTraceString().c_str());
@@ -6349,9 +9408,10 @@ class Detector {
     // check if we found all expected races (for unit tests only).
     static int total_missing = 0;
     int this_flush_missing = 0;
-    for (ExpectedRacesMap::iterator it = G_expected_races_map->begin();
-         it != G_expected_races_map->end(); ++it) {
-      ExpectedRace race = it->second;
+    vector<ExpectedRace*> races;
+    G_expected_races_map->GetAll(&races);
+    for (size_t i = 0; i < races.size(); i++) {
+      ExpectedRace race = *races[i];
       if (debug_expected_races) {
         Printf("Checking if expected race fired: %p\n", race.ptr);
       }
@@ -6360,7 +9420,7 @@ class Detector {
           (G_flags->nacl_untrusted == race.is_nacl_untrusted)) {
         ++this_flush_missing;
         Printf("Missing an expected race on %p: %s (annotated at %s)\n",
-               it->first,
+               race.ptr,
                race.description,
                PcToRtnNameAndFilePos(race.pc).c_str());
       }
@@ -6411,12 +9471,81 @@ class Detector {
     }
 
     if (vm_size_in_mb > soft_limit) {
+      // Try to free some memory w/o forgetting the useful state.
+      if (ShadowGC::Enabled() && vm_size_in_mb < (hard_limit * 15) / 16 &&
+          ShadowGC::RunFullCycle(thr) > 0) {
+        G_stats->gc_avoided_flushes++;
+        soft_limit = vm_size_in_mb + 1;
+        return;
+      }
       ForgetAllStateAndStartOver(thr,
           "ThreadSanitizer is running close to its memory limit");
       soft_limit = vm_size_in_mb + 1;
     }
   }
 
+  // Must be called under ts_lock.
+  void CheckMemoryBudget(TSanThread *thr) {
+    {
+      SubsystemTIL til(kHeapMapLock);
+      MemoryAccounting::Set(kMemHeapMap, G_heap_map->MemoryUsage());
+    }
+    size_t report_period = G_flags->mem_report_period * 1000;  // ms.
+    if (report_period) {
+      size_t cur_time = TimeInMilliSeconds();
+      if (cur_time - last_mem_report_time_ >= report_period) {
+        last_mem_report_time_ = cur_time;
+        Report("INFO: ThreadSanitizer's memory: %s\n",
+               MemoryAccounting::ToString().c_str());
+      }
+    }
+    if (G_flags->mem_budget_in_mb > 0)
+      EnforceMemoryBudget(thr);
+  }
+
+  // If we use more than --mem_budget_in_mb, free memory starting with the
+  // state which is cheapest to lose: cold (compressed) shadow lines, then
+  // the history of dead segments, and only then everything.
+  void EnforceMemoryBudget(TSanThread *thr) {
+    const uintptr_t budget = (uintptr_t)G_flags->mem_budget_in_mb << 20;
+    // Aim below the budget so that we don't evict on every check.
+    const uintptr_t target = (budget * 7) / 8;
+    uintptr_t total = MemoryAccounting::Total();
+    if (total <= budget) {
+      mem_soft_limit_ = 0;
+      return;
+    }
+    if (total <= mem_soft_limit_) return;
+
+    uintptr_t n_dropped;
+    G_cache->EvictCompressedLines(total - target, &n_dropped);
+    if (n_dropped > 0)
+      SegmentAccessFilter::InvalidateAll();
+    if (MemoryAccounting::Total() <= budget) return;
+
+    // Free the SIDs nobody refers to, then their stack trace chunks.
+    if (ShadowGC::Enabled())
+      ShadowGC::RunFullCycle(thr);
+    else
+      SegmentSet::FlushWholeRecycleQueue();
+    G_stats->mem_released_history_chunks +=
+        Segment::ReleaseDeadHistoryChunks();
+    if (MemoryAccounting::Total() <= budget) return;
+
+    ForgetAllStateAndStartOver(thr,
+        "ThreadSanitizer is over its memory budget (--mem_budget_in_mb)");
+    G_stats->mem_budget_flushes++;
+    G_stats->mem_released_history_chunks +=
+        Segment::ReleaseDeadHistoryChunks();
+    total = MemoryAccounting::Total();
+    if (total > budget) {
+      // What is left can not be evicted; don't flush again until it grows.
+      Report("INFO: ThreadSanitizer's memory after flush: %s\n",
+             MemoryAccounting::ToString().c_str());
+      mem_soft_limit_ = total + budget / 8;
+    }
+  }
+
   // Force state flushing.
   void FlushState(TID tid) {
     ForgetAllStateAndStartOver(TSanThread::Get(tid), 
@@ -6424,6 +9553,11 @@ class Detector {
   }
 
   void FlushIfNeeded(TSanThread *thr) {
+    if ((G_flags->mem_budget_in_mb > 0 || G_flags->mem_report_period > 0) &&
+        thr->TimeToCheckMemory()) {
+      TIL til(ts_lock, 7);
+      CheckMemoryBudget(thr);
+    }
     // Are we out of segment IDs?
 #if defined(TS_VALGRIND) || (defined(_WIN32) && TS_SERIALIZED == 1)
     // GetVmSizeInMb() is only available on Valgrind and Win32 anyway.
@@ -6506,6 +9640,11 @@ class Detector {
       default: break;
     }
 
+    if (TS_SERIALIZED == 0 && G_flags->locking_scheme >= 2 &&
+        HandleEventWithoutTsLock(thr, e)) {
+      return;
+    }
+
     // Everything else is under a lock.
     TIL til(ts_lock, 0);
     AssertTILHeld();
@@ -6634,6 +9773,71 @@ class Detector {
   }
 
  private:
+  // With --locking_scheme=2 lock, unlock, malloc and free are handled w/o
+  // ts_lock: the state they change has its own locks (see SubsystemLockId).
+  // MALLOC and FREE take ts_lock afterwards to clear the shadow memory,
+  // and reports found on the way are printed under ts_lock too.
+  // Returns false if the event has to be handled under ts_lock.
+  bool HandleEventWithoutTsLock(TSanThread *thr, Event *e) {
+    EventType type = e->type();
+    uintptr_t a = e->a();
+    switch (type) {
+      case WRITER_LOCK:
+      case READER_LOCK:
+      case UNLOCK:
+        // Atomicity regions are kept in global state under ts_lock.
+        if (debug_lock || G_flags->atomicity) return false;
+        break;
+      case MALLOC:
+        if (debug_malloc || !IsTrackedHeapBlock(a, e->info())) return false;
+        break;
+      case FREE:
+        // --free_is_write imitates writes to the freed block,
+        // which need ts_lock and the block in G_heap_map.
+        if (debug_free || G_flags->free_is_write || a == 0) return false;
+        break;
+      default:
+        return false;
+    }
+    // Flushing the state and recycling SIDs need ts_lock. The locked paths
+    // flush (or collect SIDs, see ShadowGC) once kMaxSIDBeforeFlush SIDs are
+    // allocated; if SIDs still run short, let this event do it.
+    if (Segment::NumberOfSegments() >
+            kMaxSIDBeforeFlush + (kMaxSID - kMaxSIDBeforeFlush) / 2 ||
+        !thr->HasRoomForDeadSids() ||
+        !UnlockedHandlerGate::Enter()) {
+      return false;
+    }
+    thr->set_without_ts_lock(true);
+    uintptr_t size = 0;
+    bool need_clear = false;
+    switch (type) {
+      case WRITER_LOCK : thr->HandleLock(a, true);   break;
+      case READER_LOCK : thr->HandleLock(a, false);  break;
+      case UNLOCK      : thr->HandleUnlock(a);       break;
+      case MALLOC      :
+        size = e->info();
+        AddHeapBlock(thr, a, size);
+        need_clear = true;
+        break;
+      case FREE        :
+        need_clear = RemoveHeapBlock(thr, a, &size);
+        break;
+      default          : CHECK(0); break;
+    }
+    thr->set_without_ts_lock(false);
+    UnlockedHandlerGate::Leave();
+    thr->stats.events_without_ts_lock++;
+
+    if (need_clear || thr->HasDeferredReports()) {
+      TIL til(ts_lock, 0);
+      if (need_clear)
+        ClearMemoryState(thr, a, a + size);
+      thr->PrintDeferredReports();
+    }
+    return true;
+  }
+
   void ShowProcSelfStatus() {
     if (G_flags->show_proc_self_status) {
       string str = ThreadSanitizerReadFileToString("/proc/self/status", false);
@@ -6647,6 +9851,9 @@ class Detector {
     if (G_flags->show_stats) {
       G_stats->PrintStats();
       G_cache->PrintStorageStats();
+      StackDepot::PrintStats();
+      MemoryAccounting::Set(kMemHeapMap, G_heap_map->MemoryUsage());
+      Printf("   Memory: %s\n", MemoryAccounting::ToString().c_str());
     }
   }
 
@@ -6775,12 +9982,11 @@ class Detector {
     if (debug_expected_races) {
       Printf("T%d: EXPECT_RACE: ptr=%p descr='%s'\n", tid.raw(), ptr, descr);
       thread->ReportStackTrace(ptr);
-      int i = 0;
-      for (ExpectedRacesMap::iterator it = G_expected_races_map->begin();
-           it != G_expected_races_map->end(); ++it) {
-        ExpectedRace &x = it->second;
-        Printf("  [%d] %p [0x%lx]\n", i, &x, x.ptr);
-        i++;
+      vector<ExpectedRace*> races;
+      G_expected_races_map->GetAll(&races);
+      for (size_t i = 0; i < races.size(); i++) {
+        ExpectedRace &x = *races[i];
+        Printf("  [%d] %p [0x%lx]\n", (int)i, &x, x.ptr);
       }
     }
   }
@@ -6809,6 +10015,12 @@ class Detector {
     Lock *lock = Lock::LookupOrCreate(e->a());
     CHECK(lock);
     lock->set_is_pure_happens_before(false);
+    if (!hybrid_locks_seen_) {
+      // From now on CheckIfRace() has to look at the locksets.
+      hybrid_locks_seen_ = true;
+      SelectMemoryAccessPath();
+      SegmentSet::FlushCaches();
+    }
   }
 
   // UNLOCK_OR_INIT
@@ -6912,12 +10124,60 @@ class Detector {
 
   // return true if the current pair of read/write segment sets
   // describes a race.
-  bool NOINLINE CheckIfRace(SSID rd_ssid, SSID wr_ssid) {
+  // The verdict depends only on the segments in the pair, so for pairs
+  // with a tuple (which are expensive to check) it is kept in the thread's
+  // VerdictCache. The cache is flushed when SSIDs get recycled.
+  // A singleton SID may get new contents w/o being recycled as an SSID,
+  // so its Segment::Generation() is stored along with the verdict.
+  template <int kMode>
+  bool INLINE CheckIfRace(SSID rd_ssid, SSID wr_ssid, TSanThread *thr) {
+    if (!G_flags->race_verdict_cache ||
+        !(rd_ssid.IsTuple() || wr_ssid.IsTuple())) {
+      return ComputeIfRace<kMode>(rd_ssid, wr_ssid, thr->ls_cache());
+    }
+    uint32_t gen = 0;
+    if (rd_ssid.IsSingleton()) {
+      gen = Segment::Generation(rd_ssid.GetSingleton());
+    } else if (wr_ssid.IsSingleton()) {
+      gen = Segment::Generation(wr_ssid.GetSingleton());
+    }
+    int stamp = static_cast<int>(gen << 1);
+    SegmentSet::VerdictCache *cache = thr->ss_cache()->verdict_cache();
+    int verdict;
+    if (cache->Lookup(rd_ssid, wr_ssid, &verdict) &&
+        (verdict & ~1) == stamp) {
+      thr->stats.race_verdict_cache_hit++;
+      bool res = verdict & 1;
+      DCHECK(res == ComputeIfRace<kMode>(rd_ssid, wr_ssid, thr->ls_cache()));
+      return res;
+    }
+    thr->stats.race_verdict_cache_miss++;
+    bool res = ComputeIfRace<kMode>(rd_ssid, wr_ssid, thr->ls_cache());
+    cache->Insert(rd_ssid, wr_ssid, stamp | res);
+    return res;
+  }
+
+  template <int kMode>
+  bool NOINLINE ComputeIfRace(SSID rd_ssid, SSID wr_ssid,
+                              LockSet::ThreadCache *ls_cache) {
     int wr_ss_size = SegmentSet::Size(wr_ssid);
     int rd_ss_size = SegmentSet::Size(rd_ssid);
 
     DCHECK(wr_ss_size >= 2 || (wr_ss_size >= 1 && rd_ss_size >= 1));
 
+    if (kMode & kPureHappensBeforeMode) {
+      // All locks are pure happens-before locks, so the intersection of
+      // locksets below is always empty: unordered segments race.
+      if (wr_ss_size >= 2) return true;
+      SID w_sid = SegmentSet::GetSID(wr_ssid, 0, __LINE__);
+      for (int r = 0; r < rd_ss_size; r++) {
+        SID r_sid = SegmentSet::GetSID(rd_ssid, r, __LINE__);
+        if (!Segment::HappensBeforeOrSameThread(w_sid, r_sid))
+          return true;
+      }
+      return false;
+    }
+
     // check all write-write pairs
     for (int w1 = 0; w1 < wr_ss_size; w1++) {
       SID w1_sid = SegmentSet::GetSID(wr_ssid, w1, __LINE__);
@@ -6927,7 +10187,7 @@ class Detector {
         DCHECK(wr_ssid.IsTuple());
         SegmentSet *ss = SegmentSet::Get(wr_ssid);
         LSID w2_ls = Segment::Get(ss->GetSID(w2))->lsid(true);
-        if (LockSet::IntersectionIsEmpty(w1_ls, w2_ls)) {
+        if (LockSet::IntersectionIsEmpty(w1_ls, w2_ls, ls_cache)) {
           return true;
         } else {
           // May happen only if the locks in the intersection are hybrid locks.
@@ -6942,7 +10202,7 @@ class Detector {
         LSID r_ls = r_seg->lsid(false);
         if (Segment::HappensBeforeOrSameThread(w1_sid, r_sid))
           continue;
-        if (LockSet::IntersectionIsEmpty(w1_ls, r_ls)) {
+        if (LockSet::IntersectionIsEmpty(w1_ls, r_ls, ls_cache)) {
           return true;
         } else {
           // May happen only if the locks in the intersection are hybrid locks.
@@ -6957,6 +10217,7 @@ class Detector {
   // New experimental state machine.
   // Set *res to the new state.
   // Return true if the new state is race.
+  template <int kMode>
   bool INLINE MemoryStateMachine(ShadowValue old_sval, TSanThread *thr,
                                  bool is_w, ShadowValue *res) {
     ShadowValue new_sval;
@@ -6980,19 +10241,23 @@ class Detector {
     SSID new_rd_ssid(0);
     SSID new_wr_ssid(0);
     if (is_w) {
-      new_rd_ssid = SegmentSet::RemoveSegmentFromSS(old_rd_ssid, cur_sid);
-      new_wr_ssid = SegmentSet::AddSegmentToSS(old_wr_ssid, cur_sid);
+      new_rd_ssid = SegmentSet::RemoveSegmentFromSS(old_rd_ssid, cur_sid,
+                                                    thr->ss_cache());
+      new_wr_ssid = SegmentSet::AddSegmentToSS(old_wr_ssid, cur_sid,
+                                               thr->ss_cache());
     } else {
       if (SegmentSet::Contains(old_wr_ssid, cur_sid)) {
         // cur_sid is already in old_wr_ssid, no change to SSrd is required.
         new_rd_ssid = old_rd_ssid;
       } else {
-        new_rd_ssid = SegmentSet::AddSegmentToSS(old_rd_ssid, cur_sid);
+        new_rd_ssid = SegmentSet::AddSegmentToSS(old_rd_ssid, cur_sid,
+                                                 thr->ss_cache());
       }
       new_wr_ssid = old_wr_ssid;
     }
 
-    if (UNLIKELY(G_flags->sample_events > 0)) {
+    if ((kMode & kExpensiveFlagsMode) &&
+        UNLIKELY(G_flags->sample_events > 0)) {
       if (new_rd_ssid.IsTuple() || new_wr_ssid.IsTuple()) {
         static EventSampler sampler;
         sampler.Sample(thr, "HasTupleSS", false);
@@ -7007,12 +10272,94 @@ class Detector {
 
     if (new_wr_ssid.IsTuple() ||
         (!new_wr_ssid.IsEmpty() && !new_rd_ssid.IsEmpty())) {
-      return CheckIfRace(new_rd_ssid, new_wr_ssid);
+      return CheckIfRace<kMode>(new_rd_ssid, new_wr_ssid, thr);
     }
     return false;
   }
 
 
+  // Unlocked fast path for transitions that involve tuple segment sets,
+  // e.g. for read-shared memory. May be called w/o ts_lock.
+  // Returns false and leaves *new_sval intact if the transition needs
+  // a new SegmentSet or a race check, or if it has raced with SegmentSet
+  // recycling. Otherwise updates *new_sval in the same way as
+  // MemoryStateMachine() + RefAndUnrefTwoSegSetPairsIfDifferent() would do.
+  INLINE bool MemoryStateMachineUnlocked(bool is_w, ShadowValue old_sval,
+                                         TSanThread *thr,
+                                         ShadowValue *new_sval) {
+    // Must be read before any SegmentSet is looked at.
+    uintptr_t reuse_epoch = SegmentSet::ReuseEpoch();
+    SegmentSet::ThreadCache *cache = thr->ss_cache();
+    SID cur_sid = thr->sid();
+    SSID old_rd_ssid = old_sval.rd_ssid();
+    SSID old_wr_ssid = old_sval.wr_ssid();
+    SSID new_rd_ssid = old_rd_ssid;
+    SSID new_wr_ssid = old_wr_ssid;
+    if (is_w) {
+      if (!SegmentSet::TryRemoveSegmentFromSS(old_rd_ssid, cur_sid, cache,
+                                              &new_rd_ssid) ||
+          !SegmentSet::TryAddSegmentToSS(old_wr_ssid, cur_sid, cache,
+                                         &new_wr_ssid)) {
+        thr->stats.unlocked_ss_transition_fail++;
+        return false;
+      }
+    } else if (!SegmentSet::Contains(old_wr_ssid, cur_sid)) {
+      if (!SegmentSet::TryAddSegmentToSS(old_rd_ssid, cur_sid, cache,
+                                         &new_rd_ssid)) {
+        thr->stats.unlocked_ss_transition_fail++;
+        return false;
+      }
+    }
+
+    bool rd_changed = new_rd_ssid != old_rd_ssid;
+    bool wr_changed = new_wr_ssid != old_wr_ssid;
+    if (!rd_changed && !wr_changed)
+      return true;
+
+    if (new_wr_ssid.IsTuple() ||
+        (!new_wr_ssid.IsEmpty() && !new_rd_ssid.IsEmpty())) {
+      // Need CheckIfRace(), leave it to the locked path.
+      thr->stats.unlocked_ss_transition_fail++;
+      return false;
+    }
+
+    // If the epoch has changed, some of the SSIDs we have looked at
+    // might have been reused.
+    bool rd_refed = false, wr_refed = false;
+    bool ok = (!rd_changed || (rd_refed = TryRefUnlocked(new_rd_ssid))) &&
+              (!wr_changed || (wr_refed = TryRefUnlocked(new_wr_ssid))) &&
+              SegmentSet::ReuseEpoch() == reuse_epoch;
+    if (!ok) {
+      if (rd_refed) UnrefUnlocked(thr, new_rd_ssid);
+      if (wr_refed) UnrefUnlocked(thr, new_wr_ssid);
+      thr->stats.unlocked_ss_transition_fail++;
+      return false;
+    }
+    if (rd_changed) UnrefUnlocked(thr, old_rd_ssid);
+    if (wr_changed) UnrefUnlocked(thr, old_wr_ssid);
+    new_sval->set(new_rd_ssid, new_wr_ssid);
+    thr->stats.unlocked_ss_transition_ok++;
+    return true;
+  }
+
+  static INLINE bool TryRefUnlocked(SSID ssid) {
+    if (ssid.IsEmpty()) return true;
+    if (ssid.IsSingleton()) {
+      Segment::Ref(ssid.GetSingleton(), "TryRefUnlocked");
+      return true;
+    }
+    return SegmentSet::TryRef(ssid);
+  }
+
+  static INLINE void UnrefUnlocked(TSanThread *thr, SSID ssid) {
+    if (ssid.IsEmpty()) return;
+    if (ssid.IsSingleton()) {
+      thr->AddDeadSid(ssid.GetSingleton(), "UnrefUnlocked");
+    } else {
+      SegmentSet::UnrefNoRecycle(ssid, thr->ss_cache());
+    }
+  }
+
   // Fast path implementation for the case when we stay in the same thread.
   // In this case we don't need to call HappensBefore(), deal with
   // Tuple segment sets and check for race.
@@ -7142,6 +10489,7 @@ class Detector {
   }
 
   // return false if we were not able to complete the task (fast_path_only).
+  template <int kMode>
   INLINE bool HandleMemoryAccessHelper(bool is_w,
                                        CacheLine *cache_line,
                                        uintptr_t addr,
@@ -7169,7 +10517,9 @@ class Detector {
     if (fast_path_ok) {
       res = true;
     } else if (fast_path_only) {
-      res = false;
+      // We check only the first bit for publishing, oh well.
+      res = !cache_line->published().Get(offset) &&
+          MemoryStateMachineUnlocked(is_w, old_sval, thr, sval_p);
     } else {
       bool is_published = cache_line->published().Get(offset);
       // We check only the first bit for publishing, oh well.
@@ -7179,7 +10529,7 @@ class Detector {
         thr->NewSegmentForWait(signaller_vts);
       }
 
-      bool is_race = MemoryStateMachine(old_sval, thr, is_w, sval_p);
+      bool is_race = MemoryStateMachine<kMode>(old_sval, thr, is_w, sval_p);
 
       // Check for race.
       if (UNLIKELY(is_race)) {
@@ -7229,10 +10579,12 @@ class Detector {
 
 
   // return false if we were not able to complete the task (fast_path_only).
+  template <int kMode>
   INLINE bool HandleAccessGranularityAndExecuteHelper(
       CacheLine *cache_line,
       TSanThread *thr, uintptr_t addr, MopInfo *mop,
-      bool has_expensive_flags, bool fast_path_only) {
+      bool fast_path_only) {
+    const bool has_expensive_flags = (kMode & kExpensiveFlagsMode) != 0;
     size_t size = mop->size();
     uintptr_t pc = mop->pc();
     bool is_w = mop->is_write();
@@ -7335,7 +10687,8 @@ class Detector {
         cache_line->Split_8_to_4(off);
         cache_line->Split_4_to_2(off);
         cache_line->Split_2_to_1(off);
-        if (!HandleMemoryAccessHelper(is_w, cache_line, x, 1, pc, thr, false))
+        if (!HandleMemoryAccessHelper<kMode>(is_w, cache_line, x, 1, pc,
+                                             thr, false))
           return false;
       }
       return true;
@@ -7361,14 +10714,15 @@ slow_path:
       else if(GranularityIs4(off, gr)) s = 4;
       else if(GranularityIs2(off, gr)) s = 2;
       else                             s = 1;
-      if (!HandleMemoryAccessHelper(is_w, cache_line, x, s, pc, thr, false))
+      if (!HandleMemoryAccessHelper<kMode>(is_w, cache_line, x, s, pc,
+                                           thr, false))
         return false;
       x += s;
     }
     return true;
 one_call:
-    return HandleMemoryAccessHelper(is_w, cache_line, addr, size, pc,
-                                    thr, fast_path_only);
+    return HandleMemoryAccessHelper<kMode>(is_w, cache_line, addr, size, pc,
+                                           thr, fast_path_only);
   }
 
   INLINE bool IsTraced(CacheLine *cache_line, uintptr_t addr,
@@ -7410,16 +10764,18 @@ one_call:
   }
 
 
+  // Handles n accesses which all hit the cache line of addrs[0].
+  template <int kMode>
 #if TS_SERIALIZED == 1
   INLINE  // TODO(kcc): this can also be made NOINLINE later.
 #else
   NOINLINE
 #endif
   void HandleMemoryAccessSlowLocked(TSanThread *thr,
-                                    uintptr_t addr,
-                                    MopInfo *mop,
-                                    bool has_expensive_flags,
+                                    uintptr_t *addrs,
+                                    MopInfo **mops, size_t n,
                                     bool need_locking) {
+    const bool has_expensive_flags = (kMode & kExpensiveFlagsMode) != 0;
     AssertTILHeld();
     DCHECK(thr->lsid(false) == thr->segment()->lsid(false));
     DCHECK(thr->lsid(true) == thr->segment()->lsid(true));
@@ -7429,32 +10785,57 @@ one_call:
       // only in non-serial variant.
       thr->GetSomeFreshSids();
     }
-    CacheLine *cache_line = G_cache->GetLineOrCreateNew(thr, addr, __LINE__);
-    HandleAccessGranularityAndExecuteHelper(cache_line, thr, addr,
-                                            mop, has_expensive_flags,
-                                            /*fast_path_only=*/false);
-    bool tracing = IsTraced(cache_line, addr, has_expensive_flags);
-    G_cache->ReleaseLine(thr, addr, cache_line, __LINE__);
+    CacheLine *cache_line = G_cache->GetLineOrCreateNew(thr, addrs[0],
+                                                        __LINE__);
+    uint64_t tracing = 0;  // Bit i is set if addrs[i] is traced.
+    for (size_t i = 0; i < n; i++) {
+      DCHECK(CacheLine::ComputeTag(addrs[i]) == cache_line->tag());
+      HandleAccessGranularityAndExecuteHelper<kMode>(
+          cache_line, thr, addrs[i], mops[i], /*fast_path_only=*/false);
+      if (IsTraced(cache_line, addrs[i], has_expensive_flags))
+        tracing |= 1ULL << (i % 64);
+    }
+    G_cache->ReleaseLine(thr, addrs[0], cache_line, __LINE__);
     cache_line = NULL;  // just in case.
 
     if (has_expensive_flags) {
-      if (tracing) {
-        DoTrace(thr, addr, mop, /*need_locking=*/false);
-      }
-      if (G_flags->sample_events > 0) {
-        const char *type = "SampleMemoryAccess";
-        static EventSampler sampler;
-        sampler.Sample(thr, type, false);
+      for (size_t i = 0; i < n; i++) {
+        if ((tracing >> (i % 64)) & 1) {
+          DoTrace(thr, addrs[i], mops[i], /*need_locking=*/false);
+        }
+        if (G_flags->sample_events > 0) {
+          const char *type = "SampleMemoryAccess";
+          static EventSampler sampler;
+          sampler.Sample(thr, type, false);
+        }
       }
     }
   }
 
+  template <int kMode>
+  void HandleMemoryAccessSlowLocked(TSanThread *thr,
+                                    uintptr_t addr,
+                                    MopInfo *mop,
+                                    bool need_locking) {
+    HandleMemoryAccessSlowLocked<kMode>(thr, &addr, &mop, 1, need_locking);
+  }
+
+  INLINE void CountMemoryAccessStats(TSanThread *thr, uintptr_t addr,
+                                     MopInfo *mop) {
+    thr->stats.memory_access_sizes[mop->size() <= 16 ? mop->size() : 17 ]++;
+    thr->stats.events[mop->is_write() ? WRITE : READ]++;
+    thr->stats.access_to_first_1g += (addr >> 30) == 0;
+    thr->stats.access_to_first_2g += (addr >> 31) == 0;
+    thr->stats.access_to_first_4g += ((uint64_t)addr >> 32) == 0;
+  }
+
+  template <int kMode>
   INLINE bool HandleMemoryAccessInternal(TSanThread *thr,
                                          uintptr_t *sblock_pc,
                                          uintptr_t addr,
                                          MopInfo *mop,
-                                         bool has_expensive_flags,
                                          bool need_locking) {
+    const bool has_expensive_flags = (kMode & kExpensiveFlagsMode) != 0;
 #   define INC_STAT(stat) \
         do { if (has_expensive_flags) (stat)++; } while ((void)0, 0)
     if (TS_ATOMICITY && G_flags->atomicity) {
@@ -7472,12 +10853,8 @@ one_call:
     // if (thr->IgnoreMemoryIfInStack(addr)) return;
 
     CacheLine *cache_line = NULL;
-    INC_STAT(thr->stats.memory_access_sizes[mop->size() <= 16 ? mop->size() : 17 ]);
-    INC_STAT(thr->stats.events[mop->is_write() ? WRITE : READ]);
     if (has_expensive_flags) {
-      thr->stats.access_to_first_1g += (addr >> 30) == 0;
-      thr->stats.access_to_first_2g += (addr >> 31) == 0;
-      thr->stats.access_to_first_4g += ((uint64_t)addr >> 32) == 0;
+      CountMemoryAccessStats(thr, addr, mop);
     }
 
     int locked_access_case = 0;
@@ -7485,47 +10862,67 @@ one_call:
     if (need_locking) {
       // The fast (unlocked) path.
       if (thr->HasRoomForDeadSids()) {
-        // Acquire a line w/o locks.
-        cache_line = G_cache->TryAcquireLine(thr, addr, __LINE__);
-        if (!Cache::LineIsNullOrLocked(cache_line)) {
-          // The line is not empty or locked -- check the tag.
-          if (cache_line->tag() == CacheLine::ComputeTag(addr)) {
-            // The line is ours and non-empty -- fire the fast path.
-            if (thr->HandleSblockEnter(*sblock_pc, /*allow_slow_path=*/false)) {
-              *sblock_pc = 0;  // don't do SblockEnter any more.
-              bool res = HandleAccessGranularityAndExecuteHelper(
-                  cache_line, thr, addr,
-                  mop, has_expensive_flags,
-                  /*fast_path_only=*/true);
-              bool traced = IsTraced(cache_line, addr, has_expensive_flags);
-              // release the line.
-              G_cache->ReleaseLine(thr, addr, cache_line, __LINE__);
-              if (res && has_expensive_flags && traced) {
-                DoTrace(thr, addr, mop, /*need_locking=*/true);
-              }
-              if (res) {
-                INC_STAT(thr->stats.unlocked_access_ok);
-                // fast path succeded, we are done.
-                return false;
-              } else {
-                locked_access_case = 1;
-              }
+        OwnedLineCache *owned_lines = thr->owned_lines();
+        uintptr_t tag = CacheLine::ComputeTag(addr);
+        cache_line = owned_lines->Lookup(tag);
+        if (cache_line) {
+          INC_STAT(thr->stats.l0_line_cache_hit);
+        } else {
+          INC_STAT(thr->stats.l0_line_cache_miss);
+          // Acquire a line w/o locks.
+          cache_line = G_cache->TryAcquireLine(thr, addr, __LINE__);
+          if (G_cache->sharded() && cache_line != Cache::kLineIsLocked() &&
+              (cache_line == NULL || cache_line->tag() != tag)) {
+            // The slot is ours but holds some other line (or none).
+            // Swap the lines under the shard locks instead of ts_lock.
+            cache_line = G_cache->FetchIntoAcquiredSlot(thr, tag, cache_line);
+            INC_STAT(thr->stats.shard_fetch);
+          }
+          if (!Cache::LineIsNullOrLocked(cache_line)) {
+            // The line is not empty or locked -- check the tag.
+            if (cache_line->tag() == tag) {
+              // The line is ours and non-empty, keep it for a while.
+              owned_lines->Insert(thr, cache_line);
             } else {
-              // we were not able to handle SblockEnter.
+              locked_access_case = 3;
+              // The line has a wrong tag.
               G_cache->ReleaseLine(thr, addr, cache_line, __LINE__);
-              locked_access_case = 2;
             }
-          } else {
-            locked_access_case = 3;
-            // The line has a wrong tag.
+          } else if (cache_line == NULL) {
+            locked_access_case = 4;
+            // We grabbed the cache slot but it is empty, release it.
             G_cache->ReleaseLine(thr, addr, cache_line, __LINE__);
+          } else {
+            locked_access_case = 5;
+          }
+        }
+        if (locked_access_case == 0 && UNLIKELY(cache_line->IsStale())) {
+          // The line needs LazyShadowClear, which requires the lock.
+          locked_access_case = 8;
+        }
+        if (locked_access_case == 0) {
+          // The line is owned by this thread -- fire the fast path.
+          if (thr->HandleSblockEnter(*sblock_pc, /*allow_slow_path=*/false)) {
+            *sblock_pc = 0;  // don't do SblockEnter any more.
+            bool res = HandleAccessGranularityAndExecuteHelper<kMode>(
+                cache_line, thr, addr,
+                mop, /*fast_path_only=*/true);
+            bool traced = IsTraced(cache_line, addr, has_expensive_flags);
+            if (res && has_expensive_flags && traced) {
+              owned_lines->ReleaseAll(thr);
+              DoTrace(thr, addr, mop, /*need_locking=*/true);
+            }
+            if (res) {
+              INC_STAT(thr->stats.unlocked_access_ok);
+              // fast path succeded, we are done.
+              return false;
+            } else {
+              locked_access_case = 1;
+            }
+          } else {
+            // we were not able to handle SblockEnter.
+            locked_access_case = 2;
           }
-        } else if (cache_line == NULL) {
-          locked_access_case = 4;
-          // We grabbed the cache slot but it is empty, release it.
-          G_cache->ReleaseLine(thr, addr, cache_line, __LINE__);
-        } else {
-          locked_access_case = 5;
         }
       } else {
         locked_access_case = 6;
@@ -7536,15 +10933,15 @@ one_call:
 
     if (need_locking) {
       INC_STAT(thr->stats.locked_access[locked_access_case]);
+      // Other threads may spin on our lines while holding ts_lock.
+      thr->owned_lines()->ReleaseAll(thr);
     }
 
     // Everything below goes under a lock.
     TIL til(ts_lock, 2, need_locking);
     thr->HandleSblockEnter(*sblock_pc, /*allow_slow_path=*/true);
     *sblock_pc = 0;  // don't do SblockEnter any more.
-    HandleMemoryAccessSlowLocked(thr, addr, mop,
-                                 has_expensive_flags,
-                                 need_locking);
+    HandleMemoryAccessSlowLocked<kMode>(thr, addr, mop, need_locking);
     return true;
 #undef INC_STAT
   }
@@ -7586,9 +10983,25 @@ one_call:
     uintptr_t a = e->a();
     uintptr_t size = e->info();
 
+    if (!IsTrackedHeapBlock(a, size))
+      return;
+    TSanThread *thr = TSanThread::Get(tid);
+    AddHeapBlock(thr, a, size);
+    ClearMemoryState(thr, a, a + size);
+
+    if (is_mmap) {
+      // Mmap may be used for thread stack, so we should keep the mmap info
+      // when state is flushing.
+      ThreadStackInfo ts_info;
+      ts_info.ptr = a;
+      ts_info.size = size;
+      G_thread_stack_map->InsertInfo(a, ts_info);
+    }
+  }
 
+  static bool IsTrackedHeapBlock(uintptr_t a, uintptr_t size) {
     if (a == 0)
-      return;
+      return false;
 
     #if defined(__GNUC__) && __WORDSIZE == 64
     // If we are allocating a huge piece of memory,
@@ -7596,14 +11009,17 @@ one_call:
     // TODO(kcc): this is a workaround for NaCl. May need to fix it cleaner.
     const uint64_t G84 = (1ULL << 32) * 21; // 84G.
     if (size >= G84) {
-      return;
+      return false;
     }
     #endif
-    TSanThread *thr = TSanThread::Get(tid);
+    CHECK(a <= a + size);
+    return true;
+  }
+
+  // Start a new segment for the allocation and put the block into
+  // G_heap_map. Does not need ts_lock.
+  void AddHeapBlock(TSanThread *thr, uintptr_t a, uintptr_t size) {
     thr->NewSegmentForMallocEvent();
-    uintptr_t b = a + size;
-    CHECK(a <= b);
-    ClearMemoryState(thr, a, b);
     // update heap_map
     HeapInfo info;
     info.ptr  = a;
@@ -7612,7 +11028,7 @@ one_call:
     Segment::Ref(info.sid, __FUNCTION__);
     if (debug_malloc) {
       Printf("T%d MALLOC: %p [%p %p) %s %s\n%s\n",
-             tid.raw(), size, a, a+size,
+             thr->tid().raw(), size, a, a+size,
              Segment::ToString(thr->sid()).c_str(),
              thr->segment()->vts()->ToString().c_str(),
              info.StackTraceString().c_str());
@@ -7620,16 +11036,25 @@ one_call:
 
     // CHECK(!G_heap_map->count(a));  // we may have two calls
                                       //  to AnnotateNewMemory.
+    SubsystemTIL til(kHeapMapLock);
     G_heap_map->InsertInfo(a, info);
+  }
 
-    if (is_mmap) {
-      // Mmap may be used for thread stack, so we should keep the mmap info
-      // when state is flushing.
-      ThreadStackInfo ts_info;
-      ts_info.ptr = a;
-      ts_info.size = size;
-      G_thread_stack_map->InsertInfo(a, ts_info);
+  // Remove the block which starts at `a` from G_heap_map.
+  // Returns false if there is no such block. Does not need ts_lock.
+  bool RemoveHeapBlock(TSanThread *thr, uintptr_t a, uintptr_t *size) {
+    SID sid;
+    {
+      SubsystemTIL til(kHeapMapLock);
+      HeapInfo *info = G_heap_map->GetInfo(a);
+      if (!info || info->ptr != a)
+        return false;
+      *size = info->size;
+      sid = info->sid;
+      G_heap_map->EraseInfo(a);
     }
+    thr->UnrefSegment(sid, __FUNCTION__);
+    return true;
   }
 
   void ImitateWriteOnFree(TSanThread *thr, uintptr_t a, uintptr_t size, uintptr_t pc) {
@@ -7659,18 +11084,26 @@ one_call:
     }
     if (a == 0)
       return;
-    HeapInfo *info = G_heap_map->GetInfo(a);
-    if (!info || info->ptr != a)
-      return;
-    uintptr_t size = info->size;
+    uintptr_t size;
+    SID sid;
+    {
+      SubsystemTIL til(kHeapMapLock);
+      HeapInfo *info = G_heap_map->GetInfo(a);
+      if (!info || info->ptr != a)
+        return;
+      size = info->size;
+      sid = info->sid;
+    }
     uintptr_t pc = e->pc();
     ImitateWriteOnFree(thr, a, size, pc);
     // update G_heap_map
-    CHECK(info->ptr == a);
-    Segment::Unref(info->sid, __FUNCTION__);
+    Segment::Unref(sid, __FUNCTION__);
 
     ClearMemoryState(thr, a, a + size);
-    G_heap_map->EraseInfo(a);
+    {
+      SubsystemTIL til(kHeapMapLock);
+      G_heap_map->EraseInfo(a);
+    }
 
     // We imitate a Write event again, in case there will be use-after-free.
     // We also need to create a new sblock so that the previous stack trace
@@ -7689,13 +11122,18 @@ one_call:
     uintptr_t a = e->a();
     if (a == 0)
       return;
-    HeapInfo *h_info = G_heap_map->GetInfo(a);
     uintptr_t size = e->info();
-    if (h_info && h_info->ptr == a && h_info->size == size) {
-      // TODO(glider): we may want to handle memory deletion and call
-      // Segment::Unref for all the unmapped memory.
-      Segment::Unref(h_info->sid, __FUNCTION__);
-      G_heap_map->EraseRange(a, a + size);
+    // The mapping itself and the heap blocks inside it.
+    vector<HeapInfo> erased;
+    {
+      SubsystemTIL til(kHeapMapLock);
+      HeapInfo *h_info = G_heap_map->GetInfo(a);
+      if (h_info && h_info->ptr == a && h_info->size == size) {
+        G_heap_map->EraseRange(a, a + size, &erased);
+      }
+    }
+    for (size_t i = 0; i < erased.size(); i++) {
+      Segment::Unref(erased[i].sid, __FUNCTION__);
     }
 
     ThreadStackInfo *ts_info = G_thread_stack_map->GetInfo(a);
@@ -7708,13 +11146,14 @@ one_call:
     // Printf("HandleThreadStart: tid=%d parent_tid=%d pc=%lx pid=%d\n",
     //         child_tid.raw(), parent_tid.raw(), pc, getpid());
     VTS *vts = NULL;
-    StackTrace *creation_context = NULL;
+    StackDepot::Id creation_context = 0;
     if (child_tid == TID(0)) {
       // main thread, we are done.
       vts = VTS::CreateSingleton(child_tid);
     } else if (!parent_tid.valid()) {
       TSanThread::StopIgnoringAccessesInT0BecauseNewThreadStarted();
       Report("INFO: creating thread T%d w/o a parent\n", child_tid.raw());
+      ShadowGC::HandleThreadWithoutParent(child_tid);
       vts = VTS::CreateSingleton(child_tid);
     } else {
       TSanThread::StopIgnoringAccessesInT0BecauseNewThreadStarted();
@@ -7809,10 +11248,10 @@ one_call:
              "ignore_wr=%d ignore_rd=%d\n", tid.raw(),
              thr->ignore_reads(), thr->ignore_writes());
       for (int i = 0; i < 2; i++) {
-        StackTrace *context = thr->GetLastIgnoreContext(i);
+        StackDepot::Id context = thr->GetLastIgnoreContext(i);
         if (context) {
           Report("Last ignore_%s call was here: \n%s\n", i ? "wr" : "rd",
-                 context->ToString().c_str());
+                 StackDepot::ToString(context).c_str());
         }
       }
       if (G_flags->save_ignore_context == false) {
@@ -7846,6 +11285,28 @@ one_call:
   void SetUnwindCallback(ThreadSanitizerUnwindCallback cb) {
     reports_.SetUnwindCallback(cb);
   }
+
+ private:
+  typedef void (Detector::*HandleTraceFn)(TSanThread *thr, MopInfo *mops,
+                                          size_t n, uintptr_t pc,
+                                          uintptr_t *tleb, bool need_locking);
+  static const HandleTraceFn kHandleTraceImpl[kNumAccessModes];
+
+  int access_mode_;  // Index in kHandleTraceImpl; read w/o a lock.
+  bool hybrid_locks_seen_;
+
+  // See CheckMemoryBudget.
+  size_t last_mem_report_time_;
+  uintptr_t mem_soft_limit_;
+};
+
+const Detector::HandleTraceFn
+    Detector::kHandleTraceImpl[Detector::kNumAccessModes] = {
+  &Detector::HandleTraceImpl<0>,
+  &Detector::HandleTraceImpl<Detector::kPureHappensBeforeMode>,
+  &Detector::HandleTraceImpl<Detector::kExpensiveFlagsMode>,
+  &Detector::HandleTraceImpl<Detector::kPureHappensBeforeMode |
+                             Detector::kExpensiveFlagsMode>,
 };
 
 static Detector        *G_detector;
@@ -8078,6 +11539,7 @@ void ThreadSanitizerParseFlags(vector<string> *args) {
 
   FindBoolFlag("ignore_stack", false, args, &G_flags->ignore_stack);
   FindIntFlag("keep_history", 1, args, &G_flags->keep_history);
+  FindIntFlag("history_ring_kb", 128, args, &G_flags->history_ring_kb);
   FindUIntFlag("segment_set_recycle_queue_size", TSAN_DEBUG ? 10 : 10000, args,
                &G_flags->segment_set_recycle_queue_size);
   FindUIntFlag("recent_segments_cache_size", 10, args,
@@ -8143,6 +11605,13 @@ void ThreadSanitizerParseFlags(vector<string> *args) {
   FindIntFlag("dry_run", 0, args, &G_flags->dry_run);
   FindBoolFlag("report_races", true, args, &G_flags->report_races);
   FindIntFlag("locking_scheme", 1, args, &G_flags->locking_scheme);
+  FindIntFlag("shadow_shards", 0, args, &G_flags->shadow_shards);
+  CHECK(G_flags->shadow_shards >= 0 && G_flags->shadow_shards <= 64);
+  CHECK((G_flags->shadow_shards & (G_flags->shadow_shards - 1)) == 0);
+  FindBoolFlag("segment_access_filter", true, args,
+               &G_flags->segment_access_filter);
+  FindBoolFlag("race_verdict_cache", true, args,
+               &G_flags->race_verdict_cache);
   FindBoolFlag("unlock_on_mutex_destroy", true, args,
                &G_flags->unlock_on_mutex_destroy);
 
@@ -8179,6 +11648,10 @@ void ThreadSanitizerParseFlags(vector<string> *args) {
     // create h-b arcs between Unlocks and Locks.
     G_flags->pure_happens_before = false;
   }
+  if (G_flags->atomicity || G_flags->trace_level > 0) {
+    // These want to see every access.
+    G_flags->segment_access_filter = false;
+  }
 
   FindBoolFlag("call_coverage", false, args, &G_flags->call_coverage);
   FindStringFlag("dump_events", args, &G_flags->dump_events);
@@ -8188,7 +11661,19 @@ void ThreadSanitizerParseFlags(vector<string> *args) {
               reinterpret_cast<intptr_t*>(&G_flags->trace_addr));
 
   FindIntFlag("max_mem_in_mb", 0, args, &G_flags->max_mem_in_mb);
+  FindIntFlag("mem_budget_in_mb", 0, args, &G_flags->mem_budget_in_mb);
+  FindIntFlag("mem_report_period", 0, args, &G_flags->mem_report_period);
   FindBoolFlag("offline", false, args, &G_flags->offline);
+  FindBoolFlag("radix_shadow_storage", false, args,
+               &G_flags->radix_shadow_storage);
+  FindBoolFlag("compress_cache_lines", false, args,
+               &G_flags->compress_cache_lines);
+  vector<string> shadow_spill_dir_tmp;
+  FindStringFlag("shadow_spill_dir", args, &shadow_spill_dir_tmp);
+  if (shadow_spill_dir_tmp.size() > 0) {
+    G_flags->shadow_spill_dir = shadow_spill_dir_tmp.back();
+  }
+  FindIntFlag("shadow_spill_mb", 4096, args, &G_flags->shadow_spill_mb);
   FindBoolFlag("attach_mode", false, args, &G_flags->attach_mode);
   if (G_flags->max_mem_in_mb == 0) {
     G_flags->max_mem_in_mb = GetMemoryLimitInMb();
@@ -8233,6 +11718,12 @@ void ThreadSanitizerParseFlags(vector<string> *args) {
   FindIntFlag("max_sid_before_flush", (kMaxSID * 15) / 16, args, 
               &G_flags->max_sid_before_flush);
   kMaxSIDBeforeFlush = G_flags->max_sid_before_flush;
+  FindIntFlag("gc_lines_per_slice", 0, args,
+              &G_flags->gc_lines_per_slice);
+  FindIntFlag("lazy_clear_min_lines", 1024, args,
+              &G_flags->lazy_clear_min_lines);
+  FindIntFlag("lazy_clear_max_pending", 256, args,
+              &G_flags->lazy_clear_max_pending);
 
   FindIntFlag("num_callers_in_history", kSizeOfHistoryStackTrace, args,
               &G_flags->num_callers_in_history);
@@ -8269,6 +11760,9 @@ void ThreadSanitizerParseFlags(vector<string> *args) {
 
   FindBoolFlag("nacl_untrusted", false, args, &G_flags->nacl_untrusted);
   FindBoolFlag("threaded_analysis", false, args, &G_flags->threaded_analysis);
+  FindIntFlag("analysis_ring_size", 16, args, &G_flags->analysis_ring_size);
+  CHECK(G_flags->analysis_ring_size >= 2);
+  FindBoolFlag("analysis_ring_drop", false, args, &G_flags->analysis_ring_drop);
 
   FindBoolFlag("sched_shake", false, args, &G_flags->sched_shake);
   FindBoolFlag("api_ambush", false, args, &G_flags->api_ambush);
@@ -8430,6 +11924,8 @@ static void SetupIgnore() {
     string str = ThreadSanitizerReadFileToString(file_name, true);
     ReadIgnoresFromString(str, g_white_lists);
   }
+  CompileIgnoreLists(g_ignore_lists);
+  CompileIgnoreLists(g_white_lists);
 }
 
 void ThreadSanitizerSetUnwindCallback(ThreadSanitizerUnwindCallback cb) {
@@ -8458,8 +11954,8 @@ bool ThreadSanitizerWantToInstrumentSblock(uintptr_t pc) {
   PcToStrings(pc, false, &img_name, &rtn_name, &file_name, &line_no);
 
   if (g_white_lists->ignores.size() > 0) {
-    bool in_white_list = TripleVectorMatchKnown(g_white_lists->ignores, 
-                                                rtn_name, img_name, file_name);
+    bool in_white_list = g_white_lists->ignores_matcher.Match(
+        rtn_name, img_name, file_name);
     if (in_white_list) {
       if (debug_ignore) {
         Report("INFO: Whitelisted rtn: %s\n", rtn_name.c_str());
@@ -8476,10 +11972,10 @@ bool ThreadSanitizerWantToInstrumentSblock(uintptr_t pc) {
     return false;
   }
 
-  bool ignore = TripleVectorMatchKnown(g_ignore_lists->ignores,
-                                       rtn_name, img_name, file_name) ||
-                TripleVectorMatchKnown(g_ignore_lists->ignores_r,
-                                       rtn_name, img_name, file_name);
+  bool ignore = g_ignore_lists->ignores_matcher.Match(
+                    rtn_name, img_name, file_name) ||
+                g_ignore_lists->ignores_r_matcher.Match(
+                    rtn_name, img_name, file_name);
   if (debug_ignore) {
     Printf("%s: pc=%p file_name=%s img_name=%s rtn_name=%s ret=%d\n",
            __FUNCTION__, pc, file_name.c_str(), img_name.c_str(),
@@ -8494,29 +11990,63 @@ bool ThreadSanitizerWantToCreateSegmentsOnSblockEntry(uintptr_t pc) {
   rtn_name = PcToRtnName(pc, false);
   if (G_flags->keep_history == 0)
     return false;
-  return !(TripleVectorMatchKnown(g_ignore_lists->ignores_hist,
-                                  rtn_name, "", ""));
+  return !g_ignore_lists->ignores_hist_matcher.Match(rtn_name, "", "");
 }
 
-// Returns true if function at "pc" is marked as "fun_r" in the ignore file.
-bool NOINLINE ThreadSanitizerIgnoreAccessesBelowFunction(uintptr_t pc) {
-  ScopedMallocCostCenter cc(__FUNCTION__);
-  typedef unordered_map<uintptr_t, bool> Cache;
-  static Cache *cache = NULL;
-  {
-    TIL ignore_below_lock(ts_ignore_below_lock, 18);
-    if (!cache)
-      cache = new Cache;
+// -------- IgnoreBelowVerdicts -------------- {{{1
+// pc -> ThreadSanitizerIgnoreAccessesBelowFunction(pc).
+// Lookups don't take any lock (see InsertOnlyHashTable); insertions are
+// serialized by ts_ignore_below_lock.
+class IgnoreBelowVerdicts {
+ public:
+  // Returns false if there is no verdict for 'pc' yet.
+  static bool Lookup(uintptr_t pc, bool *verdict) {
+    for (Entry *e = table_.Head(Hash(pc)); e; e = e->next) {
+      if (e->pc == pc) {
+        *verdict = e->verdict;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Requires ts_ignore_below_lock; 'pc' must not be in the table.
+  static void Insert(uintptr_t pc, bool verdict) {
+    Entry *e = new Entry;
+    e->pc = pc;
+    e->verdict = verdict;
+    table_.Insert(Hash(pc), e);
+  }
 
-    // Fast path - check if we already know the answer.
-    Cache::iterator i = cache->find(pc);
-    if (i != cache->end())
-      return i->second;
+  static void InitClassMembers() {
+    table_.Init("IgnoreBelowVerdicts::table_ (lock-free lookup)");
   }
 
+ private:
+  struct Entry {
+    Entry     *next;
+    uintptr_t  pc;
+    bool       verdict;
+  };
+
+  static uintptr_t Hash(uintptr_t pc) { return (pc >> 2) ^ (pc >> 16); }
+
+  static InsertOnlyHashTable<Entry, 1 << 14> table_;
+};
+
+InsertOnlyHashTable<IgnoreBelowVerdicts::Entry, 1 << 14>
+    IgnoreBelowVerdicts::table_;
+
+// Returns true if function at "pc" is marked as "fun_r" in the ignore file.
+bool NOINLINE ThreadSanitizerIgnoreAccessesBelowFunction(uintptr_t pc) {
+  // Fast path - check if we already know the answer.
+  bool ret;
+  if (IgnoreBelowVerdicts::Lookup(pc, &ret))
+    return ret;
+
+  ScopedMallocCostCenter cc(__FUNCTION__);
   string rtn_name = PcToRtnName(pc, false);
-  bool ret =
-      TripleVectorMatchKnown(g_ignore_lists->ignores_r, rtn_name, "", "");
+  ret = g_ignore_lists->ignores_r_matcher.Match(rtn_name, "", "");
 
   if (TSAN_DEBUG) {
     // Heavy test for NormalizeFunctionName: test on all possible inputs in
@@ -8524,13 +12054,17 @@ bool NOINLINE ThreadSanitizerIgnoreAccessesBelowFunction(uintptr_t pc) {
     NormalizeFunctionName(PcToRtnName(pc, true));
   }
 
-  // Grab the lock again
   TIL ignore_below_lock(ts_ignore_below_lock, 19);
+  // Someone may have inserted the same pc while we were symbolizing.
+  bool known;
+  if (IgnoreBelowVerdicts::Lookup(pc, &known))
+    return known;
   if (ret && debug_ignore) {
     Report("INFO: ignoring all accesses below the function '%s' (%p)\n",
            PcToRtnNameAndFilePos(pc).c_str(), pc);
   }
-  return ((*cache)[pc] = ret);
+  IgnoreBelowVerdicts::Insert(pc, ret);
+  return ret;
 }
 
 // We intercept a user function with this name
@@ -8555,11 +12089,13 @@ extern "C" const char *ThreadSanitizerQuery(const char *query) {
     Report("INFO: trace-level=0\n");
     G_flags->trace_level = 0;
     debug_happens_before = false;
+    if (G_detector) G_detector->SelectMemoryAccessPath();
   }
   if (str == "trace-level=1") {
     Report("INFO: trace-level=1\n");
     G_flags->trace_level = 1;
     debug_happens_before = true;
+    if (G_detector) G_detector->SelectMemoryAccessPath();
   }
   return ret;
 }
@@ -8568,6 +12104,10 @@ extern void ThreadSanitizerInit() {
   ScopedMallocCostCenter cc("ThreadSanitizerInit");
   ts_lock = new TSLock;
   ts_ignore_below_lock = new TSLock;
+  IgnoreBelowVerdicts::InitClassMembers();
+  for (int i = 0; i < kNumSubsystemLocks; i++) {
+    ts_subsystem_locks[i] = new TSLock;
+  }
   g_so_far_only_one_thread = true;
   ANNOTATE_BENIGN_RACE(&g_so_far_only_one_thread, "real benign race");
   CHECK_EQ(sizeof(ShadowValue), 8);
@@ -8586,9 +12126,15 @@ extern void ThreadSanitizerInit() {
   }
   SegmentSet::InitClassMembers();
   CacheLine::InitClassMembers();
+  CompressedCacheLine::InitClassMembers();
+  ShadowSpill::InitClassMembers();
   TSanThread::InitClassMembers();
   Lock::InitClassMembers();
+  StackDepot::InitClassMembers();
   LockSet::InitClassMembers();
+  ShadowGC::InitClassMembers();
+  ShadowGeneration::InitClassMembers();
+  LazyShadowClear::InitClassMembers();
   EventSampler::InitClassMembers();
   VTS::InitClassMembers();
   // TODO(timurrrr): make sure *::InitClassMembers() are called only once for
@@ -8628,7 +12174,7 @@ extern void ThreadSanitizerInit() {
     Report("INFO: STARTING WITH GLOBAL IGNORE ON\n");
   }
   ANNOTATE_BENIGN_RACE(&g_lock_era,
-                       "g_lock_era may be incremented in a racey way");
+                       "g_lock_era is read w/o a lock");
 }
 
 extern void ThreadSanitizerFini() {
@@ -8828,7 +12374,7 @@ void TsanAtomicCore::HandleWrite(TSanThread* thr,
   // Fill in new entry in the modification history.
   hist.val = v;
   hist.tid = thr->tid();
-  hist.clk = thr->vts()->clk(thr->tid());
+  hist.clk = thr->own_clk();
   if (hist.vts != 0) {
     VTS::Unref(hist.vts);
     hist.vts = 0;
@@ -65,7 +65,10 @@ struct FLAGS {
   string           log_file;
   bool             offline;
   intptr_t         max_n_threads;
-  bool             compress_cache_lines;
+  bool             compress_cache_lines;  // See CompressedCacheLine.
+  bool             radix_shadow_storage;  // See CacheLineStorage.
+  string           shadow_spill_dir;  // See ShadowSpill.
+  intptr_t         shadow_spill_mb;
   bool             unlock_on_mutex_destroy;
 
   intptr_t         sample_events;
@@ -73,7 +76,8 @@ struct FLAGS {
 
   intptr_t         num_callers;
 
-  intptr_t    keep_history;
+  intptr_t    keep_history;  // 0: none, 1: stacks, 2: EventHistoryRing.
+  intptr_t    history_ring_kb;
   bool        pure_happens_before;
   bool        free_is_write;
   bool        exit_after_main;
@@ -98,7 +102,12 @@ struct FLAGS {
   intptr_t     dry_run;
   intptr_t     max_sid;
   intptr_t     max_sid_before_flush;
+  intptr_t     gc_lines_per_slice;  // See ShadowGC.
+  intptr_t     lazy_clear_min_lines;  // See LazyShadowClear.
+  intptr_t     lazy_clear_max_pending;
   intptr_t     max_mem_in_mb;
+  intptr_t     mem_budget_in_mb;  // See Detector::EnforceMemoryBudget.
+  intptr_t     mem_report_period;
   intptr_t     num_callers_in_history;
   intptr_t     flush_period;
 
@@ -106,6 +115,10 @@ struct FLAGS {
   bool         start_with_global_ignore_on;
 
   intptr_t     locking_scheme;  // Used for internal experiments with locking.
+                                // 2 -- also lock each shared table separately.
+  intptr_t     shadow_shards;   // See Cache::Shard. 0 -- off.
+  bool         segment_access_filter;  // See SegmentAccessFilter.
+  bool         race_verdict_cache;  // See Detector::CheckIfRace.
 
   bool         report_races;
   bool         thread_coverage;
@@ -131,6 +144,8 @@ struct FLAGS {
   bool nacl_untrusted;
 
   bool threaded_analysis;
+  intptr_t analysis_ring_size;  // In event batches, per thread.
+  bool analysis_ring_drop;  // Drop mops instead of waiting on a full ring.
 
   bool sched_shake;
   bool api_ambush;
@@ -31,9 +31,11 @@
 
 #include <gtest/gtest.h>
 
+#include "ignore.h"
 #include "ts_heap_info.h"
 #include "ts_simple_cache.h"
 #include "dense_multimap.h"
+#include "ts_vts_kernels.h"
 
 // Testing the HeapMap.
 struct TestHeapInfo {
@@ -137,6 +139,46 @@ TEST(ThreadSanitizer, HeapInfoTest) {
 
 }
 
+TEST(ThreadSanitizer, HeapInfoRangeTest) {
+  HeapMap<TestHeapInfo> map;
+  TestHeapInfo *info;
+  // A big mapping with small and medium blocks inside and one after it.
+  const uintptr_t kMapping = 1 << 24, kMappingSize = 1 << 22;
+  map.InsertInfo(kMapping, TestHeapInfo(kMapping, kMappingSize, 1));
+  map.InsertInfo(kMapping + 16, TestHeapInfo(kMapping + 16, 16, 2));
+  map.InsertInfo(kMapping + 250, TestHeapInfo(kMapping + 250, 100, 3));
+  map.InsertInfo(kMapping + 8192, TestHeapInfo(kMapping + 8192, 10000, 4));
+  map.InsertInfo(kMapping + kMappingSize,
+                 TestHeapInfo(kMapping + kMappingSize, 8, 5));
+  EXPECT_EQ(5U, map.size());
+
+  // The innermost block is returned.
+  EXPECT_TRUE((info = map.GetInfo(kMapping + 20)));
+  EXPECT_EQ(2, info->val);
+  EXPECT_TRUE((info = map.GetInfo(kMapping + 300)));  // Crosses a granule.
+  EXPECT_EQ(3, info->val);
+  EXPECT_TRUE((info = map.GetInfo(kMapping + 8192 + 9999)));
+  EXPECT_EQ(4, info->val);
+  EXPECT_TRUE((info = map.GetInfo(kMapping + 40)));
+  EXPECT_EQ(1, info->val);
+
+  vector<TestHeapInfo*> all;
+  map.GetAll(&all);
+  EXPECT_EQ(5U, all.size());
+  for (size_t i = 1; i < all.size(); i++)
+    EXPECT_LT(all[i - 1]->ptr, all[i]->ptr);
+
+  // Erasing the mapping erases everything inside it.
+  vector<TestHeapInfo> erased;
+  map.EraseRange(kMapping, kMapping + kMappingSize, &erased);
+  EXPECT_EQ(4U, erased.size());
+  EXPECT_EQ(1U, map.size());
+  EXPECT_FALSE(map.GetInfo(kMapping + 20));
+  EXPECT_FALSE(map.GetInfo(kMapping + 8192));
+  EXPECT_TRUE((info = map.GetInfo(kMapping + kMappingSize)));
+  EXPECT_EQ(5, info->val);
+}
+
 TEST(ThreadSanitizer, PtrToBoolCacheTest) {
   PtrToBoolCache<256> c;
   bool val = false;
@@ -256,6 +298,100 @@ TEST(ThreadSanitizer, DenseMultimapTest) {
   EXPECT_FALSE(m9.has(1));
 }
 
+// Testing the VTS kernels.
+// Fills a random sparse VTS with tids below max_width.
+static void RandomSparseVts(size_t max_width, int max_clk, vector<VtsTs> *v) {
+  v->clear();
+  for (size_t tid = 0; tid < max_width; tid++) {
+    if (rand() % 3 == 0) continue;
+    VtsTs ts = {(int32_t)tid, (rand() % max_clk) + 1};
+    v->push_back(ts);
+  }
+}
+
+static void SparseToDense(const vector<VtsTs> &v, vector<int32_t> *d) {
+  d->clear();
+  d->resize(v.empty() ? 0 : v.back().tid + 1);
+  for (size_t i = 0; i < v.size(); i++) {
+    (*d)[v[i].tid] = v[i].clk;
+  }
+}
+
+TEST(ThreadSanitizer, VtsKernelsTest) {
+  vector<VtsTs> a, b;
+  vector<int32_t> da, db;
+  for (int iter = 0; iter < 100000; iter++) {
+    size_t max_width = 1 + rand() % 40;
+    // Small clocks make equal and ordered VTSs likely.
+    RandomSparseVts(max_width, 2, &a);
+    RandomSparseVts(1 + rand() % 40, 2, &b);
+    if (a.empty() || b.empty()) continue;
+    SparseToDense(a, &da);
+    SparseToDense(b, &db);
+
+    bool hb = SparseVtsHappensBefore(&a[0], a.size(), &b[0], b.size());
+    EXPECT_EQ(hb, DenseVtsHappensBeforeScalar(&da[0], da.size(),
+                                              &db[0], db.size()));
+    EXPECT_EQ(hb, DenseVtsHappensBefore(&da[0], da.size(),
+                                        &db[0], db.size()));
+    EXPECT_EQ(hb, SparseDenseVtsHappensBefore(&a[0], a.size(),
+                                              &db[0], db.size()));
+    EXPECT_EQ(hb, DenseSparseVtsHappensBefore(&da[0], da.size(),
+                                              &b[0], b.size()));
+    // A VTS happens-before its join with any other VTS, unless equal to it.
+    vector<VtsTs> sparse_join(a.size() + b.size());
+    sparse_join.resize(SparseVtsJoin(&a[0], a.size(), &b[0], b.size(),
+                                     &sparse_join[0]));
+    vector<int32_t> expected;
+    SparseToDense(sparse_join, &expected);
+
+    size_t width = max(da.size(), db.size());
+    vector<int32_t> dense_join(width);
+    DenseVtsJoin(&da[0], da.size(), &db[0], db.size(), &dense_join[0]);
+    EXPECT_TRUE(dense_join == expected);
+    vector<int32_t> mixed_join(width);
+    DenseSparseVtsJoin(&da[0], da.size(), &b[0], b.size(),
+                       &mixed_join[0], width);
+    EXPECT_TRUE(mixed_join == expected);
+    EXPECT_EQ(!(expected == da),
+              DenseVtsHappensBefore(&da[0], da.size(),
+                                    &expected[0], expected.size()));
+  }
+}
+
+TEST(ThreadSanitizer, IgnoreMatcherTest) {
+  vector<IgnoreTriple> v;
+  v.push_back(IgnoreFun("foo"));
+  v.push_back(IgnoreFun("bar_*"));
+  v.push_back(IgnoreObj("*/libpthread*"));
+  v.push_back(IgnoreObj("/lib/libc.so"));
+  v.push_back(IgnoreFile("*ts_valgrind_intercepts.c"));
+  v.push_back(IgnoreFile("a.c"));
+  v.push_back(IgnoreTriple("baz", "*/libbaz.so", "*"));
+  IgnoreMatcher m;
+  m.Compile(v);
+
+  const char *funs[] = {"", "foo", "foo1", "bar_", "bar_x", "baz", "qux"};
+  const char *objs[] = {"", "/lib/libpthread.so.0", "/lib/libc.so",
+                        "/lib/libc.so.6", "/lib/libbaz.so", "a.out"};
+  const char *files[] = {"", "ts_valgrind_intercepts.c", "a.c", "b.c"};
+  int n_matched = 0;
+  for (size_t f = 0; f < TS_ARRAY_SIZE(funs); f++) {
+    for (size_t o = 0; o < TS_ARRAY_SIZE(objs); o++) {
+      for (size_t s = 0; s < TS_ARRAY_SIZE(files); s++) {
+        bool expected = TripleVectorMatchKnown(v, funs[f], objs[o], files[s]);
+        EXPECT_EQ(expected, m.Match(funs[f], objs[o], files[s]));
+        n_matched += expected;
+      }
+    }
+  }
+  EXPECT_GT(n_matched, 0);
+  EXPECT_TRUE(m.Match("foo", "", ""));
+  EXPECT_TRUE(m.Match("baz", "/lib/libbaz.so", ""));
+  EXPECT_FALSE(m.Match("baz", "a.out", ""));
+  EXPECT_FALSE(m.Match("", "", ""));
+}
+
 TEST(ThreadSanitizer, NormalizeFunctionNameNotChangingTest) {
   const char *samples[] = {
     // These functions should not be changed by NormalizeFunctionName():
@@ -36,81 +36,240 @@
 // For each heap allocation we create a struct HeapInfo.
 // This struct should have fields 'uintptr_t ptr' and 'uintptr_t size',
 // a default CTOR and a copy CTOR.
+//
+// Blocks are indexed by size class: a block of size at most 1 << kGranuleLog[k]
+// is put into the bucket of class k which corresponds to the granule
+// (aligned chunk of 1 << kGranuleLog[k] bytes) where the block starts.
+// Such a block covers at most two granules, so an address is looked up
+// in two buckets per class. Few blocks start in one granule (a granule of
+// class k is at most 16 blocks of class k-1), so buckets are short lists.
+// Blocks bigger than the largest granule are kept in a std::map.
+// Not thread-safe.
 
 template<class HeapInfo>
 class HeapMap {
  public:
-  typedef map<uintptr_t, HeapInfo> map_t;
-  typedef typename map_t::iterator iterator;
+  HeapMap() : size_(0) { }
+  ~HeapMap() { Clear(); }
 
-  HeapMap() { Reset(); }
+  size_t size() { return size_; }
 
-  iterator begin() { return ++map_.begin(); }
-  iterator end() { return --map_.end(); }
-
-  size_t size() { return map_.size() - 2; }
+  // Approximate number of bytes used: a node and a bucket per block.
+  size_t MemoryUsage() {
+    return size_ * (sizeof(Node) + sizeof(typename Buckets::value_type) +
+                    2 * sizeof(void*));
+  }
 
   void InsertInfo(uintptr_t a, HeapInfo info) {
     CHECK(IsValidPtr(a));
     CHECK(info.ptr == a);
-    map_[a] = info;
+    EraseInfo(a);
+    Node *node = new Node;
+    node->info = info;
+    int cls = SizeClass(info.size);
+    if (cls == kNumClasses) {
+      large_[a] = node;
+    } else {
+      Node *&head = buckets_[cls][a >> kGranuleLog[cls]];
+      node->next = head;
+      head = node;
+    }
+    size_++;
   }
 
   void EraseInfo(uintptr_t a) {
     CHECK(IsValidPtr(a));
-    map_.erase(a);
+    for (int cls = 0; cls < kNumClasses; cls++) {
+      typename Buckets::iterator it =
+          buckets_[cls].find(a >> kGranuleLog[cls]);
+      if (it == buckets_[cls].end()) continue;
+      for (Node **p = &it->second; *p; p = &(*p)->next) {
+        if ((*p)->info.ptr != a) continue;
+        Node *node = *p;
+        *p = node->next;
+        delete node;
+        if (it->second == NULL)
+          buckets_[cls].erase(it);
+        size_--;
+        return;
+      }
+    }
+    typename LargeMap::iterator it = large_.find(a);
+    if (it != large_.end()) {
+      delete it->second;
+      large_.erase(it);
+      size_--;
+    }
   }
 
-  void EraseRange(uintptr_t start, uintptr_t end) {
+  // Erase all the blocks which start in [start, end).
+  // If 'erased' is not NULL, the erased blocks are appended to it.
+  void EraseRange(uintptr_t start, uintptr_t end,
+                  vector<HeapInfo> *erased = NULL) {
     CHECK(IsValidPtr(start));
     CHECK(IsValidPtr(end));
-    // TODO(glider): the [start, end) range may cover several map_ records.
-    EraseInfo(start);
+    CHECK(start <= end);
+    if (start == end) return;
+    for (int cls = 0; cls < kNumClasses; cls++) {
+      Buckets &buckets = buckets_[cls];
+      if (buckets.empty()) continue;
+      uintptr_t first = start >> kGranuleLog[cls];
+      uintptr_t last = (end - 1) >> kGranuleLog[cls];
+      if (last - first >= buckets.size()) {
+        // Cheaper to visit every bucket.
+        vector<uintptr_t> keys;
+        for (typename Buckets::iterator it = buckets.begin();
+             it != buckets.end(); ++it) {
+          if (it->first >= first && it->first <= last)
+            keys.push_back(it->first);
+        }
+        for (size_t i = 0; i < keys.size(); i++)
+          EraseInBucket(cls, keys[i], start, end, erased);
+      } else {
+        for (uintptr_t g = first; g <= last; g++)
+          EraseInBucket(cls, g, start, end, erased);
+      }
+    }
+    typename LargeMap::iterator it = large_.lower_bound(start);
+    while (it != large_.end() && it->first < end) {
+      if (erased) erased->push_back(it->second->info);
+      delete it->second;
+      large_.erase(it++);
+      size_--;
+    }
   }
 
+  // Returns the block which starts at 'a', or else the block with the
+  // largest start address which contains 'a', or NULL.
   HeapInfo *GetInfo(uintptr_t a) {
     CHECK(this);
     CHECK(IsValidPtr(a));
-    typename map_t::iterator it = map_.lower_bound(a);
-    CHECK(it != map_.end());
-    if (it->second.ptr == a) {
-      // Exact match. 'a' is the beginning of a heap-allocated address.
-      return &it->second;
+    HeapInfo *res = NULL;
+    for (int cls = 0; cls < kNumClasses; cls++) {
+      uintptr_t g = a >> kGranuleLog[cls];
+      LookupInBucket(cls, g, a, &res);
+      if (res && res->ptr == a) return res;  // Exact match.
+      if (g > 0)
+        LookupInBucket(cls, g - 1, a, &res);
+    }
+    typename LargeMap::iterator it = large_.upper_bound(a);
+    if (it != large_.begin()) {
+      --it;
+      HeapInfo *info = &it->second->info;
+      if (Contains(info, a) && (!res || res->ptr < info->ptr))
+        res = info;
     }
-    CHECK(a < it->second.ptr);
-    CHECK(it != map_.begin());
-    // not an exact match, try the previous iterator.
-    --it;
-    HeapInfo *info = &it->second;
-    CHECK(info->ptr < a);
-    if (info->ptr + info->size > a) {
-      // within the range.
-      return info;
+    return res;
+  }
+
+  // All blocks, sorted by start address.
+  void GetAll(vector<HeapInfo*> *res) {
+    res->clear();
+    res->reserve(size_);
+    for (int cls = 0; cls < kNumClasses; cls++) {
+      for (typename Buckets::iterator it = buckets_[cls].begin();
+           it != buckets_[cls].end(); ++it) {
+        for (Node *node = it->second; node; node = node->next)
+          res->push_back(&node->info);
+      }
     }
-    return NULL;
+    for (typename LargeMap::iterator it = large_.begin();
+         it != large_.end(); ++it) {
+      res->push_back(&it->second->info);
+    }
+    sort(res->begin(), res->end(), LessByPtr);
   }
 
   void Clear() {
-    map_.clear();
-    Reset();
+    for (int cls = 0; cls < kNumClasses; cls++) {
+      for (typename Buckets::iterator it = buckets_[cls].begin();
+           it != buckets_[cls].end(); ++it) {
+        Node *node = it->second;
+        while (node) {
+          Node *next = node->next;
+          delete node;
+          node = next;
+        }
+      }
+      buckets_[cls].clear();
+    }
+    for (typename LargeMap::iterator it = large_.begin();
+         it != large_.end(); ++it) {
+      delete it->second;
+    }
+    large_.clear();
+    size_ = 0;
   }
 
  private:
+  struct Node {
+    HeapInfo info;
+    Node *next;
+  };
+  typedef unordered_map<uintptr_t, Node*> Buckets;
+  typedef map<uintptr_t, Node*> LargeMap;
+
+  static const int kNumClasses = 4;
+  static const uintptr_t kGranuleLog[kNumClasses];
+
+  static int SizeClass(uintptr_t size) {
+    int cls = 0;
+    while (cls < kNumClasses && size > ((uintptr_t)1 << kGranuleLog[cls]))
+      cls++;
+    return cls;
+  }
+
+  static bool Contains(HeapInfo *info, uintptr_t a) {
+    return info->ptr == a || (info->ptr < a && a - info->ptr < info->size);
+  }
+
+  static bool LessByPtr(HeapInfo *x, HeapInfo *y) {
+    return x->ptr < y->ptr;
+  }
+
+  // Update *res if there is a better block for 'a' in the bucket.
+  void LookupInBucket(int cls, uintptr_t g, uintptr_t a, HeapInfo **res) {
+    typename Buckets::iterator it = buckets_[cls].find(g);
+    if (it == buckets_[cls].end()) return;
+    for (Node *node = it->second; node; node = node->next) {
+      HeapInfo *info = &node->info;
+      if (!Contains(info, a)) continue;
+      if (!*res || (*res)->ptr < info->ptr)
+        *res = info;
+    }
+  }
+
+  void EraseInBucket(int cls, uintptr_t g, uintptr_t start, uintptr_t end,
+                     vector<HeapInfo> *erased) {
+    typename Buckets::iterator it = buckets_[cls].find(g);
+    if (it == buckets_[cls].end()) return;
+    Node **p = &it->second;
+    while (*p) {
+      Node *node = *p;
+      if (node->info.ptr >= start && node->info.ptr < end) {
+        if (erased) erased->push_back(node->info);
+        *p = node->next;
+        delete node;
+        size_--;
+      } else {
+        p = &node->next;
+      }
+    }
+    if (it->second == NULL)
+      buckets_[cls].erase(it);
+  }
+
   bool IsValidPtr(uintptr_t a) {
     return a != 0 && a != (uintptr_t) -1;
   }
-  void Reset() {
-    // Insert a maximal and minimal possible values to make GetInfo simpler.
-    HeapInfo max_info;
-    memset(&max_info, 0, sizeof(HeapInfo));
-    max_info.ptr = (uintptr_t)-1;
-    map_[max_info.ptr] = max_info;
-
-    HeapInfo min_info;
-    memset(&min_info, 0, sizeof(HeapInfo));
-    map_[min_info.ptr] = min_info;
-  }
-  map_t map_;
+
+  Buckets buckets_[kNumClasses];
+  LargeMap large_;
+  size_t size_;
 };
 
+template<class HeapInfo>
+const uintptr_t HeapMap<HeapInfo>::kGranuleLog[HeapMap<HeapInfo>::kNumClasses]
+    = {8, 12, 16, 20};
+
 #endif  // TS_HEAP_INFO_
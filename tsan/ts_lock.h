@@ -83,6 +83,10 @@ ALWAYS_INLINE void ReleaseStore(uintptr_t *ptr, uintptr_t value) {
   *ptr = value;
 }
 
+ALWAYS_INLINE uintptr_t AcquireLoad(const uintptr_t *ptr) {
+  return *ptr;
+}
+
 ALWAYS_INLINE int32_t NoBarrier_AtomicIncrement(int32_t* ptr) {
   return *ptr += 1;
 }
@@ -91,6 +95,13 @@ ALWAYS_INLINE int32_t NoBarrier_AtomicDecrement(int32_t* ptr) {
   return *ptr -= 1;
 }
 
+ALWAYS_INLINE bool AtomicCompareAndSwap(int32_t *ptr, int32_t old_value,
+                                        int32_t new_value) {
+  if (*ptr != old_value) return false;
+  *ptr = new_value;
+  return true;
+}
+
 #elif defined(__GNUC__)
 
 ALWAYS_INLINE uintptr_t AtomicExchange(uintptr_t *ptr, uintptr_t new_value) {
@@ -102,6 +113,12 @@ ALWAYS_INLINE void ReleaseStore(uintptr_t *ptr, uintptr_t value) {
   *(volatile uintptr_t*)ptr = value;
 }
 
+ALWAYS_INLINE uintptr_t AcquireLoad(const uintptr_t *ptr) {
+  uintptr_t value = *(volatile const uintptr_t*)ptr;
+  __asm__ __volatile__("" : : : "memory");
+  return value;
+}
+
 ALWAYS_INLINE int32_t NoBarrier_AtomicIncrement(int32_t* ptr) {
   return __sync_add_and_fetch(ptr, 1);
 }
@@ -110,11 +127,19 @@ ALWAYS_INLINE int32_t NoBarrier_AtomicDecrement(int32_t* ptr) {
   return __sync_sub_and_fetch(ptr, 1);
 }
 
+// Full barrier.
+ALWAYS_INLINE bool AtomicCompareAndSwap(int32_t *ptr, int32_t old_value,
+                                        int32_t new_value) {
+  return __sync_bool_compare_and_swap(ptr, old_value, new_value);
+}
+
 #elif defined(_MSC_VER)
 uintptr_t AtomicExchange(uintptr_t *ptr, uintptr_t new_value);
 void ReleaseStore(uintptr_t *ptr, uintptr_t value);
+uintptr_t AcquireLoad(const uintptr_t *ptr);
 int32_t NoBarrier_AtomicIncrement(int32_t* ptr);
 int32_t NoBarrier_AtomicDecrement(int32_t* ptr);
+bool AtomicCompareAndSwap(int32_t *ptr, int32_t old_value, int32_t new_value);
 
 #else
 # error "unsupported configuration"
@@ -202,6 +202,7 @@ struct PinThread {
   InstrumentedCallStack ic_stack;
   THREADID     tid;
   THREADID     parent_tid;
+  int          parent_uniq_tid;  // -1 if unknown.
   pthread_t    my_ptid;
   size_t       thread_stack_size_if_known;
   size_t       last_child_stack_size_if_known;
@@ -214,6 +215,7 @@ struct PinThread {
   bool         thread_finished;
   bool         thread_done;
   bool         holding_lock;
+  bool         analysis_congested;  // See AnalysisPublish.
   int          n_consumed_events;
 #ifdef _MSC_VER
   enum StartupState {
@@ -495,9 +497,11 @@ static INLINE void TLEBFlushUnlocked(ThreadLocalEventBuffer &tleb) {
       }
       i += n;
     } else if (event == THR_START) {
+      // Don't look at g_pin_threads[t.parent_tid] here: with
+      // --threaded_analysis the parent's slot may have been reused by now.
       uintptr_t parent = -1;
-      if (t.parent_tid != (THREADID)-1) {
-        parent = g_pin_threads[t.parent_tid].uniq_tid;
+      if (t.parent_uniq_tid >= 0) {
+        parent = t.parent_uniq_tid;
       }
       DumpEventInternal(THR_START, t.uniq_tid, 0, 0, parent);
     } else if (event == THR_END) {
@@ -527,6 +531,241 @@ static INLINE void TLEBFlushUnlocked(ThreadLocalEventBuffer &tleb) {
   }
 }
 
+//--------------- Analysis pipeline ----------------- {{{1
+// With --threaded_analysis the application threads do not run the detector.
+// A full (or flushed) TLEB is copied into a per-thread single-producer
+// single-consumer ring of batches and a dedicated PIN internal thread
+// (the analyzer) replays the batches under g_main_ts_lock.
+//
+// Every batch gets a global sequence number when it is published and the
+// analyzer replays the batches strictly in this order. Sync events always
+// end a batch (see TLEBAddGenericEventAndFlush), so a SIGNAL is published
+// before the matching WAIT and the detector sees the same happens-before
+// order as with the inline flush. For the same reason only one analyzer
+// thread makes sense: the detector is serialized by g_main_ts_lock anyway.
+//
+// Backpressure: when a ring is full the producer waits for the analyzer.
+// With --analysis_ring_drop the thread additionally stops recording memory
+// accesses until its ring is half-empty again; routine calls and sync events
+// are never dropped since losing them would produce false reports.
+
+// A published TLEB together with the parts of PinThread which the analyzer
+// needs and which may change once the thread is gone.
+struct AnalysisBatch {
+  uint32_t seq;
+  int      uniq_tid;
+  int      parent_uniq_tid;
+  uint32_t literace_sampling;
+  bool     thread_finished;
+  ThreadLocalEventBuffer tleb;
+};
+
+struct AnalysisRing {
+  AnalysisBatch *batches;  // G_flags->analysis_ring_size elements.
+  uintptr_t head;  // Written only by the consumer, under g_main_ts_lock.
+  uintptr_t tail;  // Written only by the producer.
+  // The analyzer's copy of the thread. PIN reuses THREADIDs, so
+  // g_pin_threads[tid] may already describe a new thread while the batches
+  // of the old one are still in the ring.
+  PinThread replay;
+  // Producer side counters, added to G_stats at exit.
+  uintptr_t n_waits;
+  uintptr_t n_dropped_traces;
+};
+
+static bool g_analysis_threaded;
+static AnalysisRing *g_analysis_rings[kMaxThreads];
+// Number of sequence numbers handed out so far.
+static int32_t g_analysis_seq;
+// The next sequence number to replay. Under g_main_ts_lock.
+static uintptr_t g_analysis_next_seq;
+// g_analysis_seq_owner[seq % kAnalysisSeqWindow] is 1 + the THREADID of the
+// ring holding the batch with this sequence number, or 0 if the batch is
+// not published yet.
+const size_t kAnalysisSeqWindow = 1 << 16;
+static uintptr_t g_analysis_seq_owner[kAnalysisSeqWindow];
+static uintptr_t g_analysis_stop;
+static uintptr_t g_analyzer_running;
+// Traces dropped under --analysis_ring_drop write their addresses here.
+static uintptr_t g_analysis_dropped_mops[kMaxMopsPerTrace];
+
+static INLINE uintptr_t AnalysisLoad(uintptr_t *ptr) {
+  return *(volatile uintptr_t*)ptr;
+}
+
+static INLINE uint32_t AnalysisLoadSeq() {
+  return *(volatile int32_t*)&g_analysis_seq;
+}
+
+static AnalysisRing *AnalysisRingForThread(THREADID tid) {
+  AnalysisRing *ring = g_analysis_rings[tid];
+  if (ring) return ring;
+  // Only the thread itself (or the one which joins it) gets here, so
+  // there is no need to synchronize with other producers.
+  ring = new AnalysisRing;
+  ring->batches = new AnalysisBatch[G_flags->analysis_ring_size];
+  ring->head = ring->tail = 0;
+  ring->replay.tid = tid;
+  ring->replay.uniq_tid = -1;
+  ring->n_waits = ring->n_dropped_traces = 0;
+  ReleaseStore((uintptr_t*)&g_analysis_rings[tid], (uintptr_t)ring);
+  return ring;
+}
+
+// Makes ring->replay describe the thread which published 'b'.
+static void AnalysisUpdateReplayThread(AnalysisRing *ring,
+                                       const AnalysisBatch &b) {
+  PinThread &r = ring->replay;
+  if (r.uniq_tid != b.uniq_tid) {
+    // A new thread with the same THREADID.
+    r.uniq_tid = b.uniq_tid;
+    r.ignore_accesses_depth = 0;
+    r.ignore_sync = 0;
+    r.thread_done = false;
+    ComputeIgnoreAccesses(r);
+  }
+  r.parent_uniq_tid = b.parent_uniq_tid;
+  r.literace_sampling = b.literace_sampling;
+  r.thread_finished = b.thread_finished;
+}
+
+// Replays up to 'max_batches' published batches in sequence order.
+// Returns the number of replayed batches.
+static size_t AnalysisDrain(size_t max_batches) {
+  size_t ring_size = G_flags->analysis_ring_size;
+  size_t n = 0;
+  ScopedLock lock(&g_main_ts_lock);
+  for (; n < max_batches; n++) {
+    uintptr_t seq = g_analysis_next_seq;
+    uintptr_t *owner = &g_analysis_seq_owner[seq % kAnalysisSeqWindow];
+    uintptr_t tid_plus_1 = AnalysisLoad(owner);
+    if (tid_plus_1 == 0) break;
+    AnalysisRing *ring = g_analysis_rings[tid_plus_1 - 1];
+    uintptr_t head = ring->head;
+    uintptr_t tail = AnalysisLoad(&ring->tail);
+    DCHECK(head < tail);
+    AnalysisBatch &b = ring->batches[head % ring_size];
+    CHECK(b.seq == (uint32_t)seq);
+
+    G_stats->analysis_batches++;
+    size_t max_idx = TS_ARRAY_SIZE(G_stats->analysis_ring_occupancy);
+    G_stats->analysis_ring_occupancy[min(ulog2(tail - head), max_idx - 1)]++;
+    uintptr_t lag = (uint32_t)AnalysisLoadSeq() - (uint32_t)seq;
+    G_stats->analysis_lag_sum += lag;
+    G_stats->analysis_max_lag = max(G_stats->analysis_max_lag, lag);
+
+    AnalysisUpdateReplayThread(ring, b);
+    TLEBFlushUnlocked(b.tleb);
+
+    ReleaseStore(&ring->head, head + 1);
+    ReleaseStore(owner, 0);
+    g_analysis_next_seq = seq + 1;
+  }
+  return n;
+}
+
+// Called by producers which have to wait for the analyzer.
+static void AnalysisWaitABit() {
+  if (AnalysisLoad(&g_analyzer_running)) {
+    YIELD();
+  } else {
+    // The analyzer is gone (we are exiting), replay on this thread.
+    AnalysisDrain(kAnalysisSeqWindow);
+  }
+}
+
+// Moves t.tleb into the thread's ring. Called instead of the inline flush.
+static void AnalysisPublish(PinThread &t) {
+  AnalysisRing *ring = AnalysisRingForThread(t.tid);
+  uintptr_t ring_size = G_flags->analysis_ring_size;
+  uintptr_t tail = ring->tail;
+  uintptr_t used = tail - AnalysisLoad(&ring->head);
+  if (used >= ring_size) {
+    ring->n_waits++;
+    if (G_flags->analysis_ring_drop) {
+      t.analysis_congested = true;
+    }
+    while (tail - AnalysisLoad(&ring->head) >= ring_size) {
+      AnalysisWaitABit();
+    }
+  } else if (t.analysis_congested && used < ring_size / 2) {
+    t.analysis_congested = false;
+  }
+
+  AnalysisBatch &b = ring->batches[tail % ring_size];
+  b.uniq_tid = t.uniq_tid;
+  b.parent_uniq_tid = t.parent_uniq_tid;
+  b.literace_sampling = t.literace_sampling;
+  b.thread_finished = t.thread_finished;
+  b.tleb.t = &ring->replay;
+  b.tleb.size = t.tleb.size;
+  memcpy(b.tleb.events, t.tleb.events, t.tleb.size * sizeof(uintptr_t));
+  t.tleb.size = 0;
+
+  uint32_t seq = NoBarrier_AtomicIncrement(&g_analysis_seq) - 1;
+  b.seq = seq;
+  ReleaseStore(&ring->tail, tail + 1);
+  uintptr_t *owner = &g_analysis_seq_owner[seq % kAnalysisSeqWindow];
+  // Non-zero only if the analyzer is kAnalysisSeqWindow batches behind.
+  while (AnalysisLoad(owner) != 0) {
+    AnalysisWaitABit();
+  }
+  ReleaseStore(owner, t.tid + 1);
+}
+
+// Blocks until all the batches published so far have been replayed.
+static void AnalysisWaitForAll() {
+  uint32_t target = AnalysisLoadSeq();
+  while ((int32_t)(target - (uint32_t)AnalysisLoad(&g_analysis_next_seq)) > 0) {
+    AnalysisWaitABit();
+  }
+}
+
+static void AnalyzerThread(void *arg) {
+  while (!AnalysisLoad(&g_analysis_stop)) {
+    if (AnalysisDrain(64) == 0) {
+      YIELD();
+    }
+  }
+  AnalysisDrain(kAnalysisSeqWindow);
+  ReleaseStore(&g_analyzer_running, 0);
+}
+
+static void AnalysisInit() {
+  g_analysis_threaded = G_flags->threaded_analysis;
+  if (!g_analysis_threaded) return;
+  if (TS_SERIALIZED == 0 || g_race_verifier_active ||
+      G_flags->offline || G_flags->dry_run) {
+    Report("WARNING: --threaded_analysis is ignored in this mode\n");
+    g_analysis_threaded = false;
+    return;
+  }
+  g_analyzer_running = 1;
+  THREADID tid = PIN_SpawnInternalThread(AnalyzerThread, NULL, 0, NULL);
+  CHECK(tid != INVALID_THREADID);
+}
+
+// Stops the analyzer thread. Whatever gets published after this point
+// is replayed by the producers themselves (see AnalysisWaitABit).
+static void AnalysisStop(void *v) {
+  if (!g_analysis_threaded) return;
+  ReleaseStore(&g_analysis_stop, 1);
+  while (AnalysisLoad(&g_analyzer_running)) {
+    YIELD();
+  }
+}
+
+static void AnalysisFini() {
+  if (!g_analysis_threaded) return;
+  AnalysisWaitForAll();
+  for (THREADID tid = 0; tid < kMaxThreads; tid++) {
+    AnalysisRing *ring = g_analysis_rings[tid];
+    if (!ring) continue;
+    G_stats->analysis_producer_waits += ring->n_waits;
+    G_stats->analysis_dropped_traces += ring->n_dropped_traces;
+  }
+}
+
 static INLINE void TLEBFlushLocked(PinThread &t) {
 #if TS_SERIALIZED==1
   if (G_flags->dry_run) {
@@ -534,6 +773,10 @@ static INLINE void TLEBFlushLocked(PinThread &t) {
     return;
   }
   CHECK(t.tleb.size <= kThreadLocalEventBufferSize);
+  if (g_analysis_threaded) {
+    if (t.tleb.size) AnalysisPublish(t);
+    return;
+  }
   G_stats->lock_sites[0]++;
   ScopedLock lock(&g_main_ts_lock);
   TLEBFlushUnlocked(t.tleb);
@@ -898,6 +1141,11 @@ static void DebugOnlyShowPcAndSp(const char *where, THREADID tid,
 
 static uintptr_t WRAP_NAME(ThreadSanitizerQuery)(WRAP_PARAM4) {
   const char *query = (const char*)arg0;
+  if (g_analysis_threaded) {
+    // The answer depends on the events still sitting in the rings.
+    TLEBFlushLocked(g_pin_threads[tid]);
+    AnalysisWaitForAll();
+  }
   return (uintptr_t)ThreadSanitizerQuery(query);
 }
 
@@ -1086,11 +1334,15 @@ void CallbackForThreadStart(THREADID tid, CONTEXT *ctxt,
   PIN_SetContextReg(ctxt, tls_reg, (ADDRINT)&t.tleb.events[2]);
 
   t.parent_tid = -1;
+  t.parent_uniq_tid = -1;
   if (has_parent) {
     t.parent_tid = g_tid_of_thread_which_called_create_thread;
 #if !defined(_MSC_VER)  // On Windows, threads may appear out of thin air.
     CHECK(t.parent_tid != (THREADID)-1);
 #endif  // _MSC_VER
+    if (t.parent_tid != (THREADID)-1) {
+      t.parent_uniq_tid = g_pin_threads[t.parent_tid].uniq_tid;
+    }
   }
 
   if (debug_thread) {
@@ -1943,6 +2195,13 @@ static void OnTraceSerial(THREADID tid, ADDRINT sp, TraceInfo *trace_info,
 
   UpdateCallStack(t, sp);
 
+  if (t.analysis_congested) {
+    // --analysis_ring_drop: the analyzer is behind, don't record the mops.
+    g_analysis_rings[tid]->n_dropped_traces++;
+    *tls_reg_p = g_analysis_dropped_mops;
+    return;
+  }
+
   t.trace_info = trace_info;
   trace_info->counter()++;
   *tls_reg_p = TLEBAddTrace(t);
@@ -3489,6 +3748,7 @@ static BOOL CallbackForExec(CHILD_PROCESS childProcess, VOID *val) {
 //--------- Fini ---------- {{{1
 static void CallbackForFini(INT32 code, void *v) {
   DumpEvent(0, THR_END, 0, 0, 0, 0);
+  AnalysisFini();
   ThreadSanitizerFini();
   if (g_race_verifier_active) {
     RaceVerifierFini();
@@ -3649,6 +3909,7 @@ int main(INT32 argc, CHAR **argv) {
   // Set up PIN callbacks.
   PIN_AddThreadStartFunction(CallbackForThreadStart, 0);
   PIN_AddThreadFiniFunction(CallbackForThreadFini, 0);
+  PIN_AddPrepareForFiniFunction(AnalysisStop, 0);
   PIN_AddFiniFunction(CallbackForFini, 0);
   IMG_AddInstrumentFunction(CallbackForIMG, 0);
   TRACE_AddInstrumentFunction(CallbackForTRACE, 0);
@@ -3668,6 +3929,8 @@ int main(INT32 argc, CHAR **argv) {
     global_ignore = true;
   }
 
+  AnalysisInit();
+
   // Fire!
   PIN_StartProgram();
   return 0;
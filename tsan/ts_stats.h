@@ -44,13 +44,20 @@ struct ThreadLocalStats {
   uintptr_t memory_access_sizes[18];
   uintptr_t events[LAST_EVENT];
   uintptr_t unlocked_access_ok;
+  uintptr_t events_without_ts_lock;
+  uintptr_t l0_line_cache_hit, l0_line_cache_miss;
+  uintptr_t shard_fetch;
+  uintptr_t mops_grouped_by_line;
+  uintptr_t segment_filter_hit, segment_filter_miss;
+  uintptr_t race_verdict_cache_hit, race_verdict_cache_miss;
+  uintptr_t unlocked_ss_transition_ok, unlocked_ss_transition_fail;
   uintptr_t n_fast_access1, n_fast_access2, n_fast_access4, n_fast_access8,
             n_slow_access1, n_slow_access2, n_slow_access4, n_slow_access8,
             n_very_slow_access, n_access_slow_iter;
 
   uintptr_t mops_per_trace[16];
   uintptr_t locks_per_trace[16];
-  uintptr_t locked_access[8];
+  uintptr_t locked_access[9];
   uintptr_t history_uses_same_segment, history_creates_new_segment,
             history_reuses_segment, history_uses_preallocated_segment;
 
@@ -93,6 +100,8 @@ struct Stats : private ThreadLocalStats {
            vts_total_create,
            vts_total_create / (vts_create_small + vts_create_big + 1),
            vts_total_delete);
+    Printf("   VTS in place: tick: %'ld; join: %'ld; dense created: %'ld\n",
+           vts_tick_in_place, vts_join_in_place, vts_create_dense);
     Printf("   n_seg_hb        = %'ld\n", n_seg_hb);
     Printf("   n_vts_hb        = %'ld\n", n_vts_hb);
     Printf("   n_vts_hb_cached = %'ld\n", n_vts_hb_cached);
@@ -116,21 +125,69 @@ struct Stats : private ThreadLocalStats {
            publish_set, publish_get, publish_clear);
 
     Printf("   PcTo: all: %'ld\n", pc_to_strings);
+    Printf("   Suppression verdicts: cached: %'ld; matched: %'ld\n",
+           suppression_verdict_cache_hit, suppression_verdict_cache_miss);
 
     Printf("   StackTrace: create: %'ld; delete %'ld\n",
            stack_trace_create, stack_trace_delete);
+    Printf("   StackDepot: put: %'ld; new: %'ld\n",
+           stack_depot_put, stack_depot_new);
 
     Printf("   History segments: same: %'ld; reuse: %'ld; "
            "preallocated: %'ld; new: %'ld\n",
            history_uses_same_segment, history_reuses_segment,
            history_uses_preallocated_segment, history_creates_new_segment);
+    if (history_ring_blocks) {
+      Printf("   History ring: blocks: %'ld; replays: %'ld; lost: %'ld\n",
+             history_ring_blocks, history_ring_replays, history_ring_lost);
+    }
     Printf("   Forget all history: %'ld\n", n_forgets);
 
     PrintStatsForSeg();
+    PrintStatsForGC();
+    Printf("   Memory budget: dropped lines: %'ld (%'ldK); "
+           "released history chunks: %'ld; flushes: %'ld\n",
+           mem_dropped_lines, mem_dropped_line_bytes >> 10,
+           mem_released_history_chunks, mem_budget_flushes);
+    if (spill_lines) {
+      Printf("   Spill: lines: %'ld (%'ld us); fault-ins: %'ld "
+             "(%'ld us, max %'ld us)\n",
+             spill_lines, spill_time_us, spill_faults,
+             spill_fault_time_us, spill_fault_max_us);
+    }
+    Printf("   Lazy clear: ranges: %'ld; lines: %'ld; flushes: %'ld (%'ld ms)\n",
+           lazy_clear_ranges, lazy_clear_lines,
+           lazy_clear_flushes, lazy_clear_flush_ms);
+    PrintStatsForAnalysis();
     PrintStatsForSS();
     PrintStatsForLS();
   }
 
+  void PrintStatsForGC() {
+    Printf("   GC: slices: %'ld; full cycles: %'ld; lines: %'ld; "
+           "avoided flushes: %'ld\n",
+           gc_slices, gc_full_cycles, gc_lines_scanned, gc_avoided_flushes);
+    Printf("   GC: svals shrunk: %'ld; cleared: %'ld; "
+           "pause total/max: %'ld / %'ld ms\n",
+           gc_svals_shrunk, gc_svals_cleared,
+           gc_total_pause_ms, gc_max_pause_ms);
+  }
+
+  void PrintStatsForAnalysis() {
+    if (analysis_batches == 0) return;
+    Printf("   Analysis: batches: %'ld; producer waits: %'ld; "
+           "dropped traces: %'ld\n",
+           analysis_batches, analysis_producer_waits,
+           analysis_dropped_traces);
+    Printf("   Analysis lag (batches): avg: %'ld; max: %'ld\n",
+           analysis_lag_sum / analysis_batches, analysis_max_lag);
+    Printf("   Analysis ring occupancy (log2):");
+    for (size_t i = 0; i < TS_ARRAY_SIZE(analysis_ring_occupancy); i++) {
+      Printf(" %'ld", analysis_ring_occupancy[i]);
+    }
+    Printf("\n");
+  }
+
   void PrintStatsForSS() {
     Printf("   SegmentSet: created: %'ld; reused: %'ld;"
            " find: %'ld; recycle: %'ld\n",
@@ -162,10 +219,13 @@ struct Stats : private ThreadLocalStats {
            "    new       = %'ld\n"
            "    delete    = %'ld\n"
            "    fetch     = %'ld\n"
-           "    storage   = %'ld\n",
+           "    storage   = %'ld\n"
+           "    compress  = %'ld\n"
+           "    inflate   = %'ld\n",
            cache_new_line,
            cache_delete_empty_line, cache_fetch,
-           cache_max_storage_size);
+           cache_max_storage_size,
+           cache_compress, cache_inflate);
   }
 
   void PrintStatsForSeg() {
@@ -180,6 +240,8 @@ struct Stats : private ThreadLocalStats {
            ls_remove_from_singleton, ls_remove_from_multi);
     Printf("   LockSet cache: add : %'ld; rem : %'ld; fast: %'ld\n",
            ls_add_cache_hit, ls_rem_cache_hit, ls_cache_fast);
+    Printf("   LockSet intersection: mask: %'ld; slow: %'ld\n",
+           ls_intersection_mask, ls_intersection_slow);
     Printf("   LockSet size: 2: %'ld 3: %'ld 4: %'ld 5: %'ld other: %'ld\n",
            ls_size_2, ls_size_3, ls_size_4, ls_size_5, ls_size_other);
   }
@@ -215,6 +277,19 @@ struct Stats : private ThreadLocalStats {
     Printf("lock_sites[*]=%ld\n", total_locks);
     Printf("futex_wait   =%ld\n", futex_wait);
     Printf("unlocked_access_ok =%'ld\n", unlocked_access_ok);
+    Printf("events w/o ts_lock =%'ld\n", events_without_ts_lock);
+    Printf("L0 line cache hit/miss =%'ld / %'ld\n",
+           l0_line_cache_hit, l0_line_cache_miss);
+    Printf("Shadow shard fetches =%'ld\n", shard_fetch);
+    Printf("Mops handled a line at a time =%'ld\n", mops_grouped_by_line);
+    uintptr_t filter_lookups = segment_filter_hit + segment_filter_miss;
+    Printf("Segment access filter hit/miss =%'ld / %'ld (%ld%%)\n",
+           segment_filter_hit, segment_filter_miss,
+           filter_lookups ? segment_filter_hit * 100 / filter_lookups : 0);
+    Printf("Race verdict cache hit/miss =%'ld / %'ld\n",
+           race_verdict_cache_hit, race_verdict_cache_miss);
+    Printf("unlocked SS transitions ok/fail =%'ld / %'ld\n",
+           unlocked_ss_transition_ok, unlocked_ss_transition_fail);
     uintptr_t all_locked_access = 0;
     for (size_t i = 0; i < TS_ARRAY_SIZE(locked_access); i++) {
       uintptr_t t = locked_access[i];
@@ -222,6 +297,13 @@ struct Stats : private ThreadLocalStats {
       all_locked_access += t;
     }
     Printf("locked_access[*]   =%'ld\n", all_locked_access);
+    for (size_t i = 0; i < TS_ARRAY_SIZE(subsystem_lock_sites); i++) {
+      if (subsystem_lock_sites[i] == 0) continue;
+      Printf("subsystem_lock[%ld] =%'ld (contended: %'ld)\n", i,
+             subsystem_lock_sites[i], subsystem_lock_contention[i]);
+    }
+    Printf("free list magazine refills/flushes =%'ld / %'ld\n",
+           magazine_refills, magazine_flushes);
     Printf("try_acquire_line_spin =%ld\n", try_acquire_line_spin);
     Printf("access to first 1/2/4 G: %'ld %'ld %'ld\n",
            access_to_first_1g, access_to_first_2g, access_to_first_4g);
@@ -250,12 +332,15 @@ struct Stats : private ThreadLocalStats {
             ls_remove_from_singleton, ls_remove_from_multi,
             ls_add_cache_hit, ls_rem_cache_hit,
             ls_cache_fast,
+            ls_intersection_mask, ls_intersection_slow,
             ls_size_2, ls_size_3, ls_size_4, ls_size_5, ls_size_other;
 
   uintptr_t cache_new_line;
   uintptr_t cache_delete_empty_line;
   uintptr_t cache_fetch;
   uintptr_t cache_max_storage_size;
+  uintptr_t cache_compress;
+  uintptr_t cache_inflate;
 
   uintptr_t mops_total;
   uintptr_t mops_uniq;
@@ -263,6 +348,11 @@ struct Stats : private ThreadLocalStats {
   uintptr_t vts_create_big, vts_create_small,
             vts_clone, vts_delete_small, vts_delete_big,
             vts_total_delete, vts_total_create;
+  uintptr_t vts_tick_in_place, vts_join_in_place;
+  uintptr_t vts_create_dense;
+
+  // See FreeListMagazine.
+  uintptr_t magazine_refills, magazine_flushes;
 
   uintptr_t ss_create, ss_reuse, ss_find, ss_recycle;
   uintptr_t ss_size_2, ss_size_3, ss_size_4, ss_size_other;
@@ -275,11 +365,41 @@ struct Stats : private ThreadLocalStats {
 
   uintptr_t pc_to_strings;
 
+  uintptr_t suppression_verdict_cache_hit, suppression_verdict_cache_miss;
+
   uintptr_t stack_trace_create, stack_trace_delete;
 
+  uintptr_t stack_depot_put, stack_depot_new;
+
   uintptr_t n_forgets;
 
+  // See EventHistoryRing.
+  uintptr_t history_ring_blocks, history_ring_replays, history_ring_lost;
+
+  uintptr_t gc_slices, gc_full_cycles, gc_lines_scanned, gc_avoided_flushes;
+  uintptr_t gc_svals_shrunk, gc_svals_cleared;
+  uintptr_t gc_total_pause_ms, gc_max_pause_ms;
+
+  // See Detector::EnforceMemoryBudget.
+  uintptr_t mem_dropped_lines, mem_dropped_line_bytes;
+  uintptr_t mem_released_history_chunks, mem_budget_flushes;
+
+  // See ShadowSpill.
+  uintptr_t spill_lines, spill_time_us;
+  uintptr_t spill_faults, spill_fault_time_us, spill_fault_max_us;
+
+  uintptr_t lazy_clear_ranges, lazy_clear_lines;
+  uintptr_t lazy_clear_flushes, lazy_clear_flush_ms;
+
+  // See --threaded_analysis in ts_pin.cc.
+  uintptr_t analysis_batches, analysis_producer_waits, analysis_dropped_traces;
+  uintptr_t analysis_lag_sum, analysis_max_lag;
+  uintptr_t analysis_ring_occupancy[8];
+
   uintptr_t lock_sites[20];
+  // Indexed by SubsystemLockId, used with --locking_scheme=2.
+  uintptr_t subsystem_lock_sites[16];
+  uintptr_t subsystem_lock_contention[16];
 
   uintptr_t tleb_flush[10];
 
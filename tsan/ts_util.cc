@@ -57,6 +57,9 @@ int getpid() { return WINDOWS::GetCurrentProcessId(); }
 size_t TimeInMilliSeconds() {
   return VG_(read_millisecond_timer)();
 }
+size_t TimeInMicroSeconds() {
+  return VG_(read_millisecond_timer)() * 1000;
+}
 #else
 // TODO(kcc): implement this.
 size_t TimeInMilliSeconds() {
@@ -66,6 +69,18 @@ size_t TimeInMilliSeconds() {
   return WINDOWS::timeGetTime();
 #endif
 }
+#ifdef __GNUC__
+#include <sys/time.h>
+size_t TimeInMicroSeconds() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+#else
+size_t TimeInMicroSeconds() {
+  return WINDOWS::timeGetTime() * 1000;
+}
+#endif
 #endif
 
 Stats *G_stats;
@@ -501,6 +516,28 @@ void OpenFileWriteStringAndClose(const string &file_name, const string &str) {
 #endif
 }
 
+//--------- Memory-mapped files ------------------ {{{1
+#if defined(__GNUC__) && !defined(TS_VALGRIND)
+#include <fcntl.h>
+#include <sys/mman.h>
+void *MapTemporaryFile(const string &file_name, size_t size) {
+  int fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) return NULL;
+  unlink(file_name.c_str());
+  void *res = NULL;
+  if (ftruncate(fd, size) == 0) {
+    res = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (res == MAP_FAILED) res = NULL;
+  }
+  close(fd);
+  return res;
+}
+#else
+void *MapTemporaryFile(const string &file_name, size_t size) {
+  return NULL;  // unimplemented.
+}
+#endif
+
 //--------- Sockets ------------------ {{{1
 #if defined(TS_PIN) && defined(__GNUC__)
 #include <sys/types.h>
@@ -810,6 +847,11 @@ void ReleaseStore(uintptr_t *ptr, uintptr_t value) {
   // TODO(kcc): anything to add here?
 }
 
+uintptr_t AcquireLoad(const uintptr_t *ptr) {
+  // Volatile reads have acquire semantics in MSVC.
+  return *(volatile const uintptr_t*)ptr;
+}
+
 int32_t NoBarrier_AtomicIncrement(int32_t* ptr) {
   return _InterlockedIncrement((volatile WINDOWS::LONG *)ptr);
 }
@@ -817,6 +859,11 @@ int32_t NoBarrier_AtomicIncrement(int32_t* ptr) {
 int32_t NoBarrier_AtomicDecrement(int32_t* ptr) {
   return _InterlockedDecrement((volatile WINDOWS::LONG *)ptr);
 }
+
+bool AtomicCompareAndSwap(int32_t *ptr, int32_t old_value, int32_t new_value) {
+  return _InterlockedCompareExchange((volatile WINDOWS::LONG *)ptr,
+                                     new_value, old_value) == old_value;
+}
 #endif  // _MSC_VER && TS_SERIALIZED
 //--------------- YIELD ----------------- {{{1
 #if defined (_MSC_VER)
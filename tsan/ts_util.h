@@ -205,6 +205,7 @@ using STD::set_intersection;
 using STD::lower_bound;
 using STD::copy;
 using STD::binary_search;
+using STD::equal;
 
 #ifdef TS_LLVM
 # include "tsan_rtl_wrap.h"
@@ -355,6 +356,7 @@ struct ThreadSanitizerReport;
 
 // Time since some moment before the program start.
 extern size_t TimeInMilliSeconds();
+extern size_t TimeInMicroSeconds();
 extern void YIELD();
 extern void PROCESSOR_YIELD();
 
@@ -372,6 +374,9 @@ size_t GetMemoryLimitInMbFromProcSelfLimits();
 
 // Sets the contents of the file 'file_name' to 'str'.
 void OpenFileWriteStringAndClose(const string &file_name, const string &str);
+// Creates a new file of `size` bytes, maps it shared and unlinks it, so the
+// file goes away with the process. Returns NULL on failure.
+void *MapTemporaryFile(const string &file_name, size_t size);
 
 // If host_and_port looks like myhost:12345, open a socket for writing
 // and returns a FILE object. Retuns NULL on failure.
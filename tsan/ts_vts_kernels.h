@@ -0,0 +1,254 @@
+/* Copyright (c) 2011, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// This file is part of ThreadSanitizer, a dynamic data race detector.
+#ifndef TS_VTS_KERNELS_H_
+#define TS_VTS_KERNELS_H_
+
+#include "ts_util.h"
+
+// Merge kernels used by class VTS (vector time stamp).
+// A VTS is stored either
+//  - sparse: an array of (tid, clk) pairs sorted by tid, clk > 0, or
+//  - dense: an array of clocks indexed by tid, 0 meaning "no such tid".
+// The dense kernels process 4 clocks at a time with SSE2 where available.
+// SSE2 is a part of the x86-64 baseline so no run-time dispatch is needed.
+// Valgrind tools are built w/o the libc headers <emmintrin.h> depends on,
+// so they always use the scalar code.
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(TS_VALGRIND)
+# define TS_VTS_SSE2 1
+# include <emmintrin.h>
+#else
+# define TS_VTS_SSE2 0
+#endif
+
+struct VtsTs {
+  int32_t tid;
+  int32_t clk;
+};
+
+// -------- Sparse kernels ---------- {{{1
+// Returns true if a happens-before b.
+static inline bool SparseVtsHappensBefore(const VtsTs *a, size_t na,
+                                          const VtsTs *b, size_t nb) {
+  const VtsTs *a_max = a + na;
+  const VtsTs *b_max = b + nb;
+  bool a_less_than_b = false;
+  while (a < a_max && b < b_max) {
+    if (a->tid < b->tid) {
+      // a->tid is not present in b.
+      return false;
+    } else if (a->tid > b->tid) {
+      // b->tid is not present in a.
+      a_less_than_b = true;
+      b++;
+    } else {
+      // this tid is present in both VTSs. Compare clocks.
+      if (a->clk > b->clk) return false;
+      if (a->clk < b->clk) a_less_than_b = true;
+      a++;
+      b++;
+    }
+  }
+  if (a < a_max) {
+    // Some tids are present in a and not in b
+    return false;
+  }
+  if (b < b_max) {
+    return true;
+  }
+  return a_less_than_b;
+}
+
+// Writes the join of a and b to res (at least na + nb elements),
+// returns the size of the result.
+static inline size_t SparseVtsJoin(const VtsTs *a, size_t na,
+                                   const VtsTs *b, size_t nb, VtsTs *res) {
+  VtsTs *t = res;
+  const VtsTs *a_max = a + na;
+  const VtsTs *b_max = b + nb;
+  while (a < a_max && b < b_max) {
+    if (a->tid < b->tid) {
+      *t++ = *a++;
+    } else if (a->tid > b->tid) {
+      *t++ = *b++;
+    } else {
+      *t++ = a->clk >= b->clk ? *a : *b;
+      a++;
+      b++;
+    }
+  }
+  while (a < a_max) *t++ = *a++;
+  while (b < b_max) *t++ = *b++;
+  return t - res;
+}
+
+// -------- Dense kernels ----------- {{{1
+// Scalar versions. Also used for the tails of the SIMD versions.
+enum DenseVtsOrder {
+  kDenseVtsNotBefore,  // a[i] > b[i] for some i.
+  kDenseVtsEqual,      // a[i] == b[i] for all i.
+  kDenseVtsBefore      // a[i] <= b[i] for all i, and a != b.
+};
+
+static inline DenseVtsOrder DenseVtsCompareScalar(const int32_t *a, size_t na,
+                                                  const int32_t *b,
+                                                  size_t nb) {
+  size_t n = min(na, nb);
+  bool a_less_than_b = false;
+  for (size_t i = 0; i < n; i++) {
+    if (a[i] > b[i]) return kDenseVtsNotBefore;
+    if (a[i] < b[i]) a_less_than_b = true;
+  }
+  for (size_t i = n; i < na; i++) {
+    if (a[i]) return kDenseVtsNotBefore;
+  }
+  for (size_t i = n; i < nb && !a_less_than_b; i++) {
+    if (b[i]) a_less_than_b = true;
+  }
+  return a_less_than_b ? kDenseVtsBefore : kDenseVtsEqual;
+}
+
+static inline bool DenseVtsHappensBeforeScalar(const int32_t *a, size_t na,
+                                               const int32_t *b, size_t nb) {
+  return DenseVtsCompareScalar(a, na, b, nb) == kDenseVtsBefore;
+}
+
+// res has max(na, nb) elements and may be the same as a.
+static inline void DenseVtsJoinScalar(const int32_t *a, size_t na,
+                                      const int32_t *b, size_t nb,
+                                      int32_t *res) {
+  size_t n = min(na, nb);
+  for (size_t i = 0; i < n; i++) {
+    res[i] = max(a[i], b[i]);
+  }
+  for (size_t i = n; i < na; i++) res[i] = a[i];
+  for (size_t i = n; i < nb; i++) res[i] = b[i];
+}
+
+#if TS_VTS_SSE2
+static inline bool DenseVtsHappensBefore(const int32_t *a, size_t na,
+                                         const int32_t *b, size_t nb) {
+  size_t n = min(na, nb) & ~(size_t)3;
+  __m128i less = _mm_setzero_si128();
+  for (size_t i = 0; i < n; i += 4) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+    if (_mm_movemask_epi8(_mm_cmpgt_epi32(va, vb)))
+      return false;
+    less = _mm_or_si128(less, _mm_cmplt_epi32(va, vb));
+  }
+  DenseVtsOrder tail = DenseVtsCompareScalar(a + n, na - n, b + n, nb - n);
+  if (tail == kDenseVtsNotBefore) return false;
+  return tail == kDenseVtsBefore || _mm_movemask_epi8(less) != 0;
+}
+
+static inline void DenseVtsJoin(const int32_t *a, size_t na,
+                                const int32_t *b, size_t nb, int32_t *res) {
+  size_t n = min(na, nb) & ~(size_t)3;
+  for (size_t i = 0; i < n; i += 4) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+    // No _mm_max_epi32 in SSE2.
+    __m128i a_gt = _mm_cmpgt_epi32(va, vb);
+    __m128i vmax = _mm_or_si128(_mm_and_si128(a_gt, va),
+                                _mm_andnot_si128(a_gt, vb));
+    _mm_storeu_si128((__m128i*)(res + i), vmax);
+  }
+  DenseVtsJoinScalar(a + n, na - n, b + n, nb - n, res + n);
+}
+#else  // TS_VTS_SSE2
+static inline bool DenseVtsHappensBefore(const int32_t *a, size_t na,
+                                         const int32_t *b, size_t nb) {
+  return DenseVtsHappensBeforeScalar(a, na, b, nb);
+}
+
+static inline void DenseVtsJoin(const int32_t *a, size_t na,
+                                const int32_t *b, size_t nb, int32_t *res) {
+  DenseVtsJoinScalar(a, na, b, nb, res);
+}
+#endif  // TS_VTS_SSE2
+
+// -------- Mixed kernels ----------- {{{1
+// One VTS is sparse and the other is dense. Linear in the sizes of both.
+static inline bool SparseDenseVtsHappensBefore(const VtsTs *a, size_t na,
+                                               const int32_t *b, size_t nb) {
+  bool a_less_than_b = false;
+  for (size_t i = 0; i < na; i++) {
+    int32_t b_clk = (size_t)a[i].tid < nb ? b[a[i].tid] : 0;
+    if (a[i].clk > b_clk) return false;
+    if (a[i].clk < b_clk) a_less_than_b = true;
+  }
+  if (a_less_than_b) return true;
+  // All tids of a are in b with the same clocks. Does b have more tids?
+  size_t n_tids_in_b = 0;
+  for (size_t i = 0; i < nb; i++) {
+    n_tids_in_b += b[i] != 0;
+  }
+  return n_tids_in_b > na;
+}
+
+static inline bool DenseSparseVtsHappensBefore(const int32_t *a, size_t na,
+                                               const VtsTs *b, size_t nb) {
+  bool a_less_than_b = false;
+  const VtsTs *b_max = b + nb;
+  for (size_t tid = 0; tid < na; tid++) {
+    if (!a[tid]) continue;
+    while (b < b_max && (size_t)b->tid < tid) {
+      // b->tid is not present in a.
+      a_less_than_b = true;
+      b++;
+    }
+    if (b == b_max || (size_t)b->tid != tid) {
+      // tid is not present in b.
+      return false;
+    }
+    if (a[tid] > b->clk) return false;
+    if (a[tid] < b->clk) a_less_than_b = true;
+    b++;
+  }
+  return a_less_than_b || b < b_max;
+}
+
+// res has max(na, b[nb-1].tid + 1) elements and may be the same as a.
+static inline void DenseSparseVtsJoin(const int32_t *a, size_t na,
+                                      const VtsTs *b, size_t nb,
+                                      int32_t *res, size_t n_res) {
+  if (res != a) {
+    memcpy(res, a, na * sizeof(int32_t));
+  }
+  if (n_res > na) {
+    memset(res + na, 0, (n_res - na) * sizeof(int32_t));
+  }
+  for (size_t i = 0; i < nb; i++) {
+    res[b[i].tid] = max(res[b[i].tid], b[i].clk);
+  }
+}
+
+// end. {{{1
+#endif  // TS_VTS_KERNELS_H_
+// vim:shiftwidth=2:softtabstop=2:expandtab:tw=80